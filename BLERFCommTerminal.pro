@@ -6,10 +6,12 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(core.pri)
+
 SOURCES += \
-        blecomm.cpp \
-        blerfcomm.cpp \
-        blescanner.cpp \
+        devicemodel.cpp \
+        headlesssession.cpp \
+        logmodel.cpp \
         main.cpp \
         uicontroller.cpp
 
@@ -27,7 +29,7 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
-    blecomm.hpp \
-    blerfcomm.hpp \
-    blescanner.hpp \
+    devicemodel.hpp \
+    headlesssession.hpp \
+    logmodel.hpp \
     uicontroller.hpp
@@ -0,0 +1,39 @@
+#include "allocationcounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+namespace {
+std::atomic<quint64> allocations{0};
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+
+void* malloc(std::size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, std::size_t size) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+
+auto AllocationCounter::supported() -> bool { return true; }
+#else
+auto AllocationCounter::supported() -> bool { return false; }
+#endif
+
+auto AllocationCounter::count() -> quint64 {
+  return allocations.load(std::memory_order_relaxed);
+}
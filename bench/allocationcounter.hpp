@@ -0,0 +1,10 @@
+#pragma once
+#include <QtGlobal>
+
+// Counts heap allocations made by the whole process (malloc, calloc,
+// realloc and everything built on top of them, operator new included).
+// Only available with glibc, where malloc can be interposed.
+namespace AllocationCounter {
+auto supported() -> bool;
+auto count() -> quint64;
+}  // namespace AllocationCounter
@@ -0,0 +1,29 @@
+QT -= gui
+QT += bluetooth
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = blerfcomm-bench
+
+include(../core.pri)
+
+SOURCES += \
+        allocationcounter.cpp \
+        benchutils.cpp \
+        compressionbench.cpp \
+        jitterbench.cpp \
+        main.cpp \
+        poolbench.cpp \
+        replaybench.cpp \
+        rpcbench.cpp \
+        rxbench.cpp \
+        schemabench.cpp \
+        stripingbench.cpp \
+        throughputbench.cpp
+
+HEADERS += \
+    allocationcounter.hpp \
+    benchsuites.hpp \
+    benchutils.hpp \
+    feedtransport.hpp
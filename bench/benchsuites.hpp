@@ -0,0 +1,30 @@
+#pragma once
+
+#include "benchutils.hpp"
+
+// End-to-end sendData -> echo -> dataReceived over SimulatedTransport.
+auto runThroughputBench(BenchOptions const& options) -> int;
+
+// Receive latency with a busy main thread, stack on it vs. on its own thread.
+auto runJitterBench(BenchOptions const& options) -> int;
+
+// Aggregate throughput of a ConnectionPool as the device count grows.
+auto runPoolBench(BenchOptions const& options) -> int;
+
+// Cost and heap allocations per message of the receive path alone.
+auto runRxBench(BenchOptions const& options) -> int;
+
+// Receive path cost on the notifications of a recorded capture file.
+auto runReplayBench(BenchOptions const& options) -> int;
+
+// Goodput of representative payloads with and without compression.
+auto runCompressionBench(BenchOptions const& options) -> int;
+
+// RpcClient calls per second and latency, lockstep vs. pipelined.
+auto runRpcBench(BenchOptions const& options) -> int;
+
+// Goodput over the main characteristic alone vs. striped over bulk ones.
+auto runStripingBench(BenchOptions const& options) -> int;
+
+// Typed message encode/decode cost, MessageSchema vs. QDataStream.
+auto runSchemaBench(BenchOptions const& options) -> int;
@@ -0,0 +1,63 @@
+#include "benchutils.hpp"
+
+#include <QBluetoothAddress>
+#include <algorithm>
+#include <cmath>
+
+#include "blerfcomm.hpp"
+#include "simulatedtransport.hpp"
+
+auto simulatedDevice(int index) -> QBluetoothDeviceInfo {
+  auto const address =
+      QString("00:00:00:00:%1:%2")
+          .arg((index >> 8) & 0xFF, 2, 16, QChar('0'))
+          .arg(index & 0xFF, 2, 16, QChar('0'))
+          .toUpper();
+  return QBluetoothDeviceInfo{QBluetoothAddress{address},
+                              QString("Simulated #%1").arg(index), 0};
+}
+
+auto makeSimulatedTransport(BenchOptions const& options)
+    -> SimulatedTransport* {
+  auto* transport = new SimulatedTransport{};
+  transport->setMtu(options.mtu);
+  transport->setNotificationChunkSize(options.notificationChunkSize);
+  transport->setPacketDelay(options.packetDelayUs);
+  transport->setLossRate(options.lossRate);
+  transport->setSeed(options.seed);
+  return transport;
+}
+
+void setUpSimulatedLink(BLERFComm& comm, BenchOptions const& options) {
+  comm.setTransport(makeSimulatedTransport(options));
+  applyWriteOptions(comm, options);
+}
+
+void applyWriteOptions(BLERFComm& comm, BenchOptions const& options) {
+  comm.comm()->setWriteWithoutResponseAllowed(!options.writeWithResponse);
+  comm.comm()->setMaxWritesInFlight(options.writesInFlight);
+  comm.setCoalescingEnabled(options.coalesceDelayMs >= 0);
+  comm.setCoalescingDelay(options.coalesceDelayMs);
+}
+
+auto percentile(std::vector<qint64> samples, double p) -> qint64 {
+  if (samples.empty()) {
+    return 0;
+  }
+
+  auto rank = static_cast<std::size_t>(
+      std::ceil(p * static_cast<double>(samples.size())));
+  rank = std::clamp<std::size_t>(rank, 1, samples.size()) - 1;
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+auto formatRate(double perSecond) -> QString {
+  if (perSecond >= 1e6) {
+    return QString("%1M").arg(perSecond / 1e6, 0, 'f', 2);
+  }
+  if (perSecond >= 1e3) {
+    return QString("%1k").arg(perSecond / 1e3, 0, 'f', 2);
+  }
+  return QString::number(perSecond, 'f', 1);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <QBluetoothDeviceInfo>
+#include <QEventLoop>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <vector>
+
+class BLERFComm;
+class SimulatedTransport;
+
+// per packet delay for suites that need the link, not the CPU, to be the
+// bottleneck when no --delay is given - roughly a 7.5 ms connection interval
+// with 6 packets per event
+constexpr int AirtimePacketDelayUs{1250};
+
+struct BenchOptions {
+  int messages{2000};
+  QVector<int> sizes{4, 16, 64, 128, 254, 1024, 4096};
+  int window{8};
+  int mtu{23};
+  int notificationChunkSize{20};
+  int packetDelayUs{0};
+  int writesInFlight{4};
+  bool writeWithResponse{false};
+  // send coalescing delay in ms, disabled when negative
+  int coalesceDelayMs{-1};
+  double lossRate{0.0};
+  quint32 seed{1};
+  int devices{7};
+  int rxIntervalUs{2000};
+  int guiLoadMs{10};
+  QString captureFile{};
+  int replayPasses{10};
+};
+
+// Runs a local event loop until the signal fires or the timeout expires.
+template <typename Sender, typename Signal>
+auto waitForSignal(Sender* sender, Signal signal, int timeoutMs = 5000)
+    -> bool {
+  QEventLoop loop{};
+  QTimer timer{};
+  bool fired{false};
+
+  timer.setSingleShot(true);
+  QObject::connect(sender, signal, &loop, [&]() {
+    fired = true;
+    loop.quit();
+  });
+  QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+  timer.start(timeoutMs);
+  loop.exec();
+  return fired;
+}
+
+auto simulatedDevice(int index = 0) -> QBluetoothDeviceInfo;
+auto makeSimulatedTransport(BenchOptions const& options) -> SimulatedTransport*;
+// Puts a simulated transport under comm and applies the write settings.
+void setUpSimulatedLink(BLERFComm& comm, BenchOptions const& options);
+void applyWriteOptions(BLERFComm& comm, BenchOptions const& options);
+
+// Nearest-rank percentile of an unsorted sample set, p in [0, 1].
+auto percentile(std::vector<qint64> samples, double p) -> qint64;
+
+auto formatRate(double perSecond) -> QString;
@@ -0,0 +1,228 @@
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "linkmetrics.hpp"
+
+namespace {
+enum class Payload { Telemetry, Records, Random };
+
+// A JSON line like sensors send, with slowly drifting readings.
+auto telemetry(int seq, QRandomGenerator& random) -> QByteArray {
+  return QString("{\"seq\":%1,\"temp\":%2,\"humidity\":%3,\"battery\":%4,"
+                 "\"state\":\"%5\"}\n")
+      .arg(seq)
+      .arg(21.0 + random.bounded(100) / 100.0, 0, 'f', 2)
+      .arg(45.0 + random.bounded(50) / 10.0, 0, 'f', 1)
+      .arg(3.7 - seq % 100 / 1000.0, 0, 'f', 3)
+      .arg(seq % 50 == 0 ? "charging" : "ok")
+      .toUtf8();
+}
+
+// A batch of fixed-size binary records, mostly zeros and small numbers.
+auto records(int seq, QRandomGenerator& random) -> QByteArray {
+  constexpr int Count{16};
+  constexpr int RecordSize{12};
+  QByteArray data{Count * RecordSize, '\0'};
+  for (int i = 0; i < Count; i++) {
+    char* record = data.data() + i * RecordSize;
+    qToLittleEndian<quint16>(static_cast<quint16>(i), record);
+    record[2] = static_cast<char>(random.bounded(2));
+    qToLittleEndian<qint32>(seq * 10 + random.bounded(8), record + 4);
+  }
+  return data;
+}
+
+auto randomBytes(QRandomGenerator& random) -> QByteArray {
+  QByteArray data{128, Qt::Uninitialized};
+  for (auto& byte : data) {
+    byte = static_cast<char>(random.bounded(256));
+  }
+  return data;
+}
+
+auto makePayloads(Payload kind, int count, quint32 seed)
+    -> std::vector<QByteArray> {
+  QRandomGenerator random{seed};
+  std::vector<QByteArray> payloads{};
+  payloads.reserve(static_cast<std::size_t>(count));
+  for (int i = 0; i < count; i++) {
+    switch (kind) {
+      case Payload::Telemetry:
+        payloads.push_back(telemetry(i, random));
+        break;
+      case Payload::Records:
+        payloads.push_back(records(i, random));
+        break;
+      case Payload::Random:
+        payloads.push_back(randomBytes(random));
+        break;
+    }
+  }
+  return payloads;
+}
+
+struct GoodputResult {
+  int delivered{0};
+  int corrupted{0};
+  qint64 payloadBytes{0};
+  quint64 bytesWritten{0};
+  quint64 compressedMessages{0};
+  qint64 elapsedNs{0};
+};
+
+auto measureGoodput(BenchOptions const& options,
+                    std::vector<QByteArray> const& payloads, bool compress)
+    -> GoodputResult {
+  GoodputResult result{};
+  // the echoing peer answers with our own Hello, so whatever we enable is
+  // negotiated
+  BLERFComm comm{};
+  setUpSimulatedLink(comm, options);
+  comm.setExtendedFramingEnabled(true);
+  comm.setCompressionEnabled(compress);
+  comm.connectToDevice(simulatedDevice());
+  if (!waitForSignal(&comm, &BLERFComm::protocolNegotiated)) {
+    return result;
+  }
+
+  auto const before = comm.metrics()->snapshot();
+  int const total = static_cast<int>(payloads.size());
+  QElapsedTimer clock{};
+  QEventLoop loop{};
+  QTimer idleTimer{};
+  int sent{0};
+  int completed{0};
+
+  auto pump = [&]() {
+    while (sent < total && sent - completed < options.window) {
+      comm.sendData(payloads[static_cast<std::size_t>(sent)]);
+      sent++;
+    }
+  };
+
+  // the echo keeps the order, so every message is compared with the one
+  // that was sent in its place
+  QObject::connect(&comm, &BLERFComm::dataReceived, &loop,
+                   [&](QByteArray const& data) {
+                     if (data == payloads[static_cast<std::size_t>(
+                                     completed)]) {
+                       result.delivered++;
+                       result.payloadBytes += data.size();
+                     } else {
+                       result.corrupted++;
+                     }
+
+                     completed++;
+                     result.elapsedNs = clock.nsecsElapsed();
+                     if (completed >= total) {
+                       loop.quit();
+                       return;
+                     }
+                     idleTimer.start();
+                     pump();
+                   });
+
+  idleTimer.setSingleShot(true);
+  idleTimer.setInterval(1000);
+  QObject::connect(&idleTimer, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+  clock.start();
+  idleTimer.start();
+  pump();
+  loop.exec();
+
+  auto const after = comm.metrics()->snapshot();
+  result.bytesWritten = after.counter(LinkMetrics::BytesWritten) -
+                        before.counter(LinkMetrics::BytesWritten);
+  result.compressedMessages = after.counter(LinkMetrics::CompressedMessages) -
+                              before.counter(LinkMetrics::CompressedMessages);
+  comm.disconnectFromDevice();
+  return result;
+}
+}  // namespace
+
+auto runCompressionBench(BenchOptions const& options) -> int {
+  auto linkOptions = options;
+  if (linkOptions.packetDelayUs == 0) {
+    linkOptions.packetDelayUs = AirtimePacketDelayUs;
+  }
+  // airtime bound runs are slow, a few hundred messages are plenty
+  int const messages = std::min(options.messages, 500);
+
+  QTextStream out{stdout};
+  out << QString("compression: %1 messages, window %2, MTU %3, delay %4 us, "
+                 "goodput with and without compression\n")
+             .arg(messages)
+             .arg(linkOptions.window)
+             .arg(linkOptions.mtu)
+             .arg(linkOptions.packetDelayUs);
+  out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+             .arg("payload", 10)
+             .arg("avg B", 6)
+             .arg("mode", 5)
+             .arg("goodput B/s", 12)
+             .arg("wire B/msg", 11)
+             .arg("compressed", 11)
+             .arg("gain", 7);
+
+  struct Kind {
+    Payload payload;
+    char const* name;
+  };
+  Kind const kinds[]{
+      {Payload::Telemetry, "telemetry"},
+      {Payload::Records, "records"},
+      {Payload::Random, "random"},
+  };
+
+  int failures{0};
+  for (auto const& kind : kinds) {
+    auto const payloads = makePayloads(kind.payload, messages, options.seed);
+    qint64 payloadBytes{0};
+    for (auto const& payload : payloads) {
+      payloadBytes += payload.size();
+    }
+
+    double plainGoodput{0.0};
+    for (bool compress : {false, true}) {
+      auto const result = measureGoodput(linkOptions, payloads, compress);
+      double const seconds = static_cast<double>(result.elapsedNs) / 1e9;
+      double const goodput =
+          seconds > 0 ? static_cast<double>(result.payloadBytes) / seconds
+                      : 0.0;
+      if (!compress) {
+        plainGoodput = goodput;
+      }
+
+      out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                 .arg(kind.name, 10)
+                 .arg(payloadBytes / messages, 6)
+                 .arg(compress ? "lz4" : "plain", 5)
+                 .arg(formatRate(goodput), 12)
+                 .arg(static_cast<double>(result.bytesWritten) / messages,
+                      11, 'f', 1)
+                 .arg(QString("%1/%2")
+                          .arg(result.compressedMessages)
+                          .arg(messages),
+                      11)
+                 .arg(plainGoodput > 0
+                          ? QString("%1x").arg(goodput / plainGoodput, 0,
+                                               'f', 2)
+                          : QString("-"),
+                      7);
+      out.flush();
+
+      if (result.delivered != messages) {
+        failures++;
+      }
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
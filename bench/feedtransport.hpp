@@ -0,0 +1,37 @@
+#pragma once
+#include <QByteArray>
+
+#include "bletransport.hpp"
+
+// Transport that is always ready and emits whatever it's fed as a received
+// notification, synchronously. Keeps the transport itself out of the
+// measurements of the receive path.
+class FeedTransport : public BLETransport
+{
+  Q_OBJECT
+
+ public:
+  using BLETransport::BLETransport;
+
+  void connectToDevice(QBluetoothDeviceInfo const&, QBluetoothUuid const&,
+                       QBluetoothUuid const&) override {
+    emit connectedToDevice();
+    emit commsReady();
+  }
+  void disconnectFromDevice() override {}
+
+  void write(QByteArray const& data, WriteMode) override {
+    emit dataWritten(data.size());
+  }
+
+  auto connected() const -> bool override { return true; }
+  auto ready() const -> bool override { return true; }
+  auto remoteName() const -> QString override { return "Feed"; }
+  auto remoteAddress() const -> QBluetoothAddress override {
+    return QBluetoothAddress{};
+  }
+  auto mtu() const -> int override { return DefaultMtu; }
+  auto supportsWriteWithoutResponse() const -> bool override { return true; }
+
+  void feed(QByteArray const& notification) { emit dataReceived(notification); }
+};
@@ -0,0 +1,197 @@
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "rfcommprotocol.hpp"
+#include "simulatedtransport.hpp"
+
+namespace {
+constexpr int FrameIntervalMs{16};
+
+struct JitterResult {
+  int received{0};
+  std::vector<qint64> latenciesNs{};
+};
+
+// The peripheral sends a message every rxIntervalUs while the main thread
+// spends guiLoadMs of every frame busy, like a heavy repaint would. Latency
+// is measured from when the message was due until BLERFComm delivered it.
+auto measureJitter(BenchOptions const& options, bool ioThread)
+    -> JitterResult {
+  JitterResult result{};
+  int const messages = options.messages;
+  qint64 const intervalNs = static_cast<qint64>(options.rxIntervalUs) * 1000;
+
+  QThread thread{};
+  auto* comm = new BLERFComm{};
+  auto* transport = makeSimulatedTransport(options);
+  transport->setEchoEnabled(false);
+  comm->setTransport(transport);
+  // drives the peripheral, on the same thread as the stack
+  auto* peripheralTimer = new QTimer{comm};
+  peripheralTimer->setTimerType(Qt::PreciseTimer);
+  peripheralTimer->setInterval(std::max(options.rxIntervalUs / 1000, 1));
+
+  if (ioThread) {
+    comm->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, comm, &QObject::deleteLater);
+    thread.start();
+  }
+
+  QElapsedTimer clock{};
+  clock.start();
+  std::vector<qint64> receivedNs(static_cast<std::size_t>(messages), -1);
+  std::atomic<int> received{0};
+  int injected{0};
+  qint64 startNs{0};
+
+  QObject::connect(
+      comm, &BLERFComm::dataReceived, comm,
+      [&](QByteArray const& data) {
+        auto const seq = qFromLittleEndian<quint32>(data.constData());
+        if (seq < receivedNs.size()) {
+          receivedNs[seq] = clock.nsecsElapsed();
+          received++;
+        }
+      },
+      Qt::DirectConnection);
+  QObject::connect(peripheralTimer, &QTimer::timeout, comm, [&]() {
+    // a late timer catches up on everything that was due in the meantime
+    qint64 const now = clock.nsecsElapsed();
+    while (injected < messages && startNs + injected * intervalNs <= now) {
+      QByteArray payload{16, 'x'};
+      qToLittleEndian<quint32>(static_cast<quint32>(injected), payload.data());
+      transport->injectNotification(RFCommProtocol::encodeFrame(payload));
+      injected++;
+    }
+    if (injected >= messages) {
+      peripheralTimer->stop();
+    }
+  });
+
+  QEventLoop loop{};
+  QTimer timeout{};
+  timeout.setSingleShot(true);
+  QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+  QObject::connect(comm, &BLERFComm::deviceReady, &loop, &QEventLoop::quit);
+  QMetaObject::invokeMethod(
+      comm, [&]() { comm->connectToDevice(simulatedDevice()); });
+  timeout.start(5000);
+  loop.exec();
+
+  // simulated rendering load on the main thread
+  QTimer loadTimer{};
+  QObject::connect(&loadTimer, &QTimer::timeout, &loop, [&]() {
+    QElapsedTimer busy{};
+    busy.start();
+    while (busy.elapsed() < options.guiLoadMs) {
+    }
+  });
+  QTimer poll{};
+  QObject::connect(&poll, &QTimer::timeout, &loop, [&]() {
+    if (received >= messages) {
+      loop.quit();
+    }
+  });
+
+  QMetaObject::invokeMethod(comm, [&]() {
+    startNs = clock.nsecsElapsed();
+    peripheralTimer->start();
+  });
+  loadTimer.start(FrameIntervalMs);
+  poll.start(FrameIntervalMs);
+  timeout.start(static_cast<int>(messages * intervalNs / 1'000'000) + 5000);
+  loop.exec();
+  loadTimer.stop();
+
+  QMetaObject::invokeMethod(
+      comm,
+      [&]() {
+        peripheralTimer->stop();
+        comm->disconnectFromDevice();
+      },
+      ioThread ? Qt::BlockingQueuedConnection : Qt::DirectConnection);
+  if (ioThread) {
+    thread.quit();
+    thread.wait();
+  } else {
+    delete comm;
+  }
+
+  for (int seq = 0; seq < messages; seq++) {
+    auto const at = receivedNs[static_cast<std::size_t>(seq)];
+    if (at >= 0) {
+      result.latenciesNs.push_back(at - (startNs + seq * intervalNs));
+    }
+  }
+  result.received = static_cast<int>(result.latenciesNs.size());
+  return result;
+}
+
+auto standardDeviation(std::vector<qint64> const& samples) -> double {
+  if (samples.empty()) {
+    return 0.0;
+  }
+
+  double mean{0.0};
+  for (auto sample : samples) {
+    mean += static_cast<double>(sample);
+  }
+  mean /= static_cast<double>(samples.size());
+
+  double variance{0.0};
+  for (auto sample : samples) {
+    auto const delta = static_cast<double>(sample) - mean;
+    variance += delta * delta;
+  }
+  return std::sqrt(variance / static_cast<double>(samples.size()));
+}
+}  // namespace
+
+auto runJitterBench(BenchOptions const& options) -> int {
+  QTextStream out{stdout};
+  out << QString("jitter: %1 messages every %2 us, main thread busy %3 of "
+                 "every %4 ms\n")
+             .arg(options.messages)
+             .arg(options.rxIntervalUs)
+             .arg(options.guiLoadMs)
+             .arg(FrameIntervalMs);
+  out << QString("%1 %2 %3 %4 %5 %6\n")
+             .arg("stack on", 12)
+             .arg("p50 us", 10)
+             .arg("p99 us", 10)
+             .arg("max us", 10)
+             .arg("stddev us", 10)
+             .arg("lost", 6);
+
+  int failures{0};
+  for (bool ioThread : {false, true}) {
+    auto const result = measureJitter(options, ioThread);
+    auto const& latencies = result.latenciesNs;
+    auto const maximum =
+        latencies.empty() ? 0 : *std::max_element(latencies.cbegin(),
+                                                  latencies.cend());
+
+    out << QString("%1 %2 %3 %4 %5 %6\n")
+               .arg(ioThread ? "I/O thread" : "main thread", 12)
+               .arg(percentile(latencies, 0.50) / 1000, 10)
+               .arg(percentile(latencies, 0.99) / 1000, 10)
+               .arg(maximum / 1000, 10)
+               .arg(standardDeviation(latencies) / 1000, 10, 'f', 1)
+               .arg(options.messages - result.received, 6);
+    out.flush();
+
+    if (result.received == 0) {
+      failures++;
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <map>
+
+#include "benchsuites.hpp"
+
+namespace {
+auto parseSizes(QString const& value) -> QVector<int> {
+  QVector<int> sizes{};
+  for (auto const& part : value.split(',', Qt::SkipEmptyParts)) {
+    bool ok{false};
+    int const size = part.trimmed().toInt(&ok);
+    if (ok && size > 0) {
+      sizes.append(size);
+    }
+  }
+  return sizes;
+}
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("blerfcomm-bench");
+
+  std::map<QString, std::function<int(BenchOptions const &)>> const suites{
+      {"throughput", runThroughputBench},
+      {"jitter", runJitterBench},
+      {"pool", runPoolBench},
+      {"rx", runRxBench},
+      {"replay", runReplayBench},
+      {"compression", runCompressionBench},
+      {"rpc", runRpcBench},
+      {"striping", runStripingBench},
+      {"schema", runSchemaBench},
+  };
+
+  QStringList suiteNames{};
+  for (auto const &suite : suites) {
+    suiteNames.append(suite.first);
+  }
+
+  QCommandLineParser parser{};
+  parser.setApplicationDescription(
+      "BLE RFComm benchmarks running against a simulated GATT peripheral");
+  parser.addHelpOption();
+  parser.addPositionalArgument(
+      "suite", "Benchmark to run (default: all): " + suiteNames.join(", "));
+  parser.addOptions({
+      {"messages", "Messages per measurement.", "count", "2000"},
+      {"sizes", "Comma-separated message sizes.", "list",
+       "4,16,64,128,254,1024,4096"},
+      {"window", "Messages in flight at once.", "count", "8"},
+      {"mtu", "Simulated ATT MTU.", "bytes", "23"},
+      {"chunk", "Notification chunk size.", "bytes", "20"},
+      {"delay", "Per-packet link delay.", "us", "0"},
+      {"in-flight", "Writes without response in flight.", "count", "4"},
+      {"with-response", "Always write with response."},
+      {"coalesce", "Coalesce short messages for up to this long.", "ms",
+       "-1"},
+      {"loss", "Notification loss probability.", "probability", "0"},
+      {"seed", "Random seed for the simulated link.", "seed", "1"},
+      {"devices", "Largest device count of the pool benchmark.", "count",
+       "7"},
+      {"interval", "Peripheral send interval of the jitter benchmark.", "us",
+       "2000"},
+      {"load", "Main thread busy time per 16 ms frame (jitter).", "ms", "10"},
+      {"capture", "Capture file to replay.", "file"},
+      {"passes", "Passes over the capture (replay).", "count", "10"},
+  });
+  parser.process(app);
+
+  BenchOptions options{};
+  options.messages = std::max(parser.value("messages").toInt(), 1);
+  options.sizes = parseSizes(parser.value("sizes"));
+  options.window = std::max(parser.value("window").toInt(), 1);
+  options.mtu = parser.value("mtu").toInt();
+  options.notificationChunkSize = parser.value("chunk").toInt();
+  options.packetDelayUs = parser.value("delay").toInt();
+  options.writesInFlight = std::max(parser.value("in-flight").toInt(), 1);
+  options.writeWithResponse = parser.isSet("with-response");
+  options.coalesceDelayMs = parser.value("coalesce").toInt();
+  options.lossRate = parser.value("loss").toDouble();
+  options.seed = parser.value("seed").toUInt();
+  options.devices = std::max(parser.value("devices").toInt(), 1);
+  options.rxIntervalUs = std::max(parser.value("interval").toInt(), 1000);
+  options.guiLoadMs = std::max(parser.value("load").toInt(), 0);
+  options.captureFile = parser.value("capture");
+  options.replayPasses = std::max(parser.value("passes").toInt(), 1);
+
+  QStringList requested = parser.positionalArguments();
+  if (requested.isEmpty()) {
+    requested = suiteNames;
+  }
+
+  int result{0};
+  for (auto const &name : requested) {
+    auto const suite = suites.find(name);
+    if (suite == suites.end()) {
+      QTextStream{stderr} << "Unknown benchmark: " << name << "\n";
+      return 2;
+    }
+    result |= suite->second(options);
+  }
+
+  return result;
+}
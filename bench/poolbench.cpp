@@ -0,0 +1,193 @@
+#include <QElapsedTimer>
+#include <QMap>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "connectionpool.hpp"
+#include "simulatedtransport.hpp"
+
+namespace {
+struct DeviceProgress {
+  int sent{0};
+  int completed{0};
+  int delivered{0};
+  qint64 lastNs{0};
+};
+
+struct PoolResult {
+  int delivered{0};
+  int lost{0};
+  qint64 elapsedNs{0};
+  double slowestPerSecond{0.0};
+  double fastestPerSecond{0.0};
+};
+
+auto measurePool(BenchOptions const& options, int devices, int messageSize)
+    -> PoolResult {
+  PoolResult result{};
+  int const expected = devices * options.messages;
+
+  ConnectionPool pool{};
+  pool.setMaxConnections(devices);
+  pool.setExtendedFramingEnabled(true);
+  int created{0};
+  pool.setTransportFactory([&](QBluetoothDeviceInfo const&) {
+    // every device gets its own loss pattern
+    auto deviceOptions = options;
+    deviceOptions.seed = options.seed + static_cast<quint32>(created++);
+    return makeSimulatedTransport(deviceOptions);
+  });
+
+  QMap<QBluetoothAddress, int> indices{};
+  std::vector<QBluetoothAddress> addresses{};
+  QEventLoop loop{};
+  QTimer timeout{};
+  int negotiated{0};
+
+  for (int i = 0; i < devices; i++) {
+    auto const device = simulatedDevice(i);
+    auto* comm = pool.connectToDevice(device);
+    applyWriteOptions(*comm, options);
+    QObject::connect(comm, &BLERFComm::protocolNegotiated, &loop, [&]() {
+      if (++negotiated == devices) {
+        loop.quit();
+      }
+    });
+
+    indices.insert(device.address(), i);
+    addresses.push_back(device.address());
+    pool.addToGroup("bench", device.address());
+  }
+
+  timeout.setSingleShot(true);
+  QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+  timeout.start(5000);
+  loop.exec();
+  if (negotiated < devices) {
+    result.lost = expected;
+    return result;
+  }
+
+  // payloads carry a per-device sequence number, anything out of order or
+  // routed to the wrong device counts as lost
+  int const size = std::max(messageSize, 4);
+  std::vector<DeviceProgress> progress(static_cast<std::size_t>(devices));
+  QElapsedTimer clock{};
+  QTimer idleTimer{};
+  int completed{0};
+
+  auto pump = [&](int index) {
+    auto& device = progress[static_cast<std::size_t>(index)];
+    while (device.sent < options.messages &&
+           device.sent - device.completed < options.window) {
+      QByteArray payload{size, 'x'};
+      qToLittleEndian<quint32>(static_cast<quint32>(device.sent),
+                               payload.data());
+      pool.sendData(addresses[static_cast<std::size_t>(index)], payload);
+      device.sent++;
+    }
+  };
+
+  QObject::connect(
+      &pool, &ConnectionPool::dataReceived, &loop,
+      [&](QBluetoothAddress const& address, QByteArray const& data) {
+        int const index = indices.value(address, -1);
+        if (index < 0) {
+          return;
+        }
+
+        auto& device = progress[static_cast<std::size_t>(index)];
+        if (data.size() == size &&
+            qFromLittleEndian<quint32>(data.constData()) ==
+                static_cast<quint32>(device.completed)) {
+          device.delivered++;
+        }
+        device.completed++;
+        device.lastNs = clock.nsecsElapsed();
+
+        if (++completed >= expected) {
+          loop.quit();
+          return;
+        }
+        idleTimer.start();
+        pump(index);
+      });
+
+  idleTimer.setSingleShot(true);
+  idleTimer.setInterval(500);
+  QObject::connect(&idleTimer, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+  clock.start();
+  idleTimer.start();
+  for (int i = 0; i < devices; i++) {
+    pump(i);
+  }
+  loop.exec();
+
+  result.slowestPerSecond = -1.0;
+  for (auto const& device : progress) {
+    double const seconds = static_cast<double>(device.lastNs) / 1e9;
+    double const perSecond = seconds > 0 ? device.delivered / seconds : 0.0;
+    result.delivered += device.delivered;
+    result.elapsedNs = std::max(result.elapsedNs, device.lastNs);
+    result.fastestPerSecond = std::max(result.fastestPerSecond, perSecond);
+    result.slowestPerSecond =
+        result.slowestPerSecond < 0
+            ? perSecond
+            : std::min(result.slowestPerSecond, perSecond);
+  }
+  result.lost = expected - result.delivered;
+
+  pool.disconnectAll();
+  return result;
+}
+}  // namespace
+
+auto runPoolBench(BenchOptions const& options) -> int {
+  QTextStream out{stdout};
+  out << QString("pool: up to %1 devices, %2 messages each, window %3, "
+                 "MTU %4, delay %5 us, loss %6\n")
+             .arg(options.devices)
+             .arg(options.messages)
+             .arg(options.window)
+             .arg(options.mtu)
+             .arg(options.packetDelayUs)
+             .arg(options.lossRate);
+  out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+             .arg("devs", 4)
+             .arg("size", 6)
+             .arg("msg/s", 10)
+             .arg("B/s", 10)
+             .arg("min dev", 10)
+             .arg("max dev", 10)
+             .arg("lost", 6);
+
+  int failures{0};
+  for (int size : options.sizes) {
+    for (int devices = 1; devices <= options.devices; devices++) {
+      auto const result = measurePool(options, devices, size);
+      double const seconds = static_cast<double>(result.elapsedNs) / 1e9;
+      double const messagesPerSecond =
+          seconds > 0 ? result.delivered / seconds : 0.0;
+
+      out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                 .arg(devices, 4)
+                 .arg(size, 6)
+                 .arg(formatRate(messagesPerSecond), 10)
+                 .arg(formatRate(messagesPerSecond * size), 10)
+                 .arg(formatRate(result.slowestPerSecond), 10)
+                 .arg(formatRate(result.fastestPerSecond), 10)
+                 .arg(result.lost, 6);
+      out.flush();
+
+      if (result.delivered == 0) {
+        failures++;
+      }
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
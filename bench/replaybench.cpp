@@ -0,0 +1,94 @@
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+
+#include "allocationcounter.hpp"
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "capturefile.hpp"
+#include "feedtransport.hpp"
+
+auto runReplayBench(BenchOptions const& options) -> int {
+  QTextStream out{stdout};
+  if (options.captureFile.isEmpty()) {
+    out << "replay: no --capture file given, skipped\n";
+    return 0;
+  }
+
+  // loaded up front, so that reading the file stays out of the measurement
+  CaptureReader reader{options.captureFile};
+  if (!reader.open()) {
+    out << QString("replay: cannot open %1: %2\n")
+               .arg(options.captureFile, reader.errorString());
+    return 1;
+  }
+
+  QVector<QByteArray> notifications{};
+  qint64 bytes{0};
+  CaptureFormat::Record record{};
+  while (reader.next(record)) {
+    if (record.type == CaptureFormat::RecordType::Notification) {
+      bytes += record.data.size();
+      notifications.append(record.data);
+    }
+  }
+  if (reader.corrupted()) {
+    out << "replay: capture is truncated, using what could be read\n";
+  }
+  if (notifications.isEmpty()) {
+    out << "replay: the capture has no notifications\n";
+    return 1;
+  }
+
+  out << QString("replay: %1 notifications (%2 bytes) from %3 through "
+                 "BLEComm -> BLERFComm::handleRx, %4 passes\n")
+             .arg(notifications.size())
+             .arg(bytes)
+             .arg(options.captureFile)
+             .arg(options.replayPasses);
+
+  auto* transport = new FeedTransport{};
+  BLERFComm comm{};
+  comm.setTransport(transport);
+  comm.connectToDevice(simulatedDevice());
+
+  quint64 frames{0};
+  QObject::connect(&comm, &BLERFComm::dataReceived,
+                   [&](QByteArray const&) { frames++; });
+
+  auto const runPasses = [&](int passes) {
+    for (int pass = 0; pass < passes; pass++) {
+      for (auto const& notification : notifications) {
+        transport->feed(notification);
+      }
+    }
+  };
+
+  // warm-up; also tells how many frames a pass carries
+  runPasses(1);
+  quint64 const framesPerPass = frames;
+
+  frames = 0;
+  QElapsedTimer clock{};
+  auto const allocationsBefore = AllocationCounter::count();
+  clock.start();
+  runPasses(options.replayPasses);
+  auto const elapsedNs = clock.nsecsElapsed();
+  auto const allocations = AllocationCounter::count() - allocationsBefore;
+
+  auto const totalNotifications =
+      static_cast<double>(notifications.size()) * options.replayPasses;
+  out << QString("%1 frames/pass, %2 ns/notification, %3 MB/s, "
+                 "%4 allocs/notification\n")
+             .arg(framesPerPass)
+             .arg(static_cast<double>(elapsedNs) / totalNotifications, 0, 'f',
+                  1)
+             .arg(static_cast<double>(bytes) * options.replayPasses * 1e3 /
+                      static_cast<double>(std::max<qint64>(elapsedNs, 1)),
+                  0, 'f', 2)
+             .arg(static_cast<double>(allocations) / totalNotifications, 0,
+                  'f', 3);
+
+  return frames == framesPerPass * options.replayPasses ? 0 : 1;
+}
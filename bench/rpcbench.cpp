@@ -0,0 +1,126 @@
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "rpcclient.hpp"
+
+namespace {
+constexpr int RequestSize{16};
+
+struct RpcResult {
+  int succeeded{0};
+  int failed{0};
+  qint64 elapsedNs{0};
+  std::vector<qint64> latenciesUs{};
+};
+
+// The echoing peer sends every request back as it is, id included, which
+// makes it a server that answers each call with its own request.
+auto measureCalls(BenchOptions const& options, int calls, int inFlight)
+    -> RpcResult {
+  RpcResult result{};
+  BLERFComm comm{};
+  setUpSimulatedLink(comm, options);
+  comm.connectToDevice(simulatedDevice());
+  if (!waitForSignal(&comm, &BLERFComm::deviceReady)) {
+    result.failed = calls;
+    return result;
+  }
+
+  RpcClient client{&comm};
+  result.latenciesUs.reserve(static_cast<std::size_t>(calls));
+  QElapsedTimer clock{};
+  QEventLoop loop{};
+  int started{0};
+  int finished{0};
+
+  std::function<void()> pump;
+  pump = [&]() {
+    while (started < calls && started - finished < inFlight) {
+      QByteArray request{RequestSize, 'r'};
+      request[0] = static_cast<char>(started & 0xFF);
+      started++;
+      client.call(request, [&, request](RpcReply const& reply) {
+        if (reply.error() == RpcReply::Error::NoError &&
+            reply.data() == request) {
+          result.succeeded++;
+          result.latenciesUs.push_back(reply.elapsedUs());
+        } else {
+          result.failed++;
+        }
+
+        finished++;
+        if (finished >= calls) {
+          result.elapsedNs = clock.nsecsElapsed();
+          loop.quit();
+          return;
+        }
+        pump();
+      });
+    }
+  };
+
+  clock.start();
+  pump();
+  loop.exec();
+
+  comm.disconnectFromDevice();
+  return result;
+}
+}  // namespace
+
+auto runRpcBench(BenchOptions const& options) -> int {
+  auto linkOptions = options;
+  if (linkOptions.packetDelayUs == 0) {
+    linkOptions.packetDelayUs = AirtimePacketDelayUs;
+  }
+  int const calls = std::min(options.messages, 500);
+
+  QTextStream out{stdout};
+  out << QString("rpc: %1 calls of %2 bytes, MTU %3, delay %4 us\n")
+             .arg(calls)
+             .arg(RequestSize)
+             .arg(linkOptions.mtu)
+             .arg(linkOptions.packetDelayUs);
+  out << QString("%1 %2 %3 %4 %5\n")
+             .arg("in flight", 10)
+             .arg("calls/s", 10)
+             .arg("p50 us", 10)
+             .arg("p99 us", 10)
+             .arg("failed", 7);
+
+  int failures{0};
+  // lockstep first, then pipelined up to the window
+  std::vector<int> inFlight{1};
+  for (int window = 4; window < options.window; window *= 2) {
+    inFlight.push_back(window);
+  }
+  if (options.window > 1) {
+    inFlight.push_back(options.window);
+  }
+
+  for (int window : inFlight) {
+    auto const result = measureCalls(linkOptions, calls, window);
+    double const seconds = static_cast<double>(result.elapsedNs) / 1e9;
+
+    out << QString("%1 %2 %3 %4 %5\n")
+               .arg(window, 10)
+               .arg(formatRate(seconds > 0 ? result.succeeded / seconds
+                                           : 0.0),
+                    10)
+               .arg(percentile(result.latenciesUs, 0.50), 10)
+               .arg(percentile(result.latenciesUs, 0.99), 10)
+               .arg(result.failed, 7);
+    out.flush();
+
+    if (result.succeeded == 0) {
+      failures++;
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+
+#include "allocationcounter.hpp"
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "feedtransport.hpp"
+#include "rfcommprotocol.hpp"
+
+namespace {
+// Splits one framed message into notifications, the way an HM-10 sends it.
+auto makeNotifications(int messageSize, int chunkSize) -> QVector<QByteArray> {
+  auto const framed = RFCommProtocol::encodeFrame(QByteArray{messageSize, 'x'});
+
+  QVector<QByteArray> notifications{};
+  for (int offset = 0; offset < framed.size(); offset += chunkSize) {
+    notifications.append(framed.mid(offset, chunkSize));
+  }
+  return notifications;
+}
+}  // namespace
+
+auto runRxBench(BenchOptions const& options) -> int {
+  QTextStream out{stdout};
+  out << QString("rx: %1 messages through BLEComm -> BLERFComm::handleRx, "
+                 "chunk %2\n")
+             .arg(options.messages)
+             .arg(options.notificationChunkSize);
+  if (!AllocationCounter::supported()) {
+    out << "allocation counting is not supported on this platform\n";
+  }
+  out << QString("%1 %2 %3\n").arg("size", 6).arg("ns/msg", 10).arg(
+      "allocs/msg", 12);
+
+  auto* transport = new FeedTransport{};
+  BLERFComm comm{};
+  comm.setTransport(transport);
+  comm.connectToDevice(simulatedDevice());
+
+  qint64 receivedBytes{0};
+  QObject::connect(
+      &comm, &BLERFComm::dataReceived,
+      [&](QByteArray const& data) { receivedBytes += data.size(); });
+
+  int failures{0};
+  for (int size : options.sizes) {
+    int const messageSize =
+        std::min(size, RFCommProtocol::MaxExtendedPayload);
+    auto const notifications =
+        makeNotifications(messageSize, options.notificationChunkSize);
+    auto const runMessages = [&](int count) {
+      for (int i = 0; i < count; i++) {
+        for (auto const& notification : notifications) {
+          transport->feed(notification);
+        }
+      }
+    };
+
+    // let the receive path reach its steady state first
+    runMessages(100);
+
+    receivedBytes = 0;
+    QElapsedTimer clock{};
+    auto const allocationsBefore = AllocationCounter::count();
+    clock.start();
+    runMessages(options.messages);
+    auto const elapsedNs = clock.nsecsElapsed();
+    auto const allocations = AllocationCounter::count() - allocationsBefore;
+
+    out << QString("%1 %2 %3\n")
+               .arg(messageSize, 6)
+               .arg(static_cast<double>(elapsedNs) / options.messages, 10, 'f',
+                    1)
+               .arg(static_cast<double>(allocations) / options.messages, 12,
+                    'f', 3);
+    out.flush();
+
+    if (receivedBytes != static_cast<qint64>(messageSize) * options.messages) {
+      failures++;
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
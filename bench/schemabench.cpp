@@ -0,0 +1,232 @@
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QTextStream>
+#include <array>
+#include <functional>
+
+#include "allocationcounter.hpp"
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "feedtransport.hpp"
+#include "messageschema.hpp"
+#include "rfcommprotocol.hpp"
+
+namespace {
+enum class SensorState : quint8 { Idle, Measuring, Charging };
+
+struct Telemetry {
+  static constexpr quint8 MessageId{0x10};
+  quint32 seq;
+  quint64 timestampUs;
+  float temperature;
+  float humidity;
+  SensorState state;
+  std::array<qint16, 3> acceleration;
+  MessageSchema::Bytes tag;
+
+  static constexpr auto fields() {
+    return MessageSchema::fields(
+        &Telemetry::seq, &Telemetry::timestampUs, &Telemetry::temperature,
+        &Telemetry::humidity, &Telemetry::state, &Telemetry::acceleration,
+        &Telemetry::tag);
+  }
+};
+
+constexpr char TagText[]{"sensor-7"};
+
+auto makeTelemetry(quint32 seq) -> Telemetry {
+  return Telemetry{seq,
+                   1000000ull * seq,
+                   21.5f + static_cast<float>(seq % 10) / 10.0f,
+                   45.0f,
+                   SensorState::Measuring,
+                   {12, -3, 1024},
+                   {TagText, int{sizeof(TagText)} - 1}};
+}
+
+// The same layout through QDataStream, the usual way without a schema.
+void streamTelemetry(QDataStream& stream, Telemetry const& message,
+                     QByteArray const& tag) {
+  stream << Telemetry::MessageId << message.seq << message.timestampUs
+         << message.temperature << message.humidity
+         << static_cast<quint8>(message.state);
+  for (auto const value : message.acceleration) {
+    stream << value;
+  }
+  stream << static_cast<quint16>(tag.size());
+  stream.writeRawData(tag.constData(), tag.size());
+}
+
+auto unstreamTelemetry(QByteArray const& data, QByteArray& tag) -> Telemetry {
+  QDataStream stream{data};
+  stream.setByteOrder(QDataStream::LittleEndian);
+  stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+  Telemetry message{};
+  quint8 id{0};
+  quint8 state{0};
+  quint16 tagSize{0};
+  stream >> id >> message.seq >> message.timestampUs >> message.temperature >>
+      message.humidity >> state;
+  for (auto& value : message.acceleration) {
+    stream >> value;
+  }
+  stream >> tagSize;
+  tag.resize(tagSize);
+  stream.readRawData(tag.data(), tagSize);
+  message.state = static_cast<SensorState>(state);
+  return message;
+}
+
+struct Measurement {
+  double nsPerMessage;
+  double allocationsPerMessage;
+};
+
+auto measure(int count, std::function<void(int)> const& body)
+    -> Measurement {
+  // warm up, so buffers reach their steady state
+  for (int i = 0; i < 100; i++) {
+    body(i);
+  }
+
+  QElapsedTimer clock{};
+  auto const allocationsBefore = AllocationCounter::count();
+  clock.start();
+  for (int i = 0; i < count; i++) {
+    body(i);
+  }
+  auto const elapsedNs = clock.nsecsElapsed();
+  auto const allocations = AllocationCounter::count() - allocationsBefore;
+  return Measurement{static_cast<double>(elapsedNs) / count,
+                     static_cast<double>(allocations) / count};
+}
+}  // namespace
+
+auto runSchemaBench(BenchOptions const& options) -> int {
+  // the codecs alone are fast, so many more rounds than messages elsewhere
+  int const count = options.messages * 100;
+  QTextStream out{stdout};
+  out << QString("schema: %1 Telemetry messages (%2 bytes), MessageSchema "
+                 "vs. QDataStream\n")
+             .arg(count)
+             .arg(MessageSchema::encodedSize(makeTelemetry(0)));
+  if (!AllocationCounter::supported()) {
+    out << "allocation counting is not supported on this platform\n";
+  }
+  out << QString("%1 %2 %3 %4\n")
+             .arg("step", 8)
+             .arg("codec", 12)
+             .arg("ns/msg", 10)
+             .arg("allocs/msg", 12);
+
+  int failures{0};
+  auto report = [&](char const* step, char const* codec,
+                    Measurement const& result) {
+    out << QString("%1 %2 %3 %4\n")
+               .arg(step, 8)
+               .arg(codec, 12)
+               .arg(result.nsPerMessage, 10, 'f', 1)
+               .arg(result.allocationsPerMessage, 12, 'f', 3);
+    out.flush();
+  };
+
+  // encoding into a reused buffer
+  auto const size = MessageSchema::encodedSize(makeTelemetry(0));
+  QByteArray buffer{size, Qt::Uninitialized};
+  quint64 checksum{0};
+  report("encode", "schema", measure(count, [&](int i) {
+           auto const message = makeTelemetry(static_cast<quint32>(i));
+           MessageSchema::encode(message, buffer.data());
+           checksum += static_cast<quint8>(buffer[1]);
+         }));
+
+  QByteArray const tag{TagText};
+  QByteArray streamed{};
+  report("encode", "QDataStream", measure(count, [&](int i) {
+           streamed.clear();
+           QDataStream stream{&streamed, QIODevice::WriteOnly};
+           stream.setByteOrder(QDataStream::LittleEndian);
+           stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+           streamTelemetry(stream, makeTelemetry(static_cast<quint32>(i)), tag);
+           checksum += static_cast<quint8>(streamed[1]);
+         }));
+  if (streamed.size() != size) {
+    failures++;
+  }
+
+  // decoding from the encoded message
+  MessageSchema::encode(makeTelemetry(42), buffer.data());
+  report("decode", "schema", measure(count, [&](int) {
+           Telemetry message{};
+           if (!MessageSchema::decode(buffer.constData(), buffer.size(),
+                                      message)) {
+             failures++;
+           }
+           checksum += message.seq + static_cast<quint64>(message.tag.size);
+         }));
+
+  QByteArray decodedTag{};
+  report("decode", "QDataStream", measure(count, [&](int) {
+           auto const message = unstreamTelemetry(buffer, decodedTag);
+           checksum += message.seq + static_cast<quint64>(decodedTag.size());
+         }));
+
+  // the whole stack, from the call to the written frame and from the
+  // notifications to the handler
+  int const stackCount = options.messages * 10;
+  auto* transport = new FeedTransport{};
+  BLERFComm comm{};
+  comm.setTransport(transport);
+  // the feed completes writes right away, but completions are counted
+  // against the queue limits until they're reported
+  comm.setTransmitQueueLimits(2 * (stackCount + 100), qint64{1} << 30);
+  comm.connectToDevice(simulatedDevice());
+  report("send", "schema", measure(stackCount, [&](int i) {
+           if (comm.send(makeTelemetry(static_cast<quint32>(i))) == 0) {
+             failures++;
+           }
+         }));
+  report("send", "QDataStream", measure(stackCount, [&](int i) {
+           QByteArray data{};
+           QDataStream stream{&data, QIODevice::WriteOnly};
+           stream.setByteOrder(QDataStream::LittleEndian);
+           stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+           streamTelemetry(stream, makeTelemetry(static_cast<quint32>(i)), tag);
+           if (comm.sendData(data) == 0) {
+             failures++;
+           }
+         }));
+
+  auto const frame = RFCommProtocol::encodeFrame(buffer);
+  qint64 received{0};
+  {
+    QObject receiver{};
+    comm.onMessage<Telemetry>(&receiver, [&](Telemetry const& message) {
+      received++;
+      checksum += message.seq;
+    });
+    report("receive", "schema",
+           measure(stackCount, [&](int) { transport->feed(frame); }));
+  }
+  {
+    QObject receiver{};
+    QObject::connect(&comm, &BLERFComm::dataReceived, &receiver,
+                     [&](QByteArray const& data) {
+                       auto const message = unstreamTelemetry(data,
+                                                              decodedTag);
+                       received++;
+                       checksum += message.seq;
+                     });
+    report("receive", "QDataStream",
+           measure(stackCount, [&](int) { transport->feed(frame); }));
+  }
+  if (received != 2 * (stackCount + 100)) {
+    failures++;
+  }
+
+  // keeps the compiler from dropping the work
+  out << QString("checksum %1\n").arg(checksum);
+  return failures == 0 ? 0 : 1;
+}
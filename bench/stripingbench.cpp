@@ -0,0 +1,186 @@
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+#include <algorithm>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "linkmetrics.hpp"
+#include "simulatedtransport.hpp"
+
+namespace {
+struct StripingResult {
+  bool striped{false};
+  int delivered{0};
+  int corrupted{0};
+  qint64 payloadBytes{0};
+  qint64 elapsedNs{0};
+  std::vector<qint64> latenciesNs{};
+};
+
+auto measureStriping(BenchOptions const& options, int size, int messages,
+                     int bulkChannels) -> StripingResult {
+  StripingResult result{};
+  // the echoing peer answers with our own Hello and echoes every segment on
+  // the characteristic it came in on
+  BLERFComm comm{};
+  setUpSimulatedLink(comm, options);
+  QList<QBluetoothUuid> bulkUuids{};
+  for (int i = 0; i < bulkChannels; i++) {
+    bulkUuids.append(QBluetoothUuid{static_cast<quint16>(0x2102 + i)});
+  }
+  comm.setBulkCharUuids(bulkUuids);
+  comm.setExtendedFramingEnabled(true);
+  comm.connectToDevice(simulatedDevice());
+  if (!waitForSignal(&comm, &BLERFComm::protocolNegotiated)) {
+    return result;
+  }
+  result.striped = comm.isStripingActive();
+
+  // every message carries its index, so reordering or corruption shows
+  std::vector<qint64> sentAtNs(static_cast<std::size_t>(messages));
+  result.latenciesNs.reserve(sentAtNs.size());
+  QElapsedTimer clock{};
+  QEventLoop loop{};
+  QTimer idleTimer{};
+  int sent{0};
+  int completed{0};
+
+  auto message = [size](int seq) {
+    QByteArray data{size, static_cast<char>(seq)};
+    for (int i = 0; i < 4 && i < size; i++) {
+      data[i] = static_cast<char>((seq >> (8 * i)) & 0xFF);
+    }
+    return data;
+  };
+  auto pump = [&]() {
+    while (sent < messages && sent - completed < options.window) {
+      sentAtNs[static_cast<std::size_t>(sent)] = clock.nsecsElapsed();
+      comm.sendData(message(sent));
+      sent++;
+    }
+  };
+
+  QObject::connect(&comm, &BLERFComm::dataReceived, &loop,
+                   [&](QByteArray const& data) {
+                     auto const now = clock.nsecsElapsed();
+                     if (data == message(completed)) {
+                       result.delivered++;
+                       result.payloadBytes += data.size();
+                       result.latenciesNs.push_back(
+                           now - sentAtNs[static_cast<std::size_t>(
+                                     completed)]);
+                     } else {
+                       result.corrupted++;
+                     }
+
+                     completed++;
+                     result.elapsedNs = now;
+                     if (completed >= messages) {
+                       loop.quit();
+                       return;
+                     }
+                     idleTimer.start();
+                     pump();
+                   });
+
+  idleTimer.setSingleShot(true);
+  idleTimer.setInterval(1000);
+  QObject::connect(&idleTimer, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+  clock.start();
+  idleTimer.start();
+  pump();
+  loop.exec();
+
+  comm.disconnectFromDevice();
+  return result;
+}
+
+// A bulk characteristic whose notifications couldn't be enabled leaves the
+// rest of the link usable, so it still has to get ready.
+auto readyWithQuietChannel(BenchOptions const& options) -> bool {
+  BLERFComm comm{};
+  auto* transport = makeSimulatedTransport(options);
+  transport->failNextNotifySetups(1);
+  comm.setTransport(transport);
+  applyWriteOptions(comm, options);
+  comm.setBulkCharUuids({QBluetoothUuid{quint16{0x2102}},
+                         QBluetoothUuid{quint16{0x2103}}});
+  comm.setExtendedFramingEnabled(true);
+  comm.connectToDevice(simulatedDevice());
+  bool const ready = waitForSignal(&comm, &BLERFComm::protocolNegotiated);
+  comm.disconnectFromDevice();
+  return ready;
+}
+}  // namespace
+
+auto runStripingBench(BenchOptions const& options) -> int {
+  auto linkOptions = options;
+  if (linkOptions.packetDelayUs == 0) {
+    linkOptions.packetDelayUs = AirtimePacketDelayUs;
+  }
+  // airtime bound runs are slow, a few hundred messages are plenty
+  int const messages = std::min(options.messages, 500);
+
+  QTextStream out{stdout};
+  out << QString("striping: up to %1 messages, window %2, MTU %3, delay %4 "
+                 "us, main characteristic alone vs. striped\n")
+             .arg(messages)
+             .arg(linkOptions.window)
+             .arg(linkOptions.mtu)
+             .arg(linkOptions.packetDelayUs);
+  out << QString("%1 %2 %3 %4 %5 %6\n")
+             .arg("size", 6)
+             .arg("bulk", 5)
+             .arg("goodput B/s", 12)
+             .arg("p50 us", 10)
+             .arg("p99 us", 10)
+             .arg("gain", 7);
+
+  int failures{0};
+  for (int const size : options.sizes) {
+    // about 64 KiB per run, long messages would take minutes otherwise
+    int const count = std::clamp(64 * 1024 / size, 1, messages);
+    double plainGoodput{0.0};
+    for (int const bulkChannels : {0, 1, 2, 4}) {
+      auto const result =
+          measureStriping(linkOptions, size, count, bulkChannels);
+      double const seconds = static_cast<double>(result.elapsedNs) / 1e9;
+      double const goodput =
+          seconds > 0 ? static_cast<double>(result.payloadBytes) / seconds
+                      : 0.0;
+      if (bulkChannels == 0) {
+        plainGoodput = goodput;
+      }
+
+      out << QString("%1 %2 %3 %4 %5 %6\n")
+                 .arg(size, 6)
+                 .arg(bulkChannels, 5)
+                 .arg(formatRate(goodput), 12)
+                 .arg(percentile(result.latenciesNs, 0.50) / 1000, 10)
+                 .arg(percentile(result.latenciesNs, 0.99) / 1000, 10)
+                 .arg(plainGoodput > 0
+                          ? QString("%1x").arg(goodput / plainGoodput, 0,
+                                               'f', 2)
+                          : QString("-"),
+                      7);
+      out.flush();
+
+      if (result.delivered != count ||
+          result.striped != (bulkChannels > 0)) {
+        failures++;
+      }
+    }
+  }
+
+  bool const quietReady = readyWithQuietChannel(linkOptions);
+  out << QString("one bulk characteristic not notifying: %1\n")
+             .arg(quietReady ? "ready" : "not ready");
+  if (!quietReady) {
+    failures++;
+  }
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <vector>
+
+#include "benchsuites.hpp"
+#include "blerfcomm.hpp"
+#include "simulatedtransport.hpp"
+
+namespace {
+struct ThroughputResult {
+  int delivered{0};
+  int corrupted{0};
+  int lost{0};
+  qint64 elapsedNs{0};
+  std::vector<qint64> latenciesNs{};
+};
+
+auto measureThroughput(BenchOptions const& options, int messageSize)
+    -> ThroughputResult {
+  ThroughputResult result{};
+  // the echoing peer answers our own Hello, so extended framing is
+  // negotiated right after connecting
+  BLERFComm comm{};
+  setUpSimulatedLink(comm, options);
+  comm.setExtendedFramingEnabled(true);
+  comm.connectToDevice(simulatedDevice());
+  if (!waitForSignal(&comm, &BLERFComm::protocolNegotiated)) {
+    result.lost = options.messages;
+    return result;
+  }
+
+  // every payload starts with its sequence number, so reordered or
+  // mis-assembled frames are detected instead of skewing the latency
+  int const size = std::max(messageSize, 4);
+  std::vector<qint64> sentAtNs(static_cast<std::size_t>(options.messages), -1);
+  result.latenciesNs.reserve(sentAtNs.size());
+
+  QElapsedTimer clock{};
+  QEventLoop loop{};
+  QTimer idleTimer{};
+  int sent{0};
+  int completed{0};
+
+  auto pump = [&]() {
+    while (sent < options.messages && sent - completed < options.window) {
+      QByteArray payload{size, 'x'};
+      qToLittleEndian<quint32>(static_cast<quint32>(sent), payload.data());
+      sentAtNs[static_cast<std::size_t>(sent)] = clock.nsecsElapsed();
+      comm.sendData(payload);
+      sent++;
+    }
+  };
+
+  QObject::connect(&comm, &BLERFComm::dataReceived, &loop,
+                   [&](QByteArray const& data) {
+                     qint64 const now = clock.nsecsElapsed();
+                     auto const seq =
+                         data.size() == size
+                             ? qFromLittleEndian<quint32>(data.constData())
+                             : static_cast<quint32>(options.messages);
+
+                     if (seq < sentAtNs.size() && sentAtNs[seq] >= 0) {
+                       result.latenciesNs.push_back(now - sentAtNs[seq]);
+                       sentAtNs[seq] = -1;
+                       result.delivered++;
+                     } else {
+                       result.corrupted++;
+                     }
+
+                     completed++;
+                     result.elapsedNs = now;
+                     if (completed >= options.messages) {
+                       loop.quit();
+                       return;
+                     }
+                     idleTimer.start();
+                     pump();
+                   });
+
+  // with packet loss some messages never come back - stop once the link
+  // has been quiet for a while
+  idleTimer.setSingleShot(true);
+  idleTimer.setInterval(500);
+  QObject::connect(&idleTimer, &QTimer::timeout, &loop, &QEventLoop::quit);
+
+  clock.start();
+  idleTimer.start();
+  pump();
+  loop.exec();
+
+  result.lost = options.messages - result.delivered - result.corrupted;
+  comm.disconnectFromDevice();
+  return result;
+}
+}  // namespace
+
+auto runThroughputBench(BenchOptions const& options) -> int {
+  QTextStream out{stdout};
+  out << QString("throughput: %1 messages, window %2, MTU %3, chunk %4, "
+                 "delay %5 us, loss %6, %7%8\n")
+             .arg(options.messages)
+             .arg(options.window)
+             .arg(options.mtu)
+             .arg(options.notificationChunkSize)
+             .arg(options.packetDelayUs)
+             .arg(options.lossRate)
+             .arg(options.writeWithResponse
+                      ? QString("writes with response")
+                      : QString("%1 writes without response in flight")
+                            .arg(options.writesInFlight))
+             .arg(options.coalesceDelayMs >= 0
+                      ? QString(", coalescing %1 ms")
+                            .arg(options.coalesceDelayMs)
+                      : QString{});
+  out << QString("%1 %2 %3 %4 %5 %6\n")
+             .arg("size", 6)
+             .arg("msg/s", 10)
+             .arg("B/s", 10)
+             .arg("p50 us", 10)
+             .arg("p99 us", 10)
+             .arg("lost", 6);
+
+  int failures{0};
+  for (int size : options.sizes) {
+    auto const result = measureThroughput(options, size);
+    double const seconds = static_cast<double>(result.elapsedNs) / 1e9;
+    double const messagesPerSecond =
+        seconds > 0 ? result.delivered / seconds : 0.0;
+
+    out << QString("%1 %2 %3 %4 %5 %6\n")
+               .arg(size, 6)
+               .arg(formatRate(messagesPerSecond), 10)
+               .arg(formatRate(messagesPerSecond * size), 10)
+               .arg(percentile(result.latenciesNs, 0.50) / 1000, 10)
+               .arg(percentile(result.latenciesNs, 0.99) / 1000, 10)
+               .arg(result.lost + result.corrupted, 6);
+    out.flush();
+
+    if (result.delivered == 0) {
+      failures++;
+    }
+  }
+
+  return failures == 0 ? 0 : 1;
+}
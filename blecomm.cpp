@@ -1,56 +1,80 @@
 #include "blecomm.hpp"
 
+#include <QRandomGenerator>
 #include <algorithm>
+#include <utility>
 
-BLEComm::BLEComm(QObject* parent) : QObject{parent} {}
+#include "gatttransport.hpp"
+
+BLEComm::BLEComm(QObject* parent) : QObject{parent} {
+  m_clock.start();
+
+  m_reconnectTimer = new QTimer{this};
+  m_reconnectTimer->setSingleShot(true);
+  QObject::connect(m_reconnectTimer, &QTimer::timeout, this,
+                   &BLEComm::reconnect);
+
+  m_tuner = new ConnectionTuner{m_metrics, this};
+
+  setTransport(new GattTransport{this});
+}
 
 BLEComm::BLEComm(QBluetoothUuid const& serviceUuid,
                  QBluetoothUuid const& charUuid, QObject* parent)
-    : QObject{parent} {
+    : BLEComm{parent} {
   setCommServiceUuid(serviceUuid);
   setCommCharacteristicUuid(charUuid);
 }
 
 void BLEComm::connectToDevice(const QBluetoothDeviceInfo& device) {
-  if (connected()) {
-    disconnectFromDevice();
-  }
+  m_reconnectTimer->stop();
+  m_reconnecting = false;
+  m_reconnectAttempt = 0;
+  m_device = device;
+  startConnecting();
+}
+
+void BLEComm::disconnectFromDevice() {
+  m_reconnectTimer->stop();
+  m_reconnecting = false;
+  m_reconnectAttempt = 0;
+  // set first, so that the transport's disconnection isn't taken for a loss
+  setState(State::Disconnected);
+  clearTransmitQueue();
+  m_transport->disconnectFromDevice();
+}
 
-  m_controller = QLowEnergyController::createCentral(device, this);
+void BLEComm::setAutoReconnect(bool enabled) {
+  m_autoReconnect = enabled;
+  if (!enabled && m_state == State::WaitingToReconnect) {
+    m_reconnectTimer->stop();
+    m_reconnecting = false;
+    clearTransmitQueue();
+    setState(State::Disconnected);
+  }
+}
 
-  QObject::connect(m_controller, &QLowEnergyController::disconnected, this,
-                   &BLEComm::disconnectedFromDevice, Qt::QueuedConnection);
-  QObject::connect(m_controller, &QLowEnergyController::connected, this,
-                   &BLEComm::handleConnection, Qt::QueuedConnection);
-  QObject::connect(m_controller, &QLowEnergyController::discoveryFinished, this,
-                   &BLEComm::handleDiscovery, Qt::QueuedConnection);
-  QObject::connect(
-      m_controller,
-      static_cast<void (QLowEnergyController::*)(QLowEnergyController::Error)>(
-          &QLowEnergyController::error),
-      [&](QLowEnergyController::Error errorCode) {
-        emit connectionError(BLEComm::Error::ConnectonError,
-                             QString("Connection error: %1 (code %2)")
-                                 .arg(m_controller->errorString(), errorCode));
-        disconnectFromDevice();
-      });
+void BLEComm::setReconnectBackoff(int initialMs, int maxMs) {
+  m_reconnectDelay = std::max(initialMs, 1);
+  m_maxReconnectDelay = std::max(maxMs, m_reconnectDelay);
+}
 
-  m_controller->connectToDevice();
+void BLEComm::setMaxReconnectAttempts(int attempts) {
+  m_maxReconnectAttempts = std::max(attempts, 0);
 }
 
-void BLEComm::disconnectFromDevice() {
-  if (m_service != nullptr) {
-    m_service->deleteLater();
-    m_service = nullptr;
-  }
+auto BLEComm::autoReconnect() const -> bool { return m_autoReconnect; }
 
-  if (m_controller != nullptr) {
-    m_controller->disconnectFromDevice();
-    m_controller->deleteLater();
-    m_controller = nullptr;
-  }
+auto BLEComm::maxReconnectAttempts() const -> int {
+  return m_maxReconnectAttempts;
 }
 
+auto BLEComm::reconnectAttempt() const -> int { return m_reconnectAttempt; }
+
+auto BLEComm::isReconnecting() const -> bool { return m_reconnecting; }
+
+auto BLEComm::state() const -> State { return m_state; }
+
 void BLEComm::setCommServiceUuid(QBluetoothUuid const& uuid) {
   if (m_serviceUuid != uuid) {
     m_serviceUuid = uuid;
@@ -65,37 +89,170 @@ void BLEComm::setCommCharacteristicUuid(QBluetoothUuid const& uuid) {
   }
 }
 
+void BLEComm::setTransport(BLETransport* transport) {
+  if (transport == nullptr || transport == m_transport) {
+    return;
+  }
+
+  if (m_transport != nullptr) {
+    m_reconnectTimer->stop();
+    m_reconnecting = false;
+    setState(State::Disconnected);
+    m_transport->disconnectFromDevice();
+    m_transport->disconnect(this);
+    m_transport->deleteLater();
+  }
+
+  m_transport = transport;
+  m_transport->setParent(this);
+
+  QObject::connect(m_transport, &BLETransport::connectedToDevice, this,
+                   &BLEComm::handleConnected);
+  QObject::connect(m_transport, &BLETransport::serviceDiscovered, this,
+                   &BLEComm::handleServiceDiscovered);
+  QObject::connect(m_transport, &BLETransport::disconnectedFromDevice, this,
+                   &BLEComm::handleDisconnection);
+  QObject::connect(m_transport, &BLETransport::connectionError, this,
+                   &BLEComm::handleConnectionError);
+  QObject::connect(m_transport, &BLETransport::commsReady, this,
+                   &BLEComm::handleReady);
+  QObject::connect(m_transport, &BLETransport::dataReceived, this,
+                   &BLEComm::handleDataReceived);
+  QObject::connect(m_transport, &BLETransport::dataWritten, this,
+                   &BLEComm::handleDataWritten);
+  QObject::connect(m_transport, &BLETransport::writeFailed, this,
+                   &BLEComm::handleWriteFailed);
+  QObject::connect(m_transport, &BLETransport::mtuChanged, this,
+                   &BLEComm::handleMtuChanged);
+  QObject::connect(m_transport, &BLETransport::bulkDataReceived, this,
+                   &BLEComm::handleBulkDataReceived);
+  QObject::connect(m_transport, &BLETransport::bulkDataWritten, this,
+                   &BLEComm::handleBulkDataWritten);
+  QObject::connect(m_transport, &BLETransport::bulkWriteFailed, this,
+                   &BLEComm::handleBulkWriteFailed);
+
+  m_transport->setDeviceCache(m_cache);
+  clearTransmitQueue();
+}
+
+auto BLEComm::transport() const -> BLETransport* { return m_transport; }
+
+void BLEComm::setDeviceCache(std::shared_ptr<DeviceCache> cache) {
+  m_cache = std::move(cache);
+  m_transport->setDeviceCache(m_cache);
+}
+
 void BLEComm::transmitData(const QByteArray& data) {
-  if (connected() && m_service != nullptr) {
-    m_service->writeCharacteristic(m_char, data);
+  if ((!ready() && !m_reconnecting) || data.isEmpty()) {
+    return;
   }
+  queueData(0, data);
+}
+
+void BLEComm::setBulkCharacteristicUuids(QList<QBluetoothUuid> const& uuids) {
+  m_bulkCharUuids = uuids;
 }
 
-auto BLEComm::connected() const -> bool {
-  return (m_controller != nullptr &&
-          (m_controller->state() == QLowEnergyController::ConnectedState ||
-           m_controller->state() == QLowEnergyController::DiscoveredState));
+auto BLEComm::bulkCharacteristicUuids() const -> QList<QBluetoothUuid> {
+  return m_bulkCharUuids;
 }
 
-auto BLEComm::ready() const -> bool {
-  if (m_service != nullptr) {
-    return m_service->state() == QLowEnergyService::ServiceDiscovered;
+auto BLEComm::bulkChannelCount() const -> int {
+  return static_cast<int>(m_lanes.size()) - 1;
+}
+
+void BLEComm::transmitBulkData(int channel, QByteArray const& data) {
+  if (!ready() || channel < 0 || channel >= bulkChannelCount() ||
+      data.isEmpty()) {
+    return;
   }
-  return false;
+  queueData(static_cast<std::size_t>(channel) + 1, data);
 }
 
-auto BLEComm::connectedDeviceName() const -> QString {
-  if (connected()) {
-    return m_controller->remoteName();
+void BLEComm::setWriteWithoutResponseAllowed(bool allowed) {
+  m_writeWithoutResponseAllowed = allowed;
+}
+
+void BLEComm::setMaxWritesInFlight(int writes) {
+  m_maxWritesInFlight = std::max(writes, 1);
+  pumpTransmitQueue();
+}
+
+auto BLEComm::writeWithoutResponseAllowed() const -> bool {
+  return m_writeWithoutResponseAllowed;
+}
+
+auto BLEComm::maxWritesInFlight() const -> int { return m_maxWritesInFlight; }
+
+auto BLEComm::writeMode() const -> BLETransport::WriteMode {
+  if (m_writeWithoutResponseAllowed &&
+      m_transport->supportsWriteWithoutResponse()) {
+    return BLETransport::WriteMode::WithoutResponse;
   }
-  return QString{};
+  return BLETransport::WriteMode::WithResponse;
 }
 
-auto BLEComm::connectedDeviceAddress() const -> QBluetoothAddress {
+auto BLEComm::mtu() const -> int {
+  return std::max(m_transport->mtu(), BLETransport::DefaultMtu);
+}
+
+auto BLEComm::pendingBytes() const -> qint64 {
+  return m_lanes.front().pendingBytes;
+}
+
+auto BLEComm::pendingBulkBytes(int channel) const -> qint64 {
+  if (channel < 0 || channel >= bulkChannelCount()) {
+    return 0;
+  }
+  return m_lanes[static_cast<std::size_t>(channel) + 1].pendingBytes;
+}
+
+auto BLEComm::metrics() const -> std::shared_ptr<LinkMetrics> {
+  return m_metrics;
+}
+
+void BLEComm::setConnectionProfiles(ConnectionProfiles const& profiles) {
+  m_connectionProfiles = profiles;
+}
+
+void BLEComm::setConnectionPolicy(ConnectionPolicy const& policy) {
+  m_connectionProfiles.insert("default", policy);
+}
+
+auto BLEComm::connectionProfiles() const -> ConnectionProfiles {
+  return m_connectionProfiles;
+}
+
+auto BLEComm::connectionTuner() const -> ConnectionTuner* { return m_tuner; }
+
+auto BLEComm::startCapture(QString const& path) -> bool {
+  auto capture = std::make_unique<CaptureWriter>(path);
+  if (!capture->open()) {
+    return false;
+  }
+
+  m_capture = std::move(capture);
   if (connected()) {
-    return m_controller->remoteAddress();
+    m_capture->record(CaptureFormat::RecordType::Connected);
   }
-  return QBluetoothAddress{};
+  recordMtu(mtu());
+  return true;
+}
+
+void BLEComm::stopCapture() { m_capture.reset(); }
+
+auto BLEComm::isCapturing() const -> bool { return m_capture != nullptr; }
+
+auto BLEComm::connected() const -> bool { return m_transport->connected(); }
+
+auto BLEComm::ready() const -> bool { return m_transport->ready(); }
+
+auto BLEComm::connectedDeviceName() const -> QString {
+  return m_transport->remoteName();
+}
+
+auto BLEComm::connectedDeviceAddress() const -> QBluetoothAddress {
+  return m_transport->remoteAddress();
 }
 
 auto BLEComm::commServiceUuid() const -> QBluetoothUuid {
@@ -106,66 +263,371 @@ auto BLEComm::commCharacteristicUuid() const -> QBluetoothUuid {
   return m_charUuid;
 }
 
-void BLEComm::handleConnection() {
+void BLEComm::handleConnected() {
+  if (m_capture) {
+    m_capture->record(CaptureFormat::RecordType::Connected);
+  }
+  if (m_state == State::Connecting) {
+    finishPhase();
+    setState(State::DiscoveringServices);
+  }
   emit connectedToDevice();
-  m_controller->discoverServices();
-}
-
-void BLEComm::handleDiscovery() {
-  auto found_services = m_controller->services();
-  auto service_ptr = std::find_if(found_services.begin(), found_services.end(),
-                                  [this](auto const& serviceUuid) {
-                                    return serviceUuid == commServiceUuid();
-                                  });
-  if (service_ptr == found_services.end()) {
-    emit connectionError(
-        BLEComm::Error::ServiceError,
-        QString("Cannot find service %1 on device %2!")
-            .arg(commServiceUuid().toString(), m_controller->remoteName()));
-    disconnectFromDevice();
+}
+
+void BLEComm::handleServiceDiscovered() {
+  if (m_state == State::DiscoveringServices) {
+    finishPhase();
+    setState(State::DiscoveringCharacteristic);
+  }
+}
+
+void BLEComm::handleReady() {
+  if (m_state == State::Disconnected || m_state == State::Ready) {
+    return;
+  }
+
+  // transports that don't report the service leave it at one phase
+  finishPhase();
+  emit timeToReady(m_phaseTimes[0], m_phaseTimes[1], m_phaseTimes[2],
+                   m_transport->connectedFromCache());
+
+  m_reconnecting = false;
+  m_reconnectAttempt = 0;
+  m_lanes.resize(static_cast<std::size_t>(m_transport->bulkChannelCount()) +
+                 1);
+  setState(State::Ready);
+  emit commsReady();
+  pumpTransmitQueue();
+}
+
+void BLEComm::handleDataReceived(QByteArray const& data) {
+  if (m_capture) {
+    m_capture->record(CaptureFormat::RecordType::Notification, data);
+  }
+  m_metrics->add(LinkMetrics::NotificationsReceived);
+  m_metrics->add(LinkMetrics::BytesReceived, data.size());
+  m_tuner->noteActivity(data.size());
+  emit dataReceived(data);
+}
+
+void BLEComm::handleMtuChanged(int mtu) {
+  recordMtu(mtu);
+  emit mtuChanged(mtu);
+}
+
+void BLEComm::handleConnectionError(BLEComm::Error error,
+                                    QString const& description) {
+  m_metrics->add(LinkMetrics::ConnectionErrors);
+  emit connectionError(error, description);
+
+  // a failed attempt counts as a lost link; errors once the device is ready
+  // only matter if the transport drops the link because of them
+  if (m_state == State::Connecting ||
+      m_state == State::DiscoveringServices ||
+      m_state == State::DiscoveringCharacteristic) {
+    handleLinkLoss();
+  }
+}
+
+void BLEComm::reconnect() {
+  if (m_state == State::WaitingToReconnect) {
+    m_metrics->add(LinkMetrics::ReconnectAttempts);
+    startConnecting();
+  }
+}
+
+void BLEComm::handleDataWritten() { finishWrite(0, true); }
+
+void BLEComm::handleWriteFailed() {
+  // the chunk is lost either way and the error itself is reported through
+  // connectionError - just keep the queue moving
+  finishWrite(0, false);
+}
+
+void BLEComm::handleBulkDataReceived(int channel, QByteArray const& data) {
+  if (m_capture) {
+    QByteArray record{};
+    record.reserve(data.size() + 1);
+    record.append(static_cast<char>(channel));
+    record.append(data);
+    m_capture->record(CaptureFormat::RecordType::BulkNotification, record);
+  }
+  m_metrics->add(LinkMetrics::NotificationsReceived);
+  m_metrics->add(LinkMetrics::BytesReceived, data.size());
+  m_tuner->noteActivity(data.size());
+  emit bulkDataReceived(channel, data);
+}
+
+void BLEComm::handleBulkDataWritten(int channel) {
+  finishWrite(static_cast<std::size_t>(channel) + 1, true);
+}
+
+void BLEComm::handleBulkWriteFailed(int channel) {
+  finishWrite(static_cast<std::size_t>(channel) + 1, false);
+}
+
+void BLEComm::handleDisconnection() {
+  if (m_capture) {
+    m_capture->record(CaptureFormat::RecordType::Disconnected);
+  }
+  if (m_state != State::Disconnected &&
+      m_state != State::WaitingToReconnect) {
+    handleLinkLoss();
+  }
+  emit disconnectedFromDevice();
+}
+
+void BLEComm::startConnecting() {
+  m_phaseTimes.fill(0);
+  m_phaseClock.start();
+  // set first, transports may report progress synchronously
+  setState(State::Connecting);
+  m_transport->setBulkCharacteristics(m_bulkCharUuids);
+  m_transport->connectToDevice(m_device, m_serviceUuid, m_charUuid);
+}
+
+void BLEComm::handleLinkLoss() {
+  bool const retry =
+      m_autoReconnect && (m_maxReconnectAttempts == 0 ||
+                          m_reconnectAttempt < m_maxReconnectAttempts);
+  bool const gaveUp = m_autoReconnect && !retry;
+  m_metrics->add(LinkMetrics::LinkLosses);
+
+  // the state goes first, tearing the link down may come back here through
+  // handleDisconnection
+  if (retry) {
+    m_reconnecting = true;
+    setState(State::WaitingToReconnect);
+    dropInterruptedWrites();
   } else {
-    m_service = m_controller->createServiceObject(*service_ptr, this);
-
-    QObject::connect(
-        m_service,
-        static_cast<void (QLowEnergyService::*)(
-            QLowEnergyService::ServiceError)>(&QLowEnergyService::error),
-        [&](QLowEnergyService::ServiceError errorCode) {
-          emit connectionError(
-              BLEComm::Error::ServiceError,
-              QString("An unknown service error happened (code %1)")
-                  .arg(errorCode));
-        });
-
-    QObject::connect(m_service, &QLowEnergyService::characteristicChanged, this,
-                     &BLEComm::handleData, Qt::QueuedConnection);
-
-    QObject::connect(
-        m_service, &QLowEnergyService::stateChanged,
-        [&](QLowEnergyService::ServiceState newState) {
-          if (newState == QLowEnergyService::ServiceDiscovered) {
-            m_char = m_service->characteristic(m_charUuid);
-
-            if (!m_char.isValid()) {
-              emit connectionError(
-                  BLEComm::Error::CharacteristicError,
-                  QString("Invalid characteristic %1 on device %2!")
-                      .arg(m_charUuid.toString(), m_controller->remoteName()));
-              disconnectFromDevice();
-              return;
-            }
-
-            emit commsReady();
-          }
-        });
-
-    m_service->discoverDetails();
-  }
-}
-
-void BLEComm::handleData(const QLowEnergyCharacteristic& characteristic,
-                         const QByteArray& data) {
-  if (characteristic == m_char) {
-    emit dataReceived(data);
+    m_reconnecting = false;
+    m_reconnectAttempt = 0;
+    setState(State::Disconnected);
+    clearTransmitQueue();
+  }
+  m_transport->disconnectFromDevice();
+
+  if (gaveUp) {
+    emit reconnectFailed();
+    return;
+  }
+  if (retry) {
+    m_reconnectAttempt++;
+    int const delay = reconnectDelay(m_reconnectAttempt);
+    m_reconnectTimer->start(delay);
+    emit reconnecting(m_reconnectAttempt, delay);
+  }
+}
+
+auto BLEComm::reconnectDelay(int attempt) const -> int {
+  qint64 base = m_reconnectDelay;
+  for (int i = 1; i < attempt && base < m_maxReconnectDelay; i++) {
+    base *= 2;
+  }
+  base = std::min<qint64>(base, m_maxReconnectDelay);
+
+  // jitter keeps devices that dropped together from retrying in lockstep
+  auto const half = static_cast<int>(base / 2);
+  return half + QRandomGenerator::global()->bounded(half + 1);
+}
+
+void BLEComm::recordMtu(int mtu) {
+  if (m_capture) {
+    char const value[]{static_cast<char>(mtu & 0xFF),
+                       static_cast<char>((mtu >> 8) & 0xFF)};
+    m_capture->record(CaptureFormat::RecordType::MtuChanged, value,
+                      int{sizeof(value)});
+  }
+}
+
+void BLEComm::setState(State state) {
+  if (m_state == state) {
+    return;
   }
+
+  if (state == State::Ready) {
+    auto const address = m_device.address().toString();
+    auto const name = m_device.name();
+    auto const fallback = m_connectionProfiles.value("default");
+    m_tuner->setPolicy(m_connectionProfiles.value(
+        address, m_connectionProfiles.value(name, fallback)));
+    m_tuner->start(m_transport);
+  } else if (m_state == State::Ready) {
+    m_tuner->stop();
+  }
+
+  m_state = state;
+  emit stateChanged(m_state);
+}
+
+void BLEComm::finishPhase() {
+  qint64 const elapsed = m_phaseClock.restart();
+  switch (m_state) {
+    case State::Connecting:
+      m_phaseTimes[0] = elapsed;
+      break;
+    case State::DiscoveringServices:
+      m_phaseTimes[1] = elapsed;
+      break;
+    default:
+      m_phaseTimes[2] = elapsed;
+      break;
+  }
+}
+
+void BLEComm::queueData(std::size_t lane, QByteArray const& data) {
+  m_lanes[lane].units.push_back(data);
+  m_lanes[lane].pendingBytes += data.size();
+  m_tuner->noteActivity(data.size());
+
+  pumpLane(lane, writeMode());
+}
+
+void BLEComm::discardPendingData() {
+  auto& lane = m_lanes.front();
+  std::size_t const started = lane.offset > 0 ? 1 : 0;
+  qint64 discarded{0};
+  while (lane.units.size() > started) {
+    discarded += lane.units.back().size();
+    lane.units.pop_back();
+  }
+  lane.pendingBytes -= discarded;
+  m_metrics->add(LinkMetrics::BytesDropped, discarded);
+}
+
+void BLEComm::pumpTransmitQueue() {
+  auto const mode = writeMode();
+  for (std::size_t lane = 0; lane < m_lanes.size(); lane++) {
+    pumpLane(lane, mode);
+  }
+}
+
+void BLEComm::pumpLane(std::size_t index, BLETransport::WriteMode mode) {
+  if (m_state != State::Ready || !ready()) {
+    return;
+  }
+
+  // ATT allows one outstanding request, so writes with response go one by one
+  int const limit = mode == BLETransport::WriteMode::WithoutResponse
+                        ? m_maxWritesInFlight
+                        : 1;
+
+  auto& lane = m_lanes[index];
+  int const chunkSize = mtu() - BLETransport::AttHeaderSize;
+  while (!lane.units.empty() &&
+         static_cast<int>(lane.writesInFlight.size()) < limit) {
+    QByteArray const& unit = lane.units.front();
+    int const size = std::min(chunkSize, unit.size() - lane.offset);
+    QByteArray chunk =
+        size == unit.size() ? unit : unit.mid(lane.offset, size);
+
+    lane.offset += size;
+    if (lane.offset == unit.size()) {
+      lane.units.pop_front();
+      lane.offset = 0;
+    }
+    lane.writesInFlight.push_back(PendingWrite{size, m_clock.nsecsElapsed()});
+
+    if (index == 0) {
+      if (m_capture) {
+        m_capture->record(CaptureFormat::RecordType::Write, chunk);
+      }
+      m_transport->write(chunk, mode);
+      continue;
+    }
+
+    int const channel = static_cast<int>(index) - 1;
+    if (m_capture) {
+      m_capture->record(CaptureFormat::RecordType::BulkWrite,
+                        static_cast<char>(channel) + chunk);
+    }
+    m_transport->writeBulk(channel, chunk, mode);
+  }
+}
+
+void BLEComm::finishWrite(std::size_t index, bool written) {
+  // bulk channels that went away with the link may still report
+  if (index >= m_lanes.size() || m_lanes[index].writesInFlight.empty()) {
+    return;
+  }
+
+  // writes complete in the order they were issued
+  auto& lane = m_lanes[index];
+  auto const write = lane.writesInFlight.front();
+  lane.writesInFlight.pop_front();
+  lane.pendingBytes -= write.bytes;
+
+  if (written) {
+    m_metrics->add(LinkMetrics::WritesCompleted);
+    m_metrics->add(LinkMetrics::BytesWritten, write.bytes);
+    m_metrics->record(LinkMetrics::WriteLatency,
+                      (m_clock.nsecsElapsed() - write.issuedNs) / 1000);
+  } else {
+    m_metrics->add(LinkMetrics::WritesDropped);
+    m_metrics->add(LinkMetrics::BytesDropped, write.bytes);
+  }
+
+  reportWrite(index, write.bytes, written);
+  pumpLane(index, writeMode());
+}
+
+void BLEComm::reportWrite(std::size_t lane, int bytes, bool written) {
+  if (lane == 0) {
+    if (written) {
+      emit dataWritten(bytes);
+    } else {
+      emit dataDropped(bytes);
+    }
+    return;
+  }
+
+  int const channel = static_cast<int>(lane) - 1;
+  if (written) {
+    emit bulkDataWritten(channel, bytes);
+  } else {
+    emit bulkDataDropped(channel, bytes);
+  }
+}
+
+void BLEComm::dropInterruptedWrites() {
+  // whether writes in flight made it is unknown, and the rest of a partly
+  // written message would be garbage to the peer - both count as dropped,
+  // in the order they were queued. Bulk channels may be gone after the
+  // reconnect, so they're emptied altogether.
+  std::vector<std::pair<std::size_t, int>> interrupted{};
+  for (std::size_t index = 0; index < m_lanes.size(); index++) {
+    auto& lane = m_lanes[index];
+    for (auto const& write : lane.writesInFlight) {
+      interrupted.emplace_back(index, write.bytes);
+    }
+    m_metrics->add(LinkMetrics::WritesDropped, lane.writesInFlight.size());
+    lane.writesInFlight.clear();
+
+    if (lane.offset > 0) {
+      interrupted.emplace_back(index, lane.units.front().size() - lane.offset);
+      lane.units.pop_front();
+      lane.offset = 0;
+    }
+    if (index > 0) {
+      for (auto const& unit : lane.units) {
+        interrupted.emplace_back(index, unit.size());
+      }
+    }
+  }
+
+  m_lanes.resize(1);
+  for (auto const& [lane, bytes] : interrupted) {
+    if (lane == 0) {
+      m_lanes.front().pendingBytes -= bytes;
+    }
+  }
+
+  for (auto const& [lane, bytes] : interrupted) {
+    m_metrics->add(LinkMetrics::BytesDropped, bytes);
+    reportWrite(lane, bytes, false);
+  }
+}
+
+void BLEComm::clearTransmitQueue() {
+  m_lanes.assign(1, Lane{});
 }
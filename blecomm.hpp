@@ -3,12 +3,20 @@
 #include <QBluetoothDeviceInfo>
 #include <QBluetoothUuid>
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QList>
-#include <QLowEnergyCharacteristic>
-#include <QLowEnergyController>
-#include <QLowEnergyService>
 #include <QObject>
 #include <QString>
+#include <QTimer>
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "bletransport.hpp"
+#include "capturefile.hpp"
+#include "connectiontuner.hpp"
+#include "linkmetrics.hpp"
 
 class BLEComm : public QObject
 {
@@ -21,27 +29,110 @@ class BLEComm : public QObject
           setCommCharacteristicUuid NOTIFY commCharacteristicUuidChanged)
 
  public:
-  enum Error {
-    NoError,
-    ConnectonError,
-    ServiceError,
-    CharacteristicError,
-    UnknownError
+  using Error = BLETransport::Error;
+  using ServiceList = QList<QBluetoothUuid>;
+
+  enum class State {
+    Disconnected,
+    Connecting,
+    DiscoveringServices,
+    DiscoveringCharacteristic,
+    Ready,
+    WaitingToReconnect
   };
+  Q_ENUM(State)
 
-  using ServiceList = QList<QBluetoothUuid>;
+  static constexpr int DefaultReconnectDelay{500};
+  static constexpr int DefaultMaxReconnectDelay{30000};
 
   explicit BLEComm(QObject* parent = nullptr);
   explicit BLEComm(QBluetoothUuid const& serviceUuid,
                    QBluetoothUuid const& charUuid, QObject* parent = nullptr);
 
   void connectToDevice(QBluetoothDeviceInfo const& device);
+  // Also stops reconnecting; whatever is left to transmit is discarded.
   void disconnectFromDevice();
 
+  // With automatic reconnect, losing the link (or failing to set it up again)
+  // schedules another attempt after an exponentially growing delay with
+  // jitter: a random point in the upper half of min(max, initial * 2^n) ms.
+  // Writes interrupted by the loss are reported through dataDropped, data
+  // not written yet is kept and goes out once the device is ready again.
+  // maxAttempts of 0 retries forever.
+  void setAutoReconnect(bool enabled);
+  void setReconnectBackoff(int initialMs, int maxMs);
+  void setMaxReconnectAttempts(int attempts);
+  auto autoReconnect() const -> bool;
+  auto maxReconnectAttempts() const -> int;
+  auto reconnectAttempt() const -> int;
+  // True from an unexpected link loss until the device is ready again or
+  // reconnecting is given up.
+  auto isReconnecting() const -> bool;
+  auto state() const -> State;
+
   void setCommServiceUuid(QBluetoothUuid const& uuid);
   void setCommCharacteristicUuid(QBluetoothUuid const& uuid);
 
+  // Takes ownership of the transport, replacing the current one. By default a
+  // GattTransport talking to a real QLowEnergyController is used.
+  void setTransport(BLETransport* transport);
+  auto transport() const -> BLETransport*;
+
+  // Shared with the transports, which use it to speed up connecting to
+  // devices they've seen before.
+  void setDeviceCache(std::shared_ptr<DeviceCache> cache);
+
+  // Splits data into chunks that fit the negotiated ATT MTU and writes them
+  // in order. Without-response writes are used whenever the characteristic
+  // supports them (unless disabled), with at most maxWritesInFlight
+  // outstanding; otherwise every chunk waits for the previous write response.
+  // While reconnecting, data is held until the device is ready again.
   void transmitData(QByteArray const& data);
+  // Drops what transmitData holds that no write has started on yet, without
+  // reporting it - for data that means nothing to the peer anymore, like
+  // reliable packets of a connection that's gone. A partly written message
+  // is still finished.
+  void discardPendingData();
+
+  // Further characteristics of the service that carry bulk data next to the
+  // main one, used from the next connection on. Those the device has become
+  // bulk channels 0 to bulkChannelCount() - 1 once it's ready, in the order
+  // given.
+  void setBulkCharacteristicUuids(QList<QBluetoothUuid> const& uuids);
+  auto bulkCharacteristicUuids() const -> QList<QBluetoothUuid>;
+  auto bulkChannelCount() const -> int;
+  // transmitData on a bulk channel, which has writes in flight of its own.
+  // Nothing waits for a reconnect there: whatever is left when the link
+  // drops is reported through bulkDataDropped.
+  void transmitBulkData(int channel, QByteArray const& data);
+
+  void setWriteWithoutResponseAllowed(bool allowed);
+  void setMaxWritesInFlight(int writes);
+  auto writeWithoutResponseAllowed() const -> bool;
+  auto maxWritesInFlight() const -> int;
+  auto writeMode() const -> BLETransport::WriteMode;
+  auto mtu() const -> int;
+  auto pendingBytes() const -> qint64;
+  auto pendingBulkBytes(int channel) const -> qint64;
+
+  // Counters and histograms of this link, shared with BLERFComm on top of it
+  // and safe to read from any thread.
+  auto metrics() const -> std::shared_ptr<LinkMetrics>;
+
+  // Which ConnectionPolicy applies to the device is looked up by its address,
+  // then its name, then "default" whenever the link gets ready. Adaptive
+  // policies have the tuner switch between the busy and idle parameters.
+  void setConnectionProfiles(ConnectionProfiles const& profiles);
+  void setConnectionPolicy(ConnectionPolicy const& policy);
+  auto connectionProfiles() const -> ConnectionProfiles;
+  auto connectionTuner() const -> ConnectionTuner*;
+
+  // Records every notification, write and link event, as they are, to a
+  // capture file (see capturefile.hpp) until stopCapture. ReplayTransport
+  // plays it back.
+  auto startCapture(QString const& path) -> bool;
+  void stopCapture();
+  auto isCapturing() const -> bool;
 
   Q_INVOKABLE auto connected() const -> bool;
   Q_INVOKABLE auto ready() const -> bool;
@@ -55,22 +146,99 @@ class BLEComm : public QObject
   void disconnectedFromDevice();
   void connectionError(BLEComm::Error errorType, QString const& description);
   void commsReady();
+  // Duration of each phase of the last (re)connection, emitted right before
+  // commsReady. The backoff delay before a reconnect isn't included.
+  void timeToReady(qint64 connectMs, qint64 serviceDiscoveryMs,
+                   qint64 characteristicDiscoveryMs, bool fromCache);
+  void stateChanged(BLEComm::State state);
+  void reconnecting(int attempt, int delayMs);
+  // The attempt cap has been reached; the state is Disconnected again.
+  void reconnectFailed();
   void dataReceived(QByteArray const& data);
+  void dataWritten(int bytes);
+  void dataDropped(int bytes);
+  void mtuChanged(int mtu);
+  void bulkDataReceived(int channel, QByteArray const& data);
+  void bulkDataWritten(int channel, int bytes);
+  void bulkDataDropped(int channel, int bytes);
 
   void commServiceUuidChanged(QBluetoothUuid commServiceUuid);
   void commCharacteristicUuidChanged(QBluetoothUuid commCharacteristicUuid);
 
  private slots:
-  void handleConnection();
-  void handleDiscovery();
-  void handleData(QLowEnergyCharacteristic const& characteristic,
-                  QByteArray const& data);
+  void handleConnected();
+  void handleServiceDiscovered();
+  void handleReady();
+  void handleDataReceived(QByteArray const& data);
+  void handleMtuChanged(int mtu);
+  void handleConnectionError(BLEComm::Error error, QString const& description);
+  void reconnect();
+  void handleDataWritten();
+  void handleWriteFailed();
+  void handleBulkDataReceived(int channel, QByteArray const& data);
+  void handleBulkDataWritten(int channel);
+  void handleBulkWriteFailed(int channel);
+  void handleDisconnection();
 
  private:
-  QLowEnergyController* m_controller{nullptr};
-  QLowEnergyService* m_service{nullptr};
-  QLowEnergyCharacteristic m_char{};
+  void startConnecting();
+  void handleLinkLoss();
+  auto reconnectDelay(int attempt) const -> int;
+  void setState(State state);
+  void recordMtu(int mtu);
+  void finishPhase();
+  void queueData(std::size_t lane, QByteArray const& data);
+  void pumpTransmitQueue();
+  void pumpLane(std::size_t lane, BLETransport::WriteMode mode);
+  void finishWrite(std::size_t lane, bool written);
+  void reportWrite(std::size_t lane, int bytes, bool written);
+  void dropInterruptedWrites();
+  void clearTransmitQueue();
+
+  BLETransport* m_transport{nullptr};
+  std::shared_ptr<DeviceCache> m_cache{};
+  std::shared_ptr<LinkMetrics> m_metrics{std::make_shared<LinkMetrics>()};
+  std::unique_ptr<CaptureWriter> m_capture{};
+  ConnectionTuner* m_tuner{nullptr};
+  ConnectionProfiles m_connectionProfiles{};
+  // time base of the write latencies
+  QElapsedTimer m_clock{};
+
+  State m_state{State::Disconnected};
+  QBluetoothDeviceInfo m_device{};
+  QTimer* m_reconnectTimer{nullptr};
+  bool m_autoReconnect{false};
+  bool m_reconnecting{false};
+  int m_reconnectAttempt{0};
+  int m_maxReconnectAttempts{0};
+  int m_reconnectDelay{DefaultReconnectDelay};
+  int m_maxReconnectDelay{DefaultMaxReconnectDelay};
+
+  // connect, service discovery, characteristic discovery
+  QElapsedTimer m_phaseClock{};
+  std::array<qint64, 3> m_phaseTimes{};
+
+  // messages as handed to transmitData, split into writes as they go out so
+  // that a reconnect with a different MTU can pick up where it left off
+  struct PendingWrite {
+    int bytes;
+    qint64 issuedNs;
+  };
+
+  // the transmit path of one characteristic
+  struct Lane {
+    std::deque<QByteArray> units{};
+    int offset{0};
+    std::deque<PendingWrite> writesInFlight{};
+    qint64 pendingBytes{0};
+  };
+
+  // the main characteristic's first, then one per bulk channel once ready
+  std::vector<Lane> m_lanes{};
+  int m_maxWritesInFlight{4};
+  bool m_writeWithoutResponseAllowed{true};
 
   QBluetoothUuid m_serviceUuid{};
   QBluetoothUuid m_charUuid{};
+  QList<QBluetoothUuid> m_bulkCharUuids{};
 };
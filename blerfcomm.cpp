@@ -1,9 +1,50 @@
 #include "blerfcomm.hpp"
 
+#include <QFile>
+#include <QFileInfo>
 #include <algorithm>
 
+#include "lzcodec.hpp"
+#include "rfcommprotocol.hpp"
+
+namespace {
+// tracks of the transmit queue: frames written to the main characteristic
+// and those striped over the bulk ones
+constexpr int MainTrack{0};
+constexpr int BulkTrack{1};
+
+auto read32(char const* data) -> qint64 {
+  quint32 value{0};
+  for (int i = 0; i < 4; i++) {
+    value |= static_cast<quint32>(static_cast<quint8>(data[i])) << (8 * i);
+  }
+  return value;
+}
+}  // namespace
+
 BLERFComm::BLERFComm(QObject *parent) : QObject(parent) {
   m_comm = new BLEComm{this};
+  m_metrics = m_comm->metrics();
+  m_reliable.setMetrics(m_metrics);
+  m_clock.start();
+
+  m_coalesceTimer = new QTimer{this};
+  m_coalesceTimer->setSingleShot(true);
+  QObject::connect(m_coalesceTimer, &QTimer::timeout, this, &BLERFComm::flush);
+
+  m_retransmitTimer = new QTimer{this};
+  m_retransmitTimer->setSingleShot(true);
+  m_retransmitTimer->setTimerType(Qt::PreciseTimer);
+  QObject::connect(m_retransmitTimer, &QTimer::timeout, this,
+                   &BLERFComm::handleRetransmitTimeout);
+  m_ackTimer = new QTimer{this};
+  m_ackTimer->setSingleShot(true);
+  m_ackTimer->setTimerType(Qt::PreciseTimer);
+  QObject::connect(m_ackTimer, &QTimer::timeout, this, &BLERFComm::sendAck);
+  m_stripeGapTimer = new QTimer{this};
+  m_stripeGapTimer->setSingleShot(true);
+  QObject::connect(m_stripeGapTimer, &QTimer::timeout, this,
+                   &BLERFComm::skipStripeGap);
 
   QObject::connect(m_comm, &BLEComm::connectedToDevice, this,
                    &BLERFComm::connectedToDevice);
@@ -11,20 +52,52 @@ BLERFComm::BLERFComm(QObject *parent) : QObject(parent) {
                    &BLERFComm::disconnectedFromDevice);
   QObject::connect(m_comm, &BLEComm::connectionError, this,
                    &BLERFComm::connectionError);
-  QObject::connect(m_comm, &BLEComm::commsReady, this, &BLERFComm::deviceReady);
+  QObject::connect(m_comm, &BLEComm::commsReady, this,
+                   &BLERFComm::handleReady);
+  QObject::connect(m_comm, &BLEComm::timeToReady, this,
+                   &BLERFComm::timeToReady);
   QObject::connect(m_comm, &BLEComm::dataReceived, this, &BLERFComm::handleRx);
+  QObject::connect(m_comm, &BLEComm::dataWritten, this,
+                   &BLERFComm::handleDataWritten);
+  QObject::connect(m_comm, &BLEComm::dataDropped, this,
+                   &BLERFComm::handleDataDropped);
+  QObject::connect(m_comm, &BLEComm::bulkDataReceived, this,
+                   &BLERFComm::handleBulkRx);
+  QObject::connect(m_comm, &BLEComm::bulkDataWritten, this,
+                   &BLERFComm::handleBulkDataWritten);
+  QObject::connect(m_comm, &BLEComm::bulkDataDropped, this,
+                   &BLERFComm::handleBulkDataDropped);
   QObject::connect(m_comm, &BLEComm::commServiceUuidChanged, this,
                    &BLERFComm::serviceUuidChanged);
   QObject::connect(m_comm, &BLEComm::commCharacteristicUuidChanged, this,
                    &BLERFComm::charUuidChanged);
 
-  QObject::connect(m_comm, &BLEComm::commsReady,
-                   [&]() { m_deviceReady = true; });
+  QObject::connect(m_comm, &BLEComm::stateChanged, this,
+                   &BLERFComm::stateChanged);
+  QObject::connect(m_comm, &BLEComm::reconnecting, this,
+                   &BLERFComm::reconnecting);
+  QObject::connect(m_comm, &BLEComm::reconnectFailed, this,
+                   &BLERFComm::reconnectFailed);
+
   QObject::connect(m_comm, &BLEComm::connectedToDevice,
                    [&]() { m_deviceConnected = true; });
   QObject::connect(m_comm, &BLEComm::disconnectedFromDevice, [&]() {
     m_deviceReady = false;
     m_deviceConnected = false;
+    m_rx.frames.reset();
+    resetProtocolState();
+    failBlobs("Link lost");
+    // messages not written yet wait for the reconnect
+    if (!m_comm->isReconnecting()) {
+      dropQueuedFrames();
+    }
+  });
+  QObject::connect(m_comm, &BLEComm::stateChanged, [&](BLEComm::State state) {
+    if (state == BLEComm::State::WaitingToReconnect) {
+      m_deviceReady = false;
+    } else if (state == BLEComm::State::Disconnected) {
+      dropQueuedFrames();
+    }
   });
 }
 
@@ -40,19 +113,185 @@ bool BLERFComm::isDeviceConnected() const { return m_deviceConnected; }
 
 bool BLERFComm::isDeviceReady() const { return m_deviceReady; }
 
+void BLERFComm::setExtendedFramingEnabled(bool enabled) {
+  if (isExtendedFramingEnabled() == enabled) {
+    return;
+  }
+
+  auto const previousMaximum = maximumMessageSize();
+  m_localCapabilities.setFlag(ExtendedLength, enabled);
+
+  if (enabled && m_deviceReady) {
+    sendHello();
+  }
+  if (maximumMessageSize() != previousMaximum) {
+    emit maximumMessageSizeChanged(maximumMessageSize());
+  }
+}
+
+bool BLERFComm::isExtendedFramingEnabled() const {
+  return m_localCapabilities.testFlag(ExtendedLength);
+}
+
+void BLERFComm::setReliableDeliveryEnabled(bool enabled) {
+  if (isReliableDeliveryEnabled() == enabled) {
+    return;
+  }
+
+  m_localCapabilities.setFlag(ReliableDelivery, enabled);
+  if (enabled && m_deviceReady) {
+    sendHello();
+    updateReliableMode();
+  }
+}
+
+bool BLERFComm::isReliableDeliveryEnabled() const {
+  return m_localCapabilities.testFlag(ReliableDelivery);
+}
+
+bool BLERFComm::isReliableDeliveryActive() const { return m_reliableTx; }
+
+void BLERFComm::setCompressionEnabled(bool enabled) {
+  if (isCompressionEnabled() == enabled) {
+    return;
+  }
+
+  m_localCapabilities.setFlag(Compression, enabled);
+  if (enabled && m_deviceReady) {
+    sendHello();
+  }
+}
+
+bool BLERFComm::isCompressionEnabled() const {
+  return m_localCapabilities.testFlag(Compression);
+}
+
+bool BLERFComm::isCompressionActive() const {
+  return negotiatedCapabilities().testFlag(Compression);
+}
+
+void BLERFComm::setBulkCharUuids(QList<QBluetoothUuid> const& charUuids) {
+  m_comm->setBulkCharacteristicUuids(charUuids);
+}
+
+QList<QBluetoothUuid> BLERFComm::bulkCharUuids() const {
+  return m_comm->bulkCharacteristicUuids();
+}
+
+bool BLERFComm::isStripingActive() const { return m_stripingTx; }
+
+BLERFComm::Capabilities BLERFComm::negotiatedCapabilities() const {
+  return m_localCapabilities & m_peerCapabilities;
+}
+
+int BLERFComm::maximumMessageSize() const {
+  if (negotiatedCapabilities().testFlag(ExtendedLength)) {
+    return RFCommProtocol::MaxExtendedPayload;
+  }
+  return RFCommProtocol::MaxLegacyPayload;
+}
+
+void BLERFComm::setTransmitQueueLimits(int maxMessages, qint64 maxBytes) {
+  m_tx.setLimits(maxMessages, maxBytes);
+}
+
+void BLERFComm::setBackpressureThresholds(qint64 highWaterBytes,
+                                          qint64 lowWaterBytes) {
+  m_tx.setWaterMarks(highWaterBytes, lowWaterBytes);
+  reportTransmitProgress();
+}
+
+int BLERFComm::queuedMessages() const { return m_tx.messages(); }
+
+qint64 BLERFComm::queuedBytes() const { return m_tx.bytes(); }
+
+bool BLERFComm::isCongested() const { return m_tx.congested(); }
+
+void BLERFComm::setCoalescingEnabled(bool enabled) {
+  if (m_coalescingEnabled == enabled) {
+    return;
+  }
+
+  m_coalescingEnabled = enabled;
+  if (!enabled) {
+    m_coalesceTimer->stop();
+    submitQueuedFrames();
+  }
+}
+
+void BLERFComm::setCoalescingDelay(int milliseconds) {
+  m_coalescingDelay = std::max(milliseconds, 0);
+}
+
+void BLERFComm::setCoalescingThreshold(int bytes) {
+  m_coalescingThreshold = std::max(bytes, 0);
+  submitQueuedFrames();
+}
+
+bool BLERFComm::isCoalescingEnabled() const { return m_coalescingEnabled; }
+
+int BLERFComm::coalescingDelay() const { return m_coalescingDelay; }
+
+int BLERFComm::coalescingThreshold() const { return m_coalescingThreshold; }
+
+void BLERFComm::flush() {
+  m_coalesceTimer->stop();
+  m_flushRequested = m_tx.hasQueued();
+  submitQueuedFrames();
+}
+
 void BLERFComm::connectToDevice(QBluetoothDeviceInfo const& device) {
   m_comm->connectToDevice(device);
 }
 
 void BLERFComm::disconnectFromDevice() { m_comm->disconnectFromDevice(); }
 
-void BLERFComm::sendData(QByteArray const& data) {
-  QByteArray properData{data.size() + 1, 0x00};
-  properData[0] = data.size();
-  std::copy(data.begin(), data.end(), properData.begin() + 1);
-  m_comm->transmitData(properData);
+quint64 BLERFComm::sendData(QByteArray const& data, Priority priority) {
+  if (data.size() > maximumMessageSize()) {
+    m_metrics->add(LinkMetrics::MessagesRejected);
+    return 0;
+  }
+  return queueFrame(encodeMessage(data), priority);
+}
+
+BlobTransfer* BLERFComm::sendBlob(QIODevice* source, QString const& name,
+                                  qint64 offset) {
+  auto* transfer = new BlobTransfer{this, BlobTransfer::Direction::Outgoing,
+                                    0, name, this};
+  startBlob(transfer, source, offset);
+  return transfer;
+}
+
+BlobTransfer* BLERFComm::sendFile(QString const& path, qint64 offset) {
+  auto* transfer = new BlobTransfer{this, BlobTransfer::Direction::Outgoing,
+                                    0, QFileInfo{path}.fileName(), this};
+  // owned by the transfer, which reads it through a memory mapping
+  transfer->m_file = std::make_unique<QFile>(path);
+  if (!transfer->m_file->open(QIODevice::ReadOnly)) {
+    transfer->m_error = transfer->m_file->errorString();
+  }
+  startBlob(transfer, transfer->m_file.get(), offset);
+  return transfer;
+}
+
+void BLERFComm::setTransport(BLETransport* transport) {
+  m_comm->setTransport(transport);
+  m_deviceReady = false;
+  m_deviceConnected = false;
+  m_rx.frames.reset();
+  resetProtocolState();
+  failBlobs("Link lost");
+  dropQueuedFrames();
 }
 
+void BLERFComm::setDeviceCache(std::shared_ptr<DeviceCache> cache) {
+  m_comm->setDeviceCache(std::move(cache));
+}
+
+BLEComm* BLERFComm::comm() const { return m_comm; }
+
+std::shared_ptr<LinkMetrics> BLERFComm::metrics() const { return m_metrics; }
+
 void BLERFComm::setServiceUuid(QBluetoothUuid const& serviceUuid) {
   m_comm->setCommServiceUuid(serviceUuid);
 }
@@ -61,26 +300,861 @@ void BLERFComm::setCharUuid(QBluetoothUuid const& charUuid) {
   m_comm->setCommCharacteristicUuid(charUuid);
 }
 
+void BLERFComm::handleReady() {
+  m_deviceReady = true;
+  // striped segments are extended frames
+  m_localCapabilities.setFlag(
+      Striping, isExtendedFramingEnabled() && m_comm->bulkChannelCount() > 0);
+  if (m_localCapabilities != NoCapabilities) {
+    sendHello();
+  }
+  emit deviceReady();
+  // whatever was queued while reconnecting
+  submitQueuedFrames();
+}
+
 void BLERFComm::handleRx(QByteArray const& data) {
-  if (data.length() == 0) {
+  // one clock read per notification; frames starting in it are timed from
+  // its arrival
+  qint64 const now = m_clock.nsecsElapsed();
+  if (m_reliableRx) {
+    receiveReliable(data.constData(), data.size(), now);
+  } else {
+    feedFrames(m_rx, data.constData(), data.size(), now);
+  }
+}
+
+void BLERFComm::handleBulkRx(int channel, QByteArray const& data) {
+  qint64 const now = m_clock.nsecsElapsed();
+  if (channel >= static_cast<int>(m_bulkRx.size())) {
+    m_bulkRx.resize(static_cast<std::size_t>(channel) + 1);
+  }
+  auto& packets = m_bulkRx[static_cast<std::size_t>(channel)];
+
+  char const* next = data.constData();
+  int remaining = data.size();
+  while (remaining > 0) {
+    int const used = packets.feed(next, remaining);
+    next += used;
+    remaining -= used;
+
+    if (packets.frameComplete()) {
+      if (packets.frameFlags() & RFCommProtocol::Striped) {
+        receiveStripe(packets.frameFlags(), packets.frame(), now);
+      } else {
+        m_metrics->add(LinkMetrics::UndecodableMessages);
+      }
+      if (!m_deviceConnected) {
+        return;
+      }
+    }
+  }
+}
+
+void BLERFComm::feedFrames(RxStream& stream, char const* next, int remaining,
+                           qint64 now) {
+  auto& frames = stream.frames;
+  if (frames.inProgress()) {
+    stream.frameNotifications++;
+  }
+
+  // a notification may end one frame, carry several and start another
+  while (remaining > 0) {
+    if (!frames.inProgress()) {
+      stream.frameStartNs = now;
+      stream.frameNotifications = 1;
+    }
+
+    int const used = frames.feed(next, remaining);
+    next += used;
+    remaining -= used;
+
+    if (frames.frameComplete()) {
+      if (&stream == &m_rx && !m_reliableRx && isReliableDeliveryEnabled() &&
+          (frames.frameFlags() & RFCommProtocol::ReliablePacket)) {
+        startReliableReceive(next, remaining, now);
+        return;
+      }
+
+      m_metrics->add(LinkMetrics::FramesReceived);
+      m_metrics->record(LinkMetrics::ReassemblyTime,
+                        (now - stream.frameStartNs) / 1000);
+      m_metrics->record(LinkMetrics::NotificationsPerFrame,
+                        stream.frameNotifications);
+      dispatchFrame(frames);
+      // a receiver might have disconnected us in the meantime
+      if (!m_deviceConnected) {
+        return;
+      }
+    }
+  }
+}
+
+void BLERFComm::startReliableReceive(char const* data, int size,
+                                     qint64 now) {
+  // The peer switched to reliable packets, everything from its first one on
+  // goes through the channel. The first one went through the assembler
+  // already, so it's put back together.
+  QByteArray packet{};
+  auto& frames = m_rx.frames;
+  RFCommProtocol::appendFrame(packet, frames.frame().constData(),
+                              frames.frame().size(), frames.frameFlags());
+  frames.reset();
+  m_reliableRx = true;
+
+  receiveReliable(packet.constData(), packet.size(), now);
+  if (size > 0 && m_deviceConnected) {
+    receiveReliable(data, size, now);
+  }
+}
+
+void BLERFComm::receiveReliable(char const* data, int size, qint64 now) {
+  m_reliable.receive(data, size, now / 1000000);
+
+  QByteArray segment{};
+  while (m_reliable.takeDelivered(segment)) {
+    feedFrames(m_rx, segment.constData(), segment.size(), now);
+    if (!m_deviceConnected) {
+      return;
+    }
+  }
+
+  auto const acked = m_reliable.takeAckedBytes();
+  if (acked > 0) {
+    m_tx.acknowledge(static_cast<int>(acked), true, MainTrack);
+  }
+  transmitPackets(m_reliable.takeRetransmissions(now / 1000000));
+
+  if (m_reliable.ackUrgency() == ReliableChannel::AckUrgency::Now) {
+    sendAck();
+  } else if (m_reliable.ackUrgency() == ReliableChannel::AckUrgency::Delayed &&
+             !m_ackTimer->isActive()) {
+    m_ackTimer->start(AckDelay);
+  }
+
+  submitQueuedFrames();
+  reportTransmitProgress();
+}
+
+void BLERFComm::handleDataWritten(int bytes) {
+  if (auto const done = plainBytesDone(bytes); done > 0) {
+    m_tx.acknowledge(static_cast<int>(done), true);
+  }
+  submitQueuedFrames();
+  reportTransmitProgress();
+}
+
+void BLERFComm::handleDataDropped(int bytes) {
+  // lost reliable packets are sent again, or dropped with the connection
+  if (auto const done = plainBytesDone(bytes); done > 0) {
+    m_tx.acknowledge(static_cast<int>(done), false);
+  }
+  submitQueuedFrames();
+  reportTransmitProgress();
+}
+
+void BLERFComm::receiveStripe(quint8 flags, QByteArray const& packet,
+                              qint64 now) {
+  if (packet.size() < RFCommProtocol::StripedHeaderSize) {
+    m_metrics->add(LinkMetrics::UndecodableMessages);
+    return;
+  }
+
+  auto const seq = static_cast<quint16>(static_cast<quint8>(packet[0]) |
+                                        (static_cast<quint8>(packet[1]) << 8));
+  auto const ahead = static_cast<quint16>(seq - m_nextStripe);
+  bool const continued = flags & RFCommProtocol::StripeContinued;
+  if (ahead >= 0x8000) {
+    // from before a gap that was given up on
+    return;
+  }
+  if (ahead > 0) {
+    m_stripesAhead.insert(
+        seq, Stripe{continued, packet.mid(RFCommProtocol::StripedHeaderSize)});
+    if (m_stripesAhead.size() > MaxStripesAhead) {
+      skipStripeGap();
+    } else if (!m_stripeGapTimer->isActive()) {
+      m_stripeGapTimer->start(StripeGapTimeout);
+    }
+    return;
+  }
+
+  deliverStripe(continued,
+                packet.constData() + RFCommProtocol::StripedHeaderSize,
+                packet.size() - RFCommProtocol::StripedHeaderSize, now);
+  deliverStripesAhead(now);
+}
+
+void BLERFComm::deliverStripe(bool continued, char const* data, int size,
+                              qint64 now) {
+  m_nextStripe++;
+  if (m_stripeResync) {
+    if (continued) {
+      // rest of a frame whose start was lost
+      return;
+    }
+    m_stripeResync = false;
+  }
+  feedFrames(m_stripedRx, data, size, now);
+}
+
+void BLERFComm::deliverStripesAhead(qint64 now) {
+  while (m_deviceConnected) {
+    auto const it = m_stripesAhead.find(m_nextStripe);
+    if (it == m_stripesAhead.end()) {
+      break;
+    }
+    auto const stripe = it.value();
+    m_stripesAhead.erase(it);
+    deliverStripe(stripe.continued, stripe.segment.constData(),
+                  stripe.segment.size(), now);
+  }
+
+  if (m_stripesAhead.isEmpty()) {
+    m_stripeGapTimer->stop();
+  } else if (!m_stripeGapTimer->isActive()) {
+    m_stripeGapTimer->start(StripeGapTimeout);
+  }
+}
+
+void BLERFComm::skipStripeGap() {
+  if (m_stripesAhead.isEmpty()) {
     return;
   }
 
-  if (!rxInProgress()) {
-    // casting to prevent getting negative length (not sure if can even happen)
-    m_expectedBytes = static_cast<std::uint8_t>(data[0]);
-    m_rxBuffer = data.mid(1);
-    m_expectedBytes -= m_rxBuffer.size();
+  // the missing segments were dropped with their write, and so is the frame
+  // they were part of - the stream picks up at the next frame boundary
+  quint16 skipped{0xFFFF};
+  for (auto it = m_stripesAhead.cbegin(); it != m_stripesAhead.cend(); ++it) {
+    skipped = std::min(skipped, static_cast<quint16>(it.key() - m_nextStripe));
+  }
+  m_metrics->add(LinkMetrics::SkippedStripes, skipped);
+  m_nextStripe += skipped;
+  m_stripedRx.frames.reset();
+  m_stripeResync = true;
+  deliverStripesAhead(m_clock.nsecsElapsed());
+}
+
+void BLERFComm::handleBulkDataWritten(int channel, int bytes) {
+  finishStripes(channel, bytes, true);
+}
+
+void BLERFComm::handleBulkDataDropped(int channel, int bytes) {
+  finishStripes(channel, bytes, false);
+}
+
+void BLERFComm::handleRetransmitTimeout() {
+  if (!m_reliableTx) {
+    return;
+  }
+
+  transmitPackets(
+      m_reliable.takeRetransmissions(m_clock.nsecsElapsed() / 1000000));
+}
+
+void BLERFComm::sendAck() {
+  m_ackTimer->stop();
+  if (m_reliableRx && m_deviceReady &&
+      m_reliable.ackUrgency() != ReliableChannel::AckUrgency::None) {
+    m_comm->transmitData(m_reliable.makeAck());
+  }
+}
+
+bool BLERFComm::rxInProgress() const { return m_rx.frames.inProgress(); }
+
+QByteArray BLERFComm::encodeMessage(QByteArray const& data) {
+  if (data.size() < MinCompressedSize || !isCompressionActive()) {
+    return RFCommProtocol::encodeFrame(data);
+  }
+
+  // compressed into the frame right away, which is only kept if it's
+  // shorter than the plain one
+  int const plainSize =
+      RFCommProtocol::headerSize(data.size(), RFCommProtocol::NoFlags) +
+      data.size();
+  int const header =
+      RFCommProtocol::ExtendedHeaderSize + RFCommProtocol::CompressedHeaderSize;
+  QByteArray frame{plainSize - 1, Qt::Uninitialized};
+  int const size =
+      LzCodec::compress(data.constData(), data.size(), frame.data() + header,
+                        frame.size() - header);
+  if (size < 0) {
+    return RFCommProtocol::encodeFrame(data);
+  }
+
+  frame.resize(header + size);
+  RFCommProtocol::writeExtendedHeader(
+      frame.data(), RFCommProtocol::CompressedHeaderSize + size,
+      RFCommProtocol::Compressed);
+  frame[RFCommProtocol::ExtendedHeaderSize] =
+      static_cast<char>(data.size() & 0xFF);
+  frame[RFCommProtocol::ExtendedHeaderSize + 1] =
+      static_cast<char>((data.size() >> 8) & 0xFF);
+
+  m_metrics->add(LinkMetrics::CompressedMessages);
+  m_metrics->add(LinkMetrics::CompressionSavedBytes,
+                 static_cast<quint64>(plainSize - frame.size()));
+  return frame;
+}
+
+void BLERFComm::dispatchFrame(FrameAssembler const& frames) {
+  auto const flags = frames.frameFlags();
+  if (flags & RFCommProtocol::ControlFrame) {
+    handleControlFrame(frames.frame());
+  } else if (flags & RFCommProtocol::Striped) {
+    // only valid on the bulk characteristics
+    m_metrics->add(LinkMetrics::UndecodableMessages);
+  } else if (flags & RFCommProtocol::Compressed) {
+    dispatchCompressed(frames.frame());
   } else {
-    m_rxBuffer.append(data);
-    m_expectedBytes -= data.size();
+    emit dataReceived(frames.frame());
+  }
+}
+
+void BLERFComm::dispatchCompressed(QByteArray const& frame) {
+  if (frame.size() < RFCommProtocol::CompressedHeaderSize) {
+    m_metrics->add(LinkMetrics::UndecodableMessages);
+    return;
+  }
+
+  int const size = static_cast<quint8>(frame[0]) |
+                   (static_cast<quint8>(frame[1]) << 8);
+  if (!m_inflated.isDetached()) {
+    // somebody kept the previous message - leave it to them
+    m_inflated = QByteArray{};
+  }
+  m_inflated.resize(size);
+  if (!LzCodec::decompress(
+          frame.constData() + RFCommProtocol::CompressedHeaderSize,
+          frame.size() - RFCommProtocol::CompressedHeaderSize,
+          m_inflated.data(), size)) {
+    m_metrics->add(LinkMetrics::UndecodableMessages);
+    return;
+  }
+  emit dataReceived(m_inflated);
+}
+
+void BLERFComm::sendHello() {
+  auto const capabilities = static_cast<quint16>(m_localCapabilities);
+  char const hello[]{
+      static_cast<char>(RFCommProtocol::ControlType::Hello),
+      static_cast<char>(RFCommProtocol::ProtocolVersion),
+      static_cast<char>(capabilities & 0xFF),
+      static_cast<char>((capabilities >> 8) & 0xFF),
+  };
+
+  QByteArray frame{};
+  RFCommProtocol::appendFrame(frame, hello, int{sizeof(hello)},
+                              RFCommProtocol::ControlFrame);
+  m_tx.push(frame, Priority::High, 0);
+  m_helloSent = true;
+  submitQueuedFrames();
+}
+
+void BLERFComm::handleControlFrame(QByteArray const& frame) {
+  if (frame.isEmpty()) {
+    return;
+  }
+
+  switch (static_cast<RFCommProtocol::ControlType>(frame[0])) {
+    case RFCommProtocol::ControlType::Hello:
+      handleHello(frame);
+      break;
+    case RFCommProtocol::ControlType::BlobStart:
+    case RFCommProtocol::ControlType::BlobData:
+    case RFCommProtocol::ControlType::BlobEnd:
+    case RFCommProtocol::ControlType::BlobAbort:
+      handleBlobFrame(frame);
+      break;
+  }
+}
+
+void BLERFComm::handleHello(QByteArray const& frame) {
+  if (frame.size() < 4) {
+    return;
+  }
+
+  auto const previousMaximum = maximumMessageSize();
+  m_peerCapabilities = Capabilities{QFlag{
+      static_cast<quint8>(frame[2]) | (static_cast<quint8>(frame[3]) << 8)}};
+
+  // the peer started the negotiation, let it know what we support
+  if (!m_helloSent) {
+    sendHello();
+  }
+  updateReliableMode();
+  updateStripingMode();
+
+  emit protocolNegotiated(negotiatedCapabilities());
+  if (maximumMessageSize() != previousMaximum) {
+    emit maximumMessageSizeChanged(maximumMessageSize());
+  }
+}
+
+void BLERFComm::handleBlobFrame(QByteArray const& frame) {
+  if (frame.size() < 2) {
+    return;
+  }
+  auto const type = static_cast<RFCommProtocol::ControlType>(frame[0]);
+  auto const id = static_cast<quint8>(frame[1]);
+  char const* fields = frame.constData() + 2;
+  auto* incoming = m_incomingBlobs.value(id, nullptr);
+
+  switch (type) {
+    case RFCommProtocol::ControlType::BlobStart: {
+      if (frame.size() < 10) {
+        return;
+      }
+      if (incoming != nullptr) {
+        incoming->fail("Restarted by the device");
+      }
+
+      auto const total = read32(fields + 4);
+      auto* transfer = new BlobTransfer{
+          this, BlobTransfer::Direction::Incoming, id,
+          QString::fromUtf8(frame.constData() + 10, frame.size() - 10), this};
+      m_incomingBlobs.insert(id, transfer);
+      transfer->handleStart(read32(fields),
+                            total == RFCommProtocol::UnknownBlobSize
+                                ? BlobTransfer::UnknownSize
+                                : total);
+      emit incomingBlob(transfer);
+      if (transfer->isRunning() && transfer->m_device == nullptr) {
+        transfer->sendAbort();
+        transfer->fail("Nobody took the blob");
+      }
+      break;
+    }
+    case RFCommProtocol::ControlType::BlobData:
+      if (incoming != nullptr && frame.size() >= 6) {
+        incoming->handleData(read32(fields), frame.constData() + 6,
+                             frame.size() - 6);
+      }
+      break;
+    case RFCommProtocol::ControlType::BlobEnd:
+      if (incoming != nullptr && frame.size() >= 6) {
+        incoming->handleEnd(read32(fields));
+      }
+      break;
+    case RFCommProtocol::ControlType::BlobAbort: {
+      if (frame.size() < 3) {
+        return;
+      }
+      // the origin is from the sender's point of view: 0 is its own blob
+      auto* transfer = frame[2] == 0 ? incoming
+                                     : m_outgoingBlobs.value(id, nullptr);
+      if (transfer != nullptr) {
+        transfer->fail("Aborted by the device");
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+void BLERFComm::startBlob(BlobTransfer* transfer, QIODevice* source,
+                          qint64 offset) {
+  if (transfer->m_error.isEmpty()) {
+    // ids of finished transfers come around again after 256 blobs
+    auto id = m_nextBlobId;
+    for (int i = 0; i < 256 && m_outgoingBlobs.contains(id); i++) {
+      id++;
+    }
+    m_nextBlobId = id + 1;
+    transfer->m_id = id;
+
+    if (m_outgoingBlobs.contains(id)) {
+      transfer->m_error = "Too many blobs in flight";
+    } else if (!negotiatedCapabilities().testFlag(ExtendedLength)) {
+      transfer->m_error = "The device doesn't support blob transfers";
+    } else {
+      m_outgoingBlobs.insert(id, transfer);
+      if (transfer->start(source, offset)) {
+        return;
+      }
+    }
+  }
+
+  // failed once the caller had a chance to connect to the transfer
+  QTimer::singleShot(0, transfer,
+                     [transfer]() { transfer->fail(transfer->m_error); });
+}
+
+quint64 BLERFComm::queueFrame(QByteArray const& frame, Priority priority) {
+  if (!m_deviceReady && !m_comm->isReconnecting()) {
+    m_metrics->add(LinkMetrics::MessagesRejected);
+    return 0;
+  }
+
+  auto const id = m_nextMessageId++;
+  if (!m_tx.push(frame, priority, id)) {
+    m_metrics->add(LinkMetrics::MessagesRejected);
+    return 0;
+  }
+  m_metrics->add(LinkMetrics::MessagesQueued);
+
+  submitQueuedFrames();
+  reportTransmitProgress();
+  return id;
+}
+
+int BLERFComm::blobChunkSize() const {
+  // a chunk frame fills a write
+  auto size = std::max(m_comm->mtu() - BLETransport::AttHeaderSize,
+                       BlobTransfer::MinChunkFrameSize) -
+              RFCommProtocol::ExtendedHeaderSize -
+              RFCommProtocol::BlobDataHeaderSize;
+  if (m_reliableTx) {
+    size -= RFCommProtocol::ReliableOverhead;
+  } else if (m_stripingTx) {
+    size -= RFCommProtocol::StripedOverhead;
+  }
+  return size;
+}
+
+void BLERFComm::releaseBlob(BlobTransfer* transfer) {
+  auto& blobs = transfer->direction() == BlobTransfer::Direction::Outgoing
+                    ? m_outgoingBlobs
+                    : m_incomingBlobs;
+  if (blobs.value(transfer->m_id, nullptr) == transfer) {
+    blobs.remove(transfer->m_id);
+  }
+}
+
+void BLERFComm::failBlobs(QString const& reason) {
+  // failing a transfer releases it
+  auto const transfers = m_outgoingBlobs.values() + m_incomingBlobs.values();
+  for (auto* transfer : transfers) {
+    transfer->fail(reason);
+  }
+}
+
+void BLERFComm::resetProtocolState() {
+  auto const previousMaximum = maximumMessageSize();
+  m_peerCapabilities = NoCapabilities;
+  m_helloSent = false;
+
+  // whatever the peer didn't ack is lost with the connection
+  if (m_reliableTx && m_tx.inFlightBytes(MainTrack) > 0) {
+    m_tx.acknowledge(static_cast<int>(m_tx.inFlightBytes(MainTrack)), false,
+                     MainTrack);
+    reportTransmitProgress();
+  }
+  // and the packets and acks still waiting in BLEComm would reach the next
+  // connection with stale sequence numbers
+  if (m_reliableTx || m_reliableRx) {
+    m_comm->discardPendingData();
+  }
+  m_reliable.reset();
+  m_reliableRx = false;
+  m_reliableTx = false;
+  m_plainBytesInFlight = 0;
+  m_txSegment.clear();
+  m_retransmitTimer->stop();
+  m_ackTimer->stop();
+
+  // and so is whatever was striped, written or not
+  if (m_tx.inFlightBytes(BulkTrack) > 0) {
+    m_tx.acknowledge(static_cast<int>(m_tx.inFlightBytes(BulkTrack)), false,
+                     BulkTrack);
+    reportTransmitProgress();
+  }
+  m_stripingTx = false;
+  m_stripeRest.clear();
+  m_stripesSent = 0;
+  m_stripesInFlight.clear();
+  m_bulkTxStripes.clear();
+  m_bulkRx.clear();
+  m_stripedRx.frames.reset();
+  m_stripesAhead.clear();
+  m_nextStripe = 0;
+  m_stripeResync = false;
+  m_stripeGapTimer->stop();
+
+  if (maximumMessageSize() != previousMaximum) {
+    emit maximumMessageSizeChanged(maximumMessageSize());
+  }
+}
+
+void BLERFComm::updateReliableMode() {
+  if (m_reliableTx || m_stripingTx ||
+      !negotiatedCapabilities().testFlag(ReliableDelivery)) {
+    return;
+  }
+
+  // frames handed to the link so far still complete when written
+  m_reliableTx = true;
+  m_plainBytesInFlight = m_tx.inFlightBytes(MainTrack);
+  submitQueuedFrames();
+}
+
+void BLERFComm::updateStripingMode() {
+  if (m_stripingTx || m_reliableTx ||
+      !negotiatedCapabilities().testFlag(Striping) ||
+      m_comm->bulkChannelCount() == 0) {
+    return;
+  }
+
+  m_stripingTx = true;
+  m_bulkTxStripes.assign(
+      static_cast<std::size_t>(m_comm->bulkChannelCount()), {});
+  submitQueuedFrames();
+}
+
+void BLERFComm::submitQueuedFrames() {
+  if (!m_deviceReady) {
+    return;
+  }
+  if (m_reliableTx) {
+    submitReliablePackets();
+    return;
+  }
+  if (m_stripingTx) {
+    submitStripes();
+    return;
+  }
+
+  // Keep just enough in BLEComm to saturate the writes in flight, so that
+  // high priority messages queued later can still overtake the rest.
+  int const writeSize = m_comm->mtu() - BLETransport::AttHeaderSize;
+  qint64 const budget = 2 * m_comm->maxWritesInFlight() * writeSize;
+  while (m_tx.hasQueued() &&
+         (m_tx.inFlightBytes() == 0 || m_tx.inFlightBytes() < budget)) {
+    if (!m_coalescingEnabled) {
+      m_comm->transmitData(m_tx.takeNext());
+      continue;
+    }
+
+    if (holdBackForCoalescing(writeSize)) {
+      return;
+    }
+    m_comm->transmitData(m_tx.takeBatch(writeSize));
+  }
+
+  if (!m_tx.hasQueued()) {
+    m_flushRequested = false;
+    m_coalesceTimer->stop();
+  }
+}
+
+void BLERFComm::submitReliablePackets() {
+  // One packet per write, unless writes are so short that the packet
+  // overhead would eat most of them.
+  int const writeSize = m_comm->mtu() - BLETransport::AttHeaderSize;
+  int const segmentSize =
+      std::clamp(writeSize - RFCommProtocol::ReliableOverhead,
+                 ReliableChannel::MinSegmentSize,
+                 ReliableChannel::MaxSegmentSize);
+  qint64 const now = m_clock.nsecsElapsed() / 1000000;
+
+  while (m_reliable.canSend() && (!m_txSegment.isEmpty() || m_tx.hasQueued())) {
+    if (m_txSegment.isEmpty()) {
+      if (m_coalescingEnabled && holdBackForCoalescing(segmentSize)) {
+        break;
+      }
+      // packing frames costs nothing here, they're a stream anyway
+      m_txSegment = m_tx.takeBatch(segmentSize);
+    }
+
+    auto const segment = m_txSegment.size() > segmentSize
+                             ? m_txSegment.left(segmentSize)
+                             : m_txSegment;
+    m_txSegment.remove(0, segment.size());
+    m_comm->transmitData(m_reliable.wrap(segment, now));
+  }
+
+  if (!m_tx.hasQueued()) {
+    m_flushRequested = false;
+    m_coalesceTimer->stop();
+  }
+  // every packet carries the ack
+  if (m_reliable.ackUrgency() == ReliableChannel::AckUrgency::None) {
+    m_ackTimer->stop();
+  }
+  scheduleRetransmit();
+}
+
+void BLERFComm::submitStripes() {
+  int const writeSize = m_comm->mtu() - BLETransport::AttHeaderSize;
+  qint64 const budget = 2 * m_comm->maxWritesInFlight() * writeSize;
+
+  // the main characteristic is left to what must not wait behind bulk data
+  while (m_tx.hasQueued(Priority::High) &&
+         m_tx.inFlightBytes(MainTrack) < budget) {
+    m_comm->transmitData(m_tx.takeNext(Priority::High, MainTrack));
+  }
+
+  // one segment per write, on whichever channel has the least to write
+  int const segmentSize = writeSize - RFCommProtocol::StripedOverhead;
+  while (!m_stripeRest.isEmpty() || m_tx.hasQueued(Priority::Normal)) {
+    int const channel = idlestBulkChannel(budget);
+    if (channel < 0) {
+      break;
+    }
+
+    bool continued = true;
+    if (m_stripeRest.isEmpty()) {
+      if (m_coalescingEnabled && holdBackForCoalescing(segmentSize)) {
+        break;
+      }
+      m_stripeRest = m_tx.takeBatch(segmentSize, Priority::Normal, BulkTrack);
+      continued = false;
+    }
+    sendStripe(channel, continued, segmentSize);
+  }
+
+  if (!m_tx.hasQueued()) {
+    m_flushRequested = false;
+    m_coalesceTimer->stop();
+  }
+}
+
+int BLERFComm::idlestBulkChannel(qint64 budget) const {
+  int idlest = -1;
+  qint64 least = budget;
+  for (int channel = 0; channel < static_cast<int>(m_bulkTxStripes.size());
+       channel++) {
+    auto const pending = m_comm->pendingBulkBytes(channel);
+    if (pending < least) {
+      least = pending;
+      idlest = channel;
+    }
+  }
+  return idlest;
+}
+
+void BLERFComm::sendStripe(int channel, bool continued, int segmentSize) {
+  int const size = std::min(segmentSize, m_stripeRest.size());
+  QByteArray packet{RFCommProtocol::StripedOverhead + size, Qt::Uninitialized};
+  RFCommProtocol::writeExtendedHeader(
+      packet.data(), RFCommProtocol::StripedHeaderSize + size,
+      static_cast<quint8>(RFCommProtocol::Striped |
+                          (continued ? RFCommProtocol::StripeContinued : 0)));
+  auto const seq = static_cast<quint16>(m_stripesSent);
+  packet[RFCommProtocol::ExtendedHeaderSize] = static_cast<char>(seq & 0xFF);
+  packet[RFCommProtocol::ExtendedHeaderSize + 1] =
+      static_cast<char>((seq >> 8) & 0xFF);
+  std::copy_n(m_stripeRest.constData(), size,
+              packet.data() + RFCommProtocol::StripedOverhead);
+  m_stripeRest.remove(0, size);
+
+  m_stripesInFlight.push_back(StripeInFlight{size, packet.size(), true});
+  m_bulkTxStripes[static_cast<std::size_t>(channel)].push_back(m_stripesSent);
+  m_stripesSent++;
+  m_comm->transmitBulkData(channel, packet);
+}
+
+void BLERFComm::finishStripes(int channel, int bytes, bool delivered) {
+  if (channel < 0 || channel >= static_cast<int>(m_bulkTxStripes.size())) {
+    return;
+  }
+
+  auto& stripes = m_bulkTxStripes[static_cast<std::size_t>(channel)];
+  auto const first = m_stripesSent - m_stripesInFlight.size();
+  while (bytes > 0 && !stripes.empty()) {
+    auto& stripe = m_stripesInFlight[stripes.front() - first];
+    int const done = std::min(bytes, stripe.unwrittenBytes);
+    stripe.unwrittenBytes -= done;
+    stripe.delivered = stripe.delivered && delivered;
+    bytes -= done;
+    if (stripe.unwrittenBytes == 0) {
+      stripes.pop_front();
+    }
+  }
+
+  // the queue completes frames in the order they were taken, so segments
+  // written ahead of an earlier one wait for it
+  while (!m_stripesInFlight.empty() &&
+         m_stripesInFlight.front().unwrittenBytes == 0) {
+    auto const& stripe = m_stripesInFlight.front();
+    m_tx.acknowledge(stripe.segmentBytes, stripe.delivered, BulkTrack);
+    m_stripesInFlight.pop_front();
+  }
+
+  submitQueuedFrames();
+  reportTransmitProgress();
+}
+
+bool BLERFComm::holdBackForCoalescing(int writeSize) {
+  int const threshold = m_coalescingThreshold > 0
+                            ? std::min(m_coalescingThreshold, writeSize)
+                            : writeSize;
+  if (m_flushRequested || m_tx.hasHighPriority() ||
+      m_tx.waitingBytes() >= threshold) {
+    return false;
+  }
+
+  if (!m_coalesceTimer->isActive()) {
+    m_coalesceTimer->start(m_coalescingDelay);
+  }
+  return true;
+}
+
+void BLERFComm::transmitPackets(std::vector<QByteArray> const& packets) {
+  for (auto const& packet : packets) {
+    m_comm->transmitData(packet);
   }
 
-  m_rxInProgress = m_expectedBytes > 0;
+  if (m_reliable.failed()) {
+    emit connectionError(BLETransport::ConnectonError,
+                         "The device stopped acknowledging data");
+    m_comm->disconnectFromDevice();
+    return;
+  }
+  scheduleRetransmit();
+}
 
-  if (!rxInProgress()) {
-    emit dataReceived(m_rxBuffer);
+void BLERFComm::scheduleRetransmit() {
+  auto const due = m_reliable.nextTimeout();
+  if (due < 0) {
+    m_retransmitTimer->stop();
+    return;
   }
+
+  qint64 const now = m_clock.nsecsElapsed() / 1000000;
+  m_retransmitTimer->start(static_cast<int>(std::max<qint64>(due - now, 0)));
 }
 
-bool BLERFComm::rxInProgress() const { return m_rxInProgress; }
+qint64 BLERFComm::plainBytesDone(int bytes) {
+  if (!m_reliableTx) {
+    return bytes;
+  }
+
+  auto const done = std::min<qint64>(bytes, m_plainBytesInFlight);
+  m_plainBytesInFlight -= done;
+  return done;
+}
+
+void BLERFComm::dropQueuedFrames() {
+  m_tx.clear();
+  m_txSegment.clear();
+  m_stripeRest.clear();
+  m_stripesInFlight.clear();
+  for (auto& stripes : m_bulkTxStripes) {
+    stripes.clear();
+  }
+  m_flushRequested = false;
+  m_coalesceTimer->stop();
+  reportTransmitProgress();
+}
+
+void BLERFComm::reportTransmitProgress() {
+  TransmitQueue::Completion completion{};
+  while (m_tx.popCompletion(completion)) {
+    // id 0 is protocol traffic
+    if (completion.id != 0) {
+      m_metrics->add(completion.delivered ? LinkMetrics::MessagesSent
+                                          : LinkMetrics::MessagesDropped);
+    }
+    if (completion.delivered) {
+      emit messageSent(completion.id);
+    } else {
+      emit messageDropped(completion.id);
+    }
+  }
+
+  if (m_tx.updateCongestion()) {
+    emit congestionChanged(m_tx.congested());
+  }
+}
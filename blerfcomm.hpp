@@ -2,28 +2,140 @@
 
 #include <QBluetoothUuid>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QIODevice>
+#include <QList>
 #include <QObject>
+#include <QTimer>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "blecomm.hpp"
+#include "blobtransfer.hpp"
+#include "frameassembler.hpp"
+#include "messageschema.hpp"
+#include "reliablechannel.hpp"
+#include "rfcommprotocol.hpp"
+#include "transmitqueue.hpp"
 
 class BLERFComm : public QObject
 {
   Q_OBJECT
+  friend class BlobTransfer;
 
   Q_PROPERTY(QBluetoothUuid serviceUuid READ serviceUuid WRITE setServiceUuid
                  NOTIFY serviceUuidChanged)
   Q_PROPERTY(QBluetoothUuid charUuid READ charUuid WRITE setCharUuid NOTIFY
                  charUuidChanged)
 
+ public:
+  // Optional protocol features, announced to the peer in a Hello control
+  // frame once the device is ready. A feature is only used when both sides
+  // announced it.
+  enum Capability {
+    NoCapabilities = 0x0000,
+    ExtendedLength = 0x0001,
+    ReliableDelivery = 0x0002,
+    Compression = 0x0004,
+    Striping = 0x0008
+  };
+  Q_DECLARE_FLAGS(Capabilities, Capability)
+  Q_FLAG(Capabilities)
+
+  using Priority = TransmitQueue::Priority;
+
+  // how long the receiver may hold back an ack in reliable mode (ms)
+  static constexpr int AckDelay{5};
+  // shorter messages are never worth compressing
+  static constexpr int MinCompressedSize{16};
+  // how long a striped segment that arrived early waits for the missing
+  // ones (ms), and how many of them may wait
+  static constexpr int StripeGapTimeout{200};
+  static constexpr int MaxStripesAhead{64};
+
+ private:
+  // A frame stream being reassembled, with the arrival of the frame in
+  // progress and the notifications it spans so far.
+  struct RxStream {
+    FrameAssembler frames{};
+    qint64 frameStartNs{0};
+    quint64 frameNotifications{0};
+  };
+
+  struct Stripe {
+    bool continued;
+    QByteArray segment;
+  };
+
+  struct StripeInFlight {
+    int segmentBytes;
+    int unwrittenBytes;
+    bool delivered;
+  };
+
   BLEComm* m_comm{nullptr};
 
-  QByteArray m_rxBuffer{};
-  int m_expectedBytes{0};
-  bool m_rxInProgress{false};
+  RxStream m_rx{};
+  TransmitQueue m_tx{};
+  std::shared_ptr<LinkMetrics> m_metrics{};
+  QElapsedTimer m_clock{};
+  quint64 m_nextMessageId{1};
 
   bool m_deviceReady{false};
   bool m_deviceConnected{false};
 
+  Capabilities m_localCapabilities{NoCapabilities};
+  Capabilities m_peerCapabilities{NoCapabilities};
+  bool m_helloSent{false};
+
+  ReliableChannel m_reliable{};
+  // the peer's frames come in reliable packets / ours go out in them
+  bool m_reliableRx{false};
+  bool m_reliableTx{false};
+  // frame bytes written in plain frames before switching to reliable ones
+  qint64 m_plainBytesInFlight{0};
+  // rest of the frames taken from m_tx that didn't fit the last packet
+  QByteArray m_txSegment{};
+  QTimer* m_retransmitTimer{nullptr};
+  QTimer* m_ackTimer{nullptr};
+
+  // normal priority frames go out striped over the bulk channels
+  bool m_stripingTx{false};
+  // rest of the frames taken from m_tx that didn't fit the last segment
+  QByteArray m_stripeRest{};
+  // numbers the segments, the low 16 bits are their sequence number
+  quint64 m_stripesSent{0};
+  // in sequence order, up to the last one sent
+  std::deque<StripeInFlight> m_stripesInFlight{};
+  // segment numbers being written, per bulk channel
+  std::vector<std::deque<quint64>> m_bulkTxStripes{};
+  // packets of each bulk channel, the segments put back in order and those
+  // that arrived ahead of a missing one
+  std::vector<FrameAssembler> m_bulkRx{};
+  RxStream m_stripedRx{};
+  QHash<quint16, Stripe> m_stripesAhead{};
+  quint16 m_nextStripe{0};
+  // after a gap, segments are skipped up to the next frame boundary
+  bool m_stripeResync{false};
+  QTimer* m_stripeGapTimer{nullptr};
+
+  // decompressed message, reused like the receive buffer
+  QByteArray m_inflated{};
+
+  // by transfer id; ids are only unique per direction
+  QHash<quint8, BlobTransfer*> m_outgoingBlobs{};
+  QHash<quint8, BlobTransfer*> m_incomingBlobs{};
+  quint8 m_nextBlobId{0};
+
+  QTimer* m_coalesceTimer{nullptr};
+  bool m_coalescingEnabled{false};
+  int m_coalescingDelay{5};
+  int m_coalescingThreshold{0};
+  bool m_flushRequested{false};
+
  public:
   explicit BLERFComm(QObject* parent = nullptr);
 
@@ -32,18 +144,123 @@ class BLERFComm : public QObject
   bool isDeviceConnected() const;
   bool isDeviceReady() const;
 
+  // Extended framing lifts the message size limit from 254 bytes to 64 KiB.
+  // Only enable it for peers that understand control frames - legacy peers
+  // would take the Hello frame for a regular message.
+  void setExtendedFramingEnabled(bool enabled);
+  bool isExtendedFramingEnabled() const;
+  Capabilities negotiatedCapabilities() const;
+  int maximumMessageSize() const;
+
+  // Reliable delivery carries all frames in sequenced, checksummed packets
+  // that are acked and sent again when lost or corrupted, so writes without
+  // response can be used at full rate without losing data. Like extended
+  // framing, it needs a peer that supports it and is only used once both
+  // sides announced it; switching it off takes effect with the next
+  // connection. Messages count as sent once the peer acked them.
+  void setReliableDeliveryEnabled(bool enabled);
+  bool isReliableDeliveryEnabled() const;
+  bool isReliableDeliveryActive() const;
+
+  // Compression sends messages LZ4 compressed when that makes their frame
+  // shorter, and as they are otherwise, so incompressible messages cost
+  // nothing but the attempt. Negotiated like reliable delivery; received
+  // messages come out decompressed either way.
+  void setCompressionEnabled(bool enabled);
+  bool isCompressionEnabled() const;
+  bool isCompressionActive() const;
+
+  // Striping spreads normal priority messages over bulk characteristics of
+  // the service next to the main one, so that their writes don't queue up
+  // behind each other - stacks limit the packets per characteristic and
+  // connection event. The stream is cut into numbered segments that the peer
+  // puts back in order; the main characteristic is left to control frames
+  // and high priority messages. Offered along with extended framing whenever
+  // the device has at least one of the characteristics (set before
+  // connecting) and used once the peer announced it too, but not together
+  // with reliable delivery, which takes precedence.
+  void setBulkCharUuids(QList<QBluetoothUuid> const& charUuids);
+  QList<QBluetoothUuid> bulkCharUuids() const;
+  bool isStripingActive() const;
+
+  // Bounds of the transmit queue; sendData rejects messages beyond them.
+  // Congestion is signalled between the high and low water marks (bytes).
+  void setTransmitQueueLimits(int maxMessages, qint64 maxBytes);
+  void setBackpressureThresholds(qint64 highWaterBytes, qint64 lowWaterBytes);
+  int queuedMessages() const;
+  qint64 queuedBytes() const;
+  bool isCongested() const;
+
+  // With coalescing enabled, short messages wait until enough of them fill a
+  // write (threshold bytes, 0 meaning MTU - 3) or the delay (ms) expires and
+  // then go out packed together. High priority messages are never held back.
+  void setCoalescingEnabled(bool enabled);
+  void setCoalescingDelay(int milliseconds);
+  void setCoalescingThreshold(int bytes);
+  bool isCoalescingEnabled() const;
+  int coalescingDelay() const;
+  int coalescingThreshold() const;
+
+  // Streams a blob from the source, starting at the offset, to resume a
+  // transfer that failed. Needs extended framing on both sides. The chunks
+  // share the transmit queue with other messages at normal priority. The
+  // transfer is returned even if it can't start - it fails right away then.
+  BlobTransfer* sendBlob(QIODevice* source, QString const& name = {},
+                         qint64 offset = 0);
+  BlobTransfer* sendFile(QString const& path, qint64 offset = 0);
+
+  // Typed messages, see MessageSchema. send is sendData for a message that
+  // is encoded right into its frame - or into a buffer for the compressor
+  // first, when compression is active.
+  template <typename Msg>
+  quint64 send(Msg const& message, Priority priority = Priority::Normal);
+  // Calls handler(Msg const&) for every received message with the id of
+  // Msg, decoded in place from the receive buffer - Bytes fields point into
+  // it and are only valid during the call. Messages with the id that don't
+  // decode count as undecodable_messages. Disconnect the returned connection
+  // or destroy the context to stop.
+  template <typename Msg, typename Handler>
+  QMetaObject::Connection onMessage(QObject* context, Handler handler);
+
+  void setTransport(BLETransport* transport);
+  void setDeviceCache(std::shared_ptr<DeviceCache> cache);
+  BLEComm* comm() const;
+  std::shared_ptr<LinkMetrics> metrics() const;
+
  signals:
+  // The frame shares its memory with the receive buffer - copying it is
+  // cheap, but keeping it around forces the next frame into a fresh buffer.
   void dataReceived(QByteArray const& data);
   void connectedToDevice();
   void deviceReady();
+  void timeToReady(qint64 connectMs, qint64 serviceDiscoveryMs,
+                   qint64 characteristicDiscoveryMs, bool fromCache);
+  void stateChanged(BLEComm::State state);
+  void reconnecting(int attempt, int delayMs);
+  void reconnectFailed();
   void disconnectedFromDevice();
   void connectionError(BLEComm::Error error, QString const& description);
+  void protocolNegotiated(BLERFComm::Capabilities capabilities);
+  void maximumMessageSizeChanged(int maximumMessageSize);
+  void messageSent(quint64 messageId);
+  void messageDropped(quint64 messageId);
+  void congestionChanged(bool congested);
+  // The peer started sending a blob. Connect with Qt::DirectConnection and
+  // give the transfer a sink with saveTo or writeTo, or the blob is refused.
+  void incomingBlob(BlobTransfer* transfer);
 
   void serviceUuidChanged(QBluetoothUuid const& serviceUuid);
   void charUuidChanged(QBluetoothUuid const& charUuid);
 
  public slots:
-  void sendData(QByteArray const& data);
+  // Queues a message and returns its id, used by messageSent and
+  // messageDropped, or 0 if the message can't be sent (device not ready,
+  // message too long or queue full). While reconnecting, messages are queued
+  // until the device is ready again.
+  quint64 sendData(QByteArray const& data,
+                   BLERFComm::Priority priority = Priority::Normal);
+  // Sends everything held back by coalescing right away.
+  void flush();
   void connectToDevice(QBluetoothDeviceInfo const& device);
   void disconnectFromDevice();
 
@@ -51,8 +268,89 @@ class BLERFComm : public QObject
   void setCharUuid(QBluetoothUuid const& charUuid);
 
  private slots:
+  void handleReady();
   void handleRx(QByteArray const& data);
+  void handleDataWritten(int bytes);
+  void handleDataDropped(int bytes);
+  void handleBulkRx(int channel, QByteArray const& data);
+  void handleBulkDataWritten(int channel, int bytes);
+  void handleBulkDataDropped(int channel, int bytes);
+  void skipStripeGap();
+  void handleRetransmitTimeout();
+  void sendAck();
 
  private:
   bool rxInProgress() const;
+  void feedFrames(RxStream& stream, char const* data, int size, qint64 now);
+  void startReliableReceive(char const* data, int size, qint64 now);
+  void receiveReliable(char const* data, int size, qint64 now);
+  void receiveStripe(quint8 flags, QByteArray const& packet, qint64 now);
+  void deliverStripe(bool continued, char const* data, int size, qint64 now);
+  void deliverStripesAhead(qint64 now);
+  void updateReliableMode();
+  void updateStripingMode();
+  void submitReliablePackets();
+  void submitStripes();
+  int idlestBulkChannel(qint64 budget) const;
+  void sendStripe(int channel, bool continued, int segmentSize);
+  void finishStripes(int channel, int bytes, bool delivered);
+  bool holdBackForCoalescing(int writeSize);
+  void transmitPackets(std::vector<QByteArray> const& packets);
+  void scheduleRetransmit();
+  qint64 plainBytesDone(int bytes);
+  QByteArray encodeMessage(QByteArray const& data);
+  void dispatchFrame(FrameAssembler const& frames);
+  void dispatchCompressed(QByteArray const& frame);
+  void sendHello();
+  void handleControlFrame(QByteArray const& frame);
+  void handleHello(QByteArray const& frame);
+  void handleBlobFrame(QByteArray const& frame);
+  void startBlob(BlobTransfer* transfer, QIODevice* source, qint64 offset);
+  quint64 queueFrame(QByteArray const& frame,
+                     Priority priority = Priority::Normal);
+  int blobChunkSize() const;
+  void releaseBlob(BlobTransfer* transfer);
+  void failBlobs(QString const& reason);
+  void resetProtocolState();
+  void submitQueuedFrames();
+  void dropQueuedFrames();
+  void reportTransmitProgress();
 };
+
+template <typename Msg>
+quint64 BLERFComm::send(Msg const& message, Priority priority) {
+  int const size = MessageSchema::encodedSize(message);
+  if (size > maximumMessageSize()) {
+    m_metrics->add(LinkMetrics::MessagesRejected);
+    return 0;
+  }
+  if (size >= MinCompressedSize && isCompressionActive()) {
+    return queueFrame(encodeMessage(MessageSchema::encode(message)), priority);
+  }
+
+  int const header = RFCommProtocol::headerSize(size, RFCommProtocol::NoFlags);
+  QByteArray frame{header + size, Qt::Uninitialized};
+  RFCommProtocol::writeHeader(frame.data(), size, RFCommProtocol::NoFlags);
+  MessageSchema::encode(message, frame.data() + header);
+  return queueFrame(frame, priority);
+}
+
+template <typename Msg, typename Handler>
+QMetaObject::Connection BLERFComm::onMessage(QObject* context,
+                                             Handler handler) {
+  return QObject::connect(
+      this, &BLERFComm::dataReceived, context,
+      [this, handler = std::move(handler)](QByteArray const& data) mutable {
+        if (!MessageSchema::matches<Msg>(data.constData(), data.size())) {
+          return;
+        }
+        Msg message{};
+        if (!MessageSchema::decode(data.constData(), data.size(), message)) {
+          m_metrics->add(LinkMetrics::UndecodableMessages);
+          return;
+        }
+        handler(std::as_const(message));
+      });
+}
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(BLERFComm::Capabilities)
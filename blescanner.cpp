@@ -5,10 +5,17 @@
 BLEScanner::BLEScanner(QObject *parent) : QObject(parent)
 {
   m_agent = new QBluetoothDeviceDiscoveryAgent{this};
-  m_agent->setLowEnergyDiscoveryTimeout(5000);
+  m_agent->setLowEnergyDiscoveryTimeout(DefaultScanTimeout);
 
-  QObject::connect(m_agent, &QBluetoothDeviceDiscoveryAgent::canceled, this,
-                   &BLEScanner::scanCancelled);
+  QObject::connect(m_agent, &QBluetoothDeviceDiscoveryAgent::canceled, [&]() {
+    // stopping on the first match is a success, not a cancellation
+    if (m_stoppedOnMatch) {
+      m_stoppedOnMatch = false;
+      emit scanCompleted(devicesFound());
+    } else {
+      emit scanCancelled();
+    }
+  });
 
   // wtf who with the sane mind put a signal and method with the same name in
   // this fucking class
@@ -25,46 +32,61 @@ BLEScanner::BLEScanner(QObject *parent) : QObject(parent)
 
   QObject::connect(m_agent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered,
                    this, &BLEScanner::handleDeviceDiscovered);
+  QObject::connect(m_agent, &QBluetoothDeviceDiscoveryAgent::deviceUpdated,
+                   this, &BLEScanner::handleDeviceUpdated);
 }
 
 void BLEScanner::scan(BLEScanner::ScanType type) {
-  m_devices.clear();
+  m_filter.reset();
+  m_agent->setLowEnergyDiscoveryTimeout(DefaultScanTimeout);
   switch (type) {
     case ScanType::LowEnergy:
-      m_agent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
+      startScan(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
       break;
     case ScanType::Normal:
-      m_agent->start(QBluetoothDeviceDiscoveryAgent::ClassicMethod);
+      startScan(QBluetoothDeviceDiscoveryAgent::ClassicMethod);
       break;
   }
 }
 
+void BLEScanner::scanFor(Filter const &filter, int timeoutMs) {
+  m_filter = filter;
+  m_agent->setLowEnergyDiscoveryTimeout(timeoutMs);
+  startScan(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
+}
+
+void BLEScanner::stop() {
+  if (isBusy()) {
+    m_agent->stop();
+  }
+}
+
+void BLEScanner::addKnownDevice(const QBluetoothDeviceInfo &device) {
+  if (indexOf(device) < 0) {
+    m_devices.append(device);
+    indexDevice(m_devices.size() - 1);
+    emit deviceDiscovered(m_devices.size() - 1);
+  }
+}
+
 auto BLEScanner::isBusy() -> bool {
   return (m_agent != nullptr && m_agent->isActive());
 }
 
 auto BLEScanner::getDeviceByName(const QString &name)
     -> QBluetoothDeviceInfo * {
-  auto found_it =
-      std::find_if(m_devices.begin(), m_devices.end(),
-                   [&](auto device) { return device.name() == name; });
-
-  if (found_it != m_devices.end()) {
-    return found_it;
-  }
-  return nullptr;
+  auto const index = m_indexByName.value(name, -1);
+  return index >= 0 ? &m_devices[index] : nullptr;
 }
 
 auto BLEScanner::getDeviceByAddress(const QBluetoothAddress &address)
     -> QBluetoothDeviceInfo * {
-  auto found_it =
-      std::find_if(m_devices.begin(), m_devices.end(),
-                   [&](auto device) { return device.address() == address; });
+  auto const index = indexOf(address);
+  return index >= 0 ? &m_devices[index] : nullptr;
+}
 
-  if (found_it != m_devices.end()) {
-    return found_it;
-  }
-  return nullptr;
+auto BLEScanner::indexOf(const QBluetoothAddress &address) const -> int {
+  return m_indexByAddress.value(address.toUInt64(), -1);
 }
 
 auto BLEScanner::devicesFound() const -> DeviceList::size_type {
@@ -74,5 +96,95 @@ auto BLEScanner::devicesFound() const -> DeviceList::size_type {
 auto BLEScanner::deviceList() const -> DeviceList const & { return m_devices; }
 
 void BLEScanner::handleDeviceDiscovered(const QBluetoothDeviceInfo &device) {
+  // some backends report every advertisement as a new discovery
+  auto const index = indexOf(device);
+  if (index >= 0) {
+    updateDevice(index, device);
+    emit deviceUpdated(index);
+    return;
+  }
+
+  // a device that didn't match yet may still do so once its scan response
+  // (with the name, for example) comes in
+  if (m_filter && !m_filter->matches(device)) {
+    return;
+  }
+
   m_devices.append(device);
+  indexDevice(m_devices.size() - 1);
+  emit deviceDiscovered(m_devices.size() - 1);
+
+  if (m_filter && m_filter->stopOnFirstMatch && isBusy()) {
+    m_stoppedOnMatch = true;
+    m_agent->stop();
+  }
+}
+
+void BLEScanner::handleDeviceUpdated(const QBluetoothDeviceInfo &device) {
+  // the agent reports the whole device, RSSI and manufacturer data included
+  handleDeviceDiscovered(device);
+}
+
+void BLEScanner::startScan(
+    QBluetoothDeviceDiscoveryAgent::DiscoveryMethods methods) {
+  m_devices.clear();
+  m_indexByAddress.clear();
+  m_indexByUuid.clear();
+  m_indexByName.clear();
+  m_stoppedOnMatch = false;
+  emit devicesCleared();
+
+  m_agent->start(methods);
+}
+
+auto BLEScanner::indexOf(const QBluetoothDeviceInfo &device) const -> int {
+  if (device.address().isNull()) {
+    return m_indexByUuid.value(device.deviceUuid(), -1);
+  }
+  return indexOf(device.address());
+}
+
+void BLEScanner::updateDevice(int index, const QBluetoothDeviceInfo &device) {
+  auto &stored = m_devices[index];
+  if (stored.name() != device.name() &&
+      m_indexByName.value(stored.name(), -1) == index) {
+    m_indexByName.remove(stored.name());
+  }
+
+  stored = device;
+  indexDevice(index);
+}
+
+void BLEScanner::indexDevice(int index) {
+  auto const &device = m_devices.at(index);
+  if (device.address().isNull()) {
+    m_indexByUuid.insert(device.deviceUuid(), index);
+  } else {
+    m_indexByAddress.insert(device.address().toUInt64(), index);
+  }
+  // names aren't unique, the first device wins
+  if (!device.name().isEmpty() && !m_indexByName.contains(device.name())) {
+    m_indexByName.insert(device.name(), index);
+  }
+}
+
+auto BLEScanner::Filter::matches(const QBluetoothDeviceInfo &device) const
+    -> bool {
+  if (!address.isNull() && device.address() != address) {
+    return false;
+  }
+  if (minimumRssi && device.rssi() < *minimumRssi) {
+    return false;
+  }
+  if (!namePattern.pattern().isEmpty() &&
+      !namePattern.match(device.name()).hasMatch()) {
+    return false;
+  }
+  if (!serviceUuids.isEmpty()) {
+    auto const advertised = device.serviceUuids();
+    return std::any_of(
+        serviceUuids.cbegin(), serviceUuids.cend(),
+        [&](QBluetoothUuid const &uuid) { return advertised.contains(uuid); });
+  }
+  return true;
 }
@@ -3,9 +3,18 @@
 #include <QBluetoothAddress>
 #include <QBluetoothDeviceDiscoveryAgent>
 #include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QRegularExpression>
+#include <QString>
 #include <QVector>
+#include <optional>
 
+// Devices found by the last scan, in the order they were discovered. Every
+// device has a single entry that is updated in place as new advertisements
+// come in, and can be looked up by address or name in constant time.
 class BLEScanner : public QObject
 {
   Q_OBJECT
@@ -13,19 +22,47 @@ class BLEScanner : public QObject
   using DeviceList = QVector<QBluetoothDeviceInfo>;
   enum class ScanType { Normal, LowEnergy };
 
+  // Criteria a device has to meet to be collected by a targeted scan. Unset
+  // criteria match everything.
+  struct Filter {
+    // at least one of these has to be advertised
+    QList<QBluetoothUuid> serviceUuids{};
+    QRegularExpression namePattern{};
+    QBluetoothAddress address{};
+    std::optional<qint16> minimumRssi{};
+    // ends the scan (successfully) with the first match
+    bool stopOnFirstMatch{false};
+
+    auto matches(QBluetoothDeviceInfo const& device) const -> bool;
+  };
+
+  static constexpr int DefaultScanTimeout{5000};
+
   explicit BLEScanner(QObject* parent = nullptr);
 
   void scan(ScanType type = ScanType::LowEnergy);
+  // LE scan that only collects devices matching the filter.
+  void scanFor(Filter const& filter, int timeoutMs = DefaultScanTimeout);
+  void stop();
+  // Adds a device known from elsewhere (like the device cache) to the list,
+  // as if it had been discovered.
+  void addKnownDevice(QBluetoothDeviceInfo const& device);
   auto isBusy() -> bool;
 
   auto getDeviceByName(QString const& name) -> QBluetoothDeviceInfo*;
   auto getDeviceByAddress(QBluetoothAddress const& address)
       -> QBluetoothDeviceInfo*;
 
+  auto indexOf(QBluetoothAddress const& address) const -> int;
+
   auto devicesFound() const -> DeviceList::size_type;
   auto deviceList() const -> DeviceList const&;
 
  signals:
+  // Indices are positions in deviceList and stay valid until the next scan.
+  void deviceDiscovered(int index);
+  void deviceUpdated(int index);
+  void devicesCleared();
   void scanCancelled();
   void scanCompleted(int devicesFound);
   void scanError(QBluetoothDeviceDiscoveryAgent::Error error_code,
@@ -33,8 +70,21 @@ class BLEScanner : public QObject
 
  private slots:
   void handleDeviceDiscovered(QBluetoothDeviceInfo const& device);
+  void handleDeviceUpdated(QBluetoothDeviceInfo const& device);
 
  private:
+  auto indexOf(QBluetoothDeviceInfo const& device) const -> int;
+  void updateDevice(int index, QBluetoothDeviceInfo const& device);
+  void indexDevice(int index);
+
+  void startScan(QBluetoothDeviceDiscoveryAgent::DiscoveryMethods methods);
+
   DeviceList m_devices{};
+  std::optional<Filter> m_filter{};
+  bool m_stoppedOnMatch{false};
+  // platforms that hide addresses (macOS, iOS) identify devices by UUID
+  QHash<quint64, int> m_indexByAddress{};
+  QHash<QBluetoothUuid, int> m_indexByUuid{};
+  QHash<QString, int> m_indexByName{};
   QBluetoothDeviceDiscoveryAgent* m_agent{nullptr};
 };
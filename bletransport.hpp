@@ -0,0 +1,101 @@
+#pragma once
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QList>
+#include <QLowEnergyConnectionParameters>
+#include <QObject>
+#include <QString>
+#include <memory>
+
+class DeviceCache;
+
+// Link-level GATT access used by BLEComm. The real implementation talks to a
+// QLowEnergyController (see GattTransport), others can simulate a peripheral
+// in-process, so everything above this class can run without a radio.
+class BLETransport : public QObject
+{
+  Q_OBJECT
+
+ public:
+  enum Error {
+    NoError,
+    ConnectonError,
+    ServiceError,
+    CharacteristicError,
+    UnknownError
+  };
+  // also makes it usable in queued connections across threads
+  Q_ENUM(Error)
+
+  enum class WriteMode { WithResponse, WithoutResponse };
+
+  // ATT opcode and attribute handle take 3 bytes of every packet
+  static constexpr int AttHeaderSize{3};
+  static constexpr int DefaultMtu{23};
+
+  explicit BLETransport(QObject* parent = nullptr) : QObject{parent} {}
+
+  virtual void connectToDevice(QBluetoothDeviceInfo const& device,
+                               QBluetoothUuid const& serviceUuid,
+                               QBluetoothUuid const& charUuid) = 0;
+  // Emits disconnectedFromDevice if the link was up.
+  virtual void disconnectFromDevice() = 0;
+
+  // Writes a single chunk, which must fit in (mtu() - AttHeaderSize) bytes
+  // when written without response. Every write ends with either dataWritten
+  // or writeFailed.
+  virtual void write(QByteArray const& data, WriteMode mode) = 0;
+
+  virtual auto connected() const -> bool = 0;
+  virtual auto ready() const -> bool = 0;
+  virtual auto remoteName() const -> QString = 0;
+  virtual auto remoteAddress() const -> QBluetoothAddress = 0;
+  virtual auto mtu() const -> int = 0;
+  virtual auto supportsWriteWithoutResponse() const -> bool = 0;
+
+  // Further characteristics of the service for bulk data, next to the main
+  // one, used from the next connectToDevice on. Those the device has become
+  // bulk channels 0 to bulkChannelCount() - 1, in the order given.
+  // Transports that know one characteristic only ignore them.
+  virtual void setBulkCharacteristics(
+      QList<QBluetoothUuid> const& /*charUuids*/) {}
+  virtual auto bulkChannelCount() const -> int { return 0; }
+  // write() on a bulk channel, ending with bulkDataWritten or
+  // bulkWriteFailed. Only called for channels below bulkChannelCount().
+  virtual void writeBulk(int /*channel*/, QByteArray const& /*data*/,
+                         WriteMode /*mode*/) {}
+
+  // Transports that have to discover the device can use the cache to skip
+  // part of it and record what they found.
+  virtual void setDeviceCache(std::shared_ptr<DeviceCache> /*cache*/) {}
+  // Whether the current connection was set up from cached device details.
+  virtual auto connectedFromCache() const -> bool { return false; }
+
+  // Asks for new connection parameters, which the peripheral or the stack
+  // may adjust or refuse; connectionUpdated reports what was applied.
+  // Returns false if the transport has no say in them.
+  virtual auto requestConnectionUpdate(
+      QLowEnergyConnectionParameters const& /*parameters*/) -> bool {
+    return false;
+  }
+
+ signals:
+  void connectedToDevice();
+  // The service has been found, its characteristics are discovered next.
+  // Optional, only used to time the connection phases.
+  void serviceDiscovered();
+  void disconnectedFromDevice();
+  void connectionError(BLETransport::Error errorType,
+                       QString const& description);
+  void commsReady();
+  void dataReceived(QByteArray const& data);
+  void dataWritten(int bytes);
+  void writeFailed();
+  void mtuChanged(int mtu);
+  void connectionUpdated(QLowEnergyConnectionParameters const& parameters);
+  void bulkDataReceived(int channel, QByteArray const& data);
+  void bulkDataWritten(int channel, int bytes);
+  void bulkWriteFailed(int channel);
+};
@@ -0,0 +1,362 @@
+#include "blobtransfer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "blerfcomm.hpp"
+#include "rfcommprotocol.hpp"
+
+namespace {
+void write32(char* data, quint32 value) {
+  for (int i = 0; i < 4; i++) {
+    data[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+}
+
+auto controlFrame(RFCommProtocol::ControlType type, quint8 id,
+                  QByteArray const& fields = {}) -> QByteArray {
+  QByteArray payload{};
+  payload.reserve(2 + fields.size());
+  payload.append(static_cast<char>(type));
+  payload.append(static_cast<char>(id));
+  payload.append(fields);
+  return RFCommProtocol::encodeFrame(payload, RFCommProtocol::ControlFrame);
+}
+
+auto field32(qint64 value) -> QByteArray {
+  QByteArray bytes{4, Qt::Uninitialized};
+  write32(bytes.data(), static_cast<quint32>(value));
+  return bytes;
+}
+}  // namespace
+
+BlobTransfer::BlobTransfer(BLERFComm* comm, Direction direction, quint8 id,
+                           QString const& name, QObject* parent)
+    : QObject{parent},
+      m_comm{comm},
+      m_direction{direction},
+      m_id{id},
+      m_name{name} {
+  m_clock.start();
+}
+
+auto BlobTransfer::direction() const -> Direction { return m_direction; }
+
+auto BlobTransfer::name() const -> QString { return m_name; }
+
+auto BlobTransfer::totalBytes() const -> qint64 { return m_totalBytes; }
+
+auto BlobTransfer::startOffset() const -> qint64 { return m_startOffset; }
+
+auto BlobTransfer::bytesTransferred() const -> qint64 { return m_transferred; }
+
+auto BlobTransfer::elapsedMs() const -> qint64 { return m_clock.elapsed(); }
+
+auto BlobTransfer::throughput() const -> double {
+  auto const elapsed = m_clock.nsecsElapsed();
+  if (elapsed <= 0) {
+    return 0.0;
+  }
+  return static_cast<double>(m_transferred - m_startOffset) * 1e9 /
+         static_cast<double>(elapsed);
+}
+
+auto BlobTransfer::isRunning() const -> bool { return m_running; }
+
+auto BlobTransfer::errorString() const -> QString { return m_error; }
+
+auto BlobTransfer::saveTo(QString const& path) -> bool {
+  if (m_direction != Direction::Incoming || m_device || !m_running) {
+    return false;
+  }
+
+  auto file = std::make_unique<QFile>(path);
+  if (m_startOffset > 0) {
+    // keep what arrived before, drop anything past the resume point
+    if (!file->open(QIODevice::ReadWrite)) {
+      m_error = file->errorString();
+      return false;
+    }
+    if (file->size() < m_startOffset || !file->resize(m_startOffset) ||
+        !file->seek(m_startOffset)) {
+      m_error = QString("Cannot resume %1 at byte %2, it has %3")
+                    .arg(path)
+                    .arg(m_startOffset)
+                    .arg(file->size());
+      return false;
+    }
+  } else if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    m_error = file->errorString();
+    return false;
+  }
+
+  m_file = std::move(file);
+  m_device = m_file.get();
+  return true;
+}
+
+auto BlobTransfer::writeTo(QIODevice* sink) -> bool {
+  if (m_direction != Direction::Incoming || m_device || !m_running ||
+      sink == nullptr || !sink->isWritable()) {
+    return false;
+  }
+  m_device = sink;
+  return true;
+}
+
+void BlobTransfer::abort() {
+  if (!m_running) {
+    return;
+  }
+  sendAbort();
+  fail("Aborted");
+}
+
+auto BlobTransfer::start(QIODevice* source, qint64 offset) -> bool {
+  m_device = source;
+  if (source == nullptr || !source->isReadable()) {
+    m_error = "The blob can't be read";
+    return false;
+  }
+
+  if (!source->isSequential()) {
+    m_totalBytes = source->size();
+    if (m_totalBytes >= RFCommProtocol::UnknownBlobSize) {
+      m_error = "The blob is too large";
+      return false;
+    }
+    if (offset > m_totalBytes || !source->seek(offset)) {
+      m_error = QString("Cannot start at byte %1").arg(offset);
+      return false;
+    }
+  } else if (offset >= qint64{RFCommProtocol::UnknownBlobSize} ||
+             (offset > 0 && source->skip(offset) != offset)) {
+    m_error = QString("Cannot start at byte %1").arg(offset);
+    return false;
+  }
+
+  // no read calls and no intermediate buffer, the chunks are copied from
+  // the mapping right into their frames
+  if (m_file && m_totalBytes > 0) {
+    m_mapped = m_file->map(0, m_totalBytes);
+    m_mappedSize = m_mapped != nullptr ? m_totalBytes : 0;
+  }
+
+  m_startOffset = offset;
+  m_readOffset = offset;
+  m_transferred = offset;
+
+  auto const total = m_totalBytes == UnknownSize
+                         ? qint64{RFCommProtocol::UnknownBlobSize}
+                         : m_totalBytes;
+  if (m_comm->queueFrame(
+          controlFrame(RFCommProtocol::ControlType::BlobStart, m_id,
+                       field32(offset) + field32(total) + m_name.toUtf8())) ==
+      0) {
+    m_error = "The device isn't ready or the transmit queue is full";
+    return false;
+  }
+
+  QObject::connect(m_comm, &BLERFComm::messageSent, this,
+                   &BlobTransfer::handleMessageSent);
+  QObject::connect(m_comm, &BLERFComm::messageDropped, this,
+                   &BlobTransfer::handleMessageDropped);
+  if (source->isSequential()) {
+    QObject::connect(source, &QIODevice::readyRead, this,
+                     &BlobTransfer::pump);
+    auto const sourceFinished = [this]() {
+      m_sourceFinished = true;
+      pump();
+    };
+    QObject::connect(source, &QIODevice::readChannelFinished, this,
+                     sourceFinished);
+    QObject::connect(source, &QIODevice::aboutToClose, this, sourceFinished);
+  }
+
+  m_clock.start();
+  pump();
+  return true;
+}
+
+void BlobTransfer::pump() {
+  if (!m_running) {
+    return;
+  }
+
+  int const chunkSize = m_comm->blobChunkSize();
+  int const header =
+      RFCommProtocol::ExtendedHeaderSize + RFCommProtocol::BlobDataHeaderSize;
+  while (!m_sourceDone &&
+         static_cast<int>(m_chunks.size()) < ChunksInFlight) {
+    if (m_pendingFrame.isEmpty()) {
+      // read straight into the frame that carries the chunk
+      QByteArray frame{header + chunkSize, Qt::Uninitialized};
+      int const size = readChunk(frame.data() + header, chunkSize);
+      bool const sequential = m_device && m_device->isSequential();
+      bool const ended =
+          sequential && (m_sourceFinished || !m_device->isOpen());
+      // a sequential source that finished or was closed can't be read
+      // anymore, like a socket that disconnected - otherwise it's an error
+      if (size < 0 && !ended) {
+        sendAbort();
+        fail(QString("Cannot read the blob: %1")
+                 .arg(m_device ? m_device->errorString() : "source gone"));
+        return;
+      }
+      if (size <= 0) {
+        if (sequential && !ended) {
+          // nothing there yet, readyRead picks it up
+          return;
+        }
+        m_sourceDone = true;
+        break;
+      }
+      // offsets are 32 bit on the wire, sequential sources aren't checked
+      // up front
+      if (m_readOffset + size >= qint64{RFCommProtocol::UnknownBlobSize}) {
+        sendAbort();
+        fail("The blob is too large");
+        return;
+      }
+
+      frame.resize(header + size);
+      char* payload = frame.data() + RFCommProtocol::ExtendedHeaderSize;
+      RFCommProtocol::writeExtendedHeader(
+          frame.data(), RFCommProtocol::BlobDataHeaderSize + size,
+          RFCommProtocol::ControlFrame);
+      payload[0] = static_cast<char>(RFCommProtocol::ControlType::BlobData);
+      payload[1] = static_cast<char>(m_id);
+      write32(payload + 2, static_cast<quint32>(m_readOffset));
+
+      m_readOffset += size;
+      m_pendingFrame = frame;
+    }
+
+    auto const messageId = m_comm->queueFrame(m_pendingFrame);
+    if (messageId == 0) {
+      // queue full - picked up again once a message has been sent
+      return;
+    }
+    m_chunks.push_back(Chunk{messageId, m_readOffset});
+    m_pendingFrame.clear();
+  }
+
+  if (m_sourceDone && m_endMessageId == 0) {
+    m_totalBytes = m_readOffset;
+    m_endMessageId = m_comm->queueFrame(controlFrame(
+        RFCommProtocol::ControlType::BlobEnd, m_id, field32(m_readOffset)));
+  }
+}
+
+auto BlobTransfer::readChunk(char* data, int maxSize) -> int {
+  if (m_mapped != nullptr) {
+    auto const size = static_cast<int>(
+        std::min<qint64>(maxSize, m_mappedSize - m_readOffset));
+    std::memcpy(data, m_mapped + m_readOffset, static_cast<size_t>(size));
+    return size;
+  }
+  if (!m_device) {
+    return -1;
+  }
+  return static_cast<int>(m_device->read(data, maxSize));
+}
+
+void BlobTransfer::handleMessageSent(quint64 messageId) {
+  if (!m_chunks.empty() && m_chunks.front().messageId == messageId) {
+    m_transferred = m_chunks.front().end;
+    m_chunks.pop_front();
+    emit progress(m_transferred, m_totalBytes);
+  } else if (messageId == m_endMessageId) {
+    finish();
+    return;
+  }
+
+  // there's room in the queue again, whoever's message it was
+  pump();
+}
+
+void BlobTransfer::handleMessageDropped(quint64 messageId) {
+  bool const ours =
+      messageId == m_endMessageId ||
+      std::any_of(m_chunks.begin(), m_chunks.end(), [&](Chunk const& chunk) {
+        return chunk.messageId == messageId;
+      });
+  if (ours) {
+    fail(QString("Interrupted at byte %1").arg(m_transferred));
+  }
+}
+
+void BlobTransfer::handleStart(qint64 offset, qint64 totalBytes) {
+  m_startOffset = offset;
+  m_transferred = offset;
+  m_totalBytes = totalBytes;
+  m_clock.start();
+}
+
+void BlobTransfer::handleData(qint64 offset, char const* data, int size) {
+  if (!m_running) {
+    return;
+  }
+  if (offset != m_transferred) {
+    sendAbort();
+    fail(QString("Got byte %1, expected %2").arg(offset).arg(m_transferred));
+    return;
+  }
+  if (!m_device || m_device->write(data, size) != size) {
+    sendAbort();
+    fail(QString("Cannot write the blob: %1")
+             .arg(m_device ? m_device->errorString() : "sink gone"));
+    return;
+  }
+
+  m_transferred += size;
+  emit progress(m_transferred, m_totalBytes);
+}
+
+void BlobTransfer::handleEnd(qint64 size) {
+  if (!m_running) {
+    return;
+  }
+  if (size != m_transferred) {
+    fail(QString("Ended at byte %1, got %2").arg(size).arg(m_transferred));
+    return;
+  }
+
+  m_totalBytes = size;
+  finish();
+}
+
+void BlobTransfer::sendAbort() {
+  // whose blob it is: 0 the one we send, 1 the one we receive
+  QByteArray origin{1, m_direction == Direction::Outgoing ? '\0' : '\1'};
+  m_comm->queueFrame(
+      controlFrame(RFCommProtocol::ControlType::BlobAbort, m_id, origin));
+}
+
+void BlobTransfer::finish() {
+  if (!m_running) {
+    return;
+  }
+  m_running = false;
+
+  m_chunks.clear();
+  m_file.reset();
+  m_comm->releaseBlob(this);
+  emit finished();
+  deleteLater();
+}
+
+void BlobTransfer::fail(QString const& reason) {
+  if (!m_running) {
+    return;
+  }
+  m_running = false;
+  m_error = reason;
+
+  // what got written so far stays, to be resumed
+  m_chunks.clear();
+  m_file.reset();
+  m_comm->releaseBlob(this);
+  emit failed(reason);
+  deleteLater();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QIODevice>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <deque>
+#include <memory>
+
+class BLERFComm;
+
+// A blob streamed over a BLERFComm link, in either direction, as a series of
+// chunk control frames - see README for the format. Outgoing blobs are read
+// from any QIODevice, or straight from a memory mapped file, a chunk at a
+// time right into the frame that carries it, and incoming ones are written
+// to their sink as the chunks arrive, so no blob is ever held in memory.
+//
+// Transfers are created by BLERFComm::sendBlob / sendFile and announced by
+// BLERFComm::incomingBlob, and delete themselves after finished or failed.
+// A failed transfer can be resumed from bytesTransferred() by sending the
+// blob again from that offset.
+class BlobTransfer : public QObject
+{
+  Q_OBJECT
+
+ public:
+  enum class Direction { Outgoing, Incoming };
+  Q_ENUM(Direction)
+
+  static constexpr qint64 UnknownSize{-1};
+  // chunks queued on the link at once - enough to keep it busy, few enough
+  // that other messages aren't stuck behind the blob for long
+  static constexpr int ChunksInFlight{8};
+  // chunk frames are a write long, but no shorter than this
+  static constexpr int MinChunkFrameSize{128};
+
+  auto direction() const -> Direction;
+  auto name() const -> QString;
+  // Size of the whole blob, UnknownSize until the end if the source is
+  // sequential.
+  auto totalBytes() const -> qint64;
+  auto startOffset() const -> qint64;
+  // Offset up to which the blob has been sent (and acked, with reliable
+  // delivery) or written to the sink.
+  auto bytesTransferred() const -> qint64;
+  auto elapsedMs() const -> qint64;
+  // bytes per second since the start
+  auto throughput() const -> double;
+  auto isRunning() const -> bool;
+  auto errorString() const -> QString;
+
+  // For incoming blobs, in a slot connected to BLERFComm::incomingBlob.
+  // Resumed blobs (startOffset() > 0) are appended to what the file already
+  // holds up to that offset.
+  auto saveTo(QString const& path) -> bool;
+  auto writeTo(QIODevice* sink) -> bool;
+
+ public slots:
+  // Stops the transfer on both sides.
+  void abort();
+
+ signals:
+  void progress(qint64 bytesTransferred, qint64 totalBytes);
+  void finished();
+  void failed(QString const& reason);
+
+ private:
+  friend class BLERFComm;
+
+  struct Chunk {
+    quint64 messageId;
+    // offset right after the chunk
+    qint64 end;
+  };
+
+  BlobTransfer(BLERFComm* comm, Direction direction, quint8 id,
+               QString const& name, QObject* parent = nullptr);
+
+  // outgoing
+  auto start(QIODevice* source, qint64 offset) -> bool;
+  void pump();
+  auto readChunk(char* data, int maxSize) -> int;
+  void handleMessageSent(quint64 messageId);
+  void handleMessageDropped(quint64 messageId);
+
+  // incoming
+  void handleStart(qint64 offset, qint64 totalBytes);
+  void handleData(qint64 offset, char const* data, int size);
+  void handleEnd(qint64 size);
+
+  void sendAbort();
+  void finish();
+  void fail(QString const& reason);
+
+  BLERFComm* m_comm{nullptr};
+  Direction m_direction{Direction::Outgoing};
+  quint8 m_id{0};
+  QString m_name{};
+  qint64 m_totalBytes{UnknownSize};
+  qint64 m_startOffset{0};
+  qint64 m_transferred{0};
+  QElapsedTimer m_clock{};
+  bool m_running{true};
+  QString m_error{};
+
+  QPointer<QIODevice> m_device{};
+  // when the transfer opened the file itself
+  std::unique_ptr<QFile> m_file{};
+  uchar* m_mapped{nullptr};
+  qint64 m_mappedSize{0};
+
+  // outgoing: read from the source, queued and not confirmed yet
+  qint64 m_readOffset{0};
+  std::deque<Chunk> m_chunks{};
+  QByteArray m_pendingFrame{};
+  bool m_sourceDone{false};
+  // a sequential source reached its end, nothing more will come in
+  bool m_sourceFinished{false};
+  quint64 m_endMessageId{0};
+};
@@ -0,0 +1,194 @@
+#include "capturefile.hpp"
+
+#include <QDateTime>
+#include <cstring>
+
+namespace {
+// longest LEB128 encoding of a 64 bit value
+constexpr int MaxVarintSize{10};
+// anything longer can't have come from the link
+constexpr quint64 MaxRecordSize{0xFFFF};
+}  // namespace
+
+CaptureWriter::CaptureWriter(QString const& path) : m_file{path} {}
+
+CaptureWriter::~CaptureWriter() { close(); }
+
+auto CaptureWriter::open() -> bool {
+  close();
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+
+  m_buffer.clear();
+  m_buffer.reserve(BufferSize);
+
+  m_buffer.append(CaptureFormat::Magic, CaptureFormat::MagicSize);
+  m_buffer.append(static_cast<char>(CaptureFormat::Version));
+  m_buffer.append('\0');
+  auto const startTime =
+      static_cast<quint64>(QDateTime::currentMSecsSinceEpoch());
+  for (int i = 0; i < 8; i++) {
+    m_buffer.append(static_cast<char>((startTime >> (8 * i)) & 0xFF));
+  }
+
+  m_clock.start();
+  m_lastUs = 0;
+  m_records = 0;
+  return flush();
+}
+
+auto CaptureWriter::isOpen() const -> bool { return m_file.isOpen(); }
+
+auto CaptureWriter::errorString() const -> QString {
+  return m_file.errorString();
+}
+
+void CaptureWriter::record(CaptureFormat::RecordType type, char const* data,
+                           int size) {
+  if (!isOpen()) {
+    return;
+  }
+
+  qint64 const now = m_clock.nsecsElapsed() / 1000;
+  m_buffer.append(static_cast<char>(type));
+  appendVarint(static_cast<quint64>(now - m_lastUs));
+  appendVarint(static_cast<quint64>(size));
+  m_buffer.append(data, size);
+  m_lastUs = now;
+  m_records++;
+
+  // the link dropping is a good moment to get everything on disk
+  if (m_buffer.size() >= BufferSize ||
+      type == CaptureFormat::RecordType::Disconnected) {
+    flush();
+  }
+}
+
+auto CaptureWriter::flush() -> bool {
+  if (!isOpen()) {
+    return false;
+  }
+
+  bool const written =
+      m_file.write(m_buffer) == m_buffer.size() && m_file.flush();
+  // resize() keeps the reserved capacity
+  m_buffer.resize(0);
+  return written;
+}
+
+void CaptureWriter::close() {
+  if (isOpen()) {
+    flush();
+    m_file.close();
+  }
+}
+
+auto CaptureWriter::records() const -> quint64 { return m_records; }
+
+void CaptureWriter::appendVarint(quint64 value) {
+  char bytes[MaxVarintSize];
+  int size{0};
+  do {
+    auto byte = static_cast<quint8>(value & 0x7F);
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    bytes[size++] = static_cast<char>(byte);
+  } while (value != 0);
+  m_buffer.append(bytes, size);
+}
+
+CaptureReader::CaptureReader(QString const& path) : m_file{path} {}
+
+auto CaptureReader::open() -> bool {
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    m_error = m_file.errorString();
+    return false;
+  }
+
+  auto const header = m_file.read(CaptureFormat::HeaderSize);
+  if (header.size() != CaptureFormat::HeaderSize ||
+      std::memcmp(header.constData(), CaptureFormat::Magic,
+                  CaptureFormat::MagicSize) != 0) {
+    m_error = "Not a capture file";
+    m_file.close();
+    return false;
+  }
+  if (static_cast<quint8>(header[CaptureFormat::MagicSize]) !=
+      CaptureFormat::Version) {
+    m_error = "Unsupported capture file version";
+    m_file.close();
+    return false;
+  }
+
+  quint64 startTime{0};
+  for (int i = 0; i < 8; i++) {
+    startTime |= static_cast<quint64>(static_cast<quint8>(
+                     header[CaptureFormat::MagicSize + 2 + i]))
+                 << (8 * i);
+  }
+  m_startTime = static_cast<qint64>(startTime);
+  m_timestampUs = 0;
+  m_corrupted = false;
+  return true;
+}
+
+auto CaptureReader::errorString() const -> QString { return m_error; }
+
+auto CaptureReader::startTime() const -> qint64 { return m_startTime; }
+
+auto CaptureReader::next(CaptureFormat::Record& record) -> bool {
+  char type{0};
+  if (!m_file.isOpen() || m_corrupted || !m_file.getChar(&type)) {
+    return false;
+  }
+
+  quint64 delta{0};
+  quint64 size{0};
+  if (!readVarint(delta) || !readVarint(size) || size > MaxRecordSize) {
+    m_corrupted = true;
+    return false;
+  }
+
+  record.type = static_cast<CaptureFormat::RecordType>(type);
+  record.data = m_file.read(static_cast<qint64>(size));
+  if (record.data.size() != static_cast<int>(size)) {
+    m_corrupted = true;
+    return false;
+  }
+
+  m_timestampUs += static_cast<qint64>(delta);
+  record.timestampUs = m_timestampUs;
+  return true;
+}
+
+auto CaptureReader::atEnd() const -> bool {
+  return !m_file.isOpen() || m_file.atEnd();
+}
+
+auto CaptureReader::corrupted() const -> bool { return m_corrupted; }
+
+void CaptureReader::restart() {
+  if (m_file.isOpen()) {
+    m_file.seek(CaptureFormat::HeaderSize);
+    m_timestampUs = 0;
+    m_corrupted = false;
+  }
+}
+
+auto CaptureReader::readVarint(quint64& value) -> bool {
+  value = 0;
+  for (int i = 0; i < MaxVarintSize; i++) {
+    char byte{0};
+    if (!m_file.getChar(&byte)) {
+      return false;
+    }
+    value |= static_cast<quint64>(static_cast<quint8>(byte) & 0x7F) << (7 * i);
+    if ((static_cast<quint8>(byte) & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
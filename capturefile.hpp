@@ -0,0 +1,112 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+
+// Binary capture of the raw traffic of one BLEComm, see README.
+//
+// Header: | "BRFCAP" | version | flags (0) | start time (ms since epoch,
+//         64 bit LE) |
+// Record: | type | time since the previous record (us, varint) |
+//         | payload length (varint) | payload |
+//
+// Varints are unsigned LEB128. Timestamps come from a monotonic clock, the
+// start time is only there for reference.
+namespace CaptureFormat {
+constexpr char Magic[]{'B', 'R', 'F', 'C', 'A', 'P'};
+constexpr int MagicSize{sizeof(Magic)};
+constexpr int HeaderSize{MagicSize + 2 + 8};
+constexpr quint8 Version{1};
+
+enum class RecordType : quint8 {
+  // one notification, exactly as received
+  Notification = 0x01,
+  // one ATT write, exactly as issued
+  Write = 0x02,
+  Connected = 0x03,
+  Disconnected = 0x04,
+  // payload is the new MTU, 16 bit LE
+  MtuChanged = 0x05,
+  // like Notification and Write, on a bulk channel; the payload starts with
+  // the channel number
+  BulkNotification = 0x06,
+  BulkWrite = 0x07,
+};
+
+struct Record {
+  RecordType type{RecordType::Notification};
+  // since the start of the capture
+  qint64 timestampUs{0};
+  QByteArray data{};
+};
+}  // namespace CaptureFormat
+
+// Appends records to a capture file through a buffer that's written out once
+// it fills up, on link loss and on close. Not synchronized - it belongs to
+// the thread of the BLEComm it records.
+class CaptureWriter
+{
+ public:
+  static constexpr int BufferSize{64 * 1024};
+
+  explicit CaptureWriter(QString const& path);
+  ~CaptureWriter();
+
+  CaptureWriter(CaptureWriter const&) = delete;
+  auto operator=(CaptureWriter const&) -> CaptureWriter& = delete;
+
+  // Truncates the file and writes the header.
+  auto open() -> bool;
+  auto isOpen() const -> bool;
+  auto errorString() const -> QString;
+
+  void record(CaptureFormat::RecordType type, char const* data = nullptr,
+              int size = 0);
+  void record(CaptureFormat::RecordType type, QByteArray const& data) {
+    record(type, data.constData(), data.size());
+  }
+  auto flush() -> bool;
+  void close();
+
+  auto records() const -> quint64;
+
+ private:
+  void appendVarint(quint64 value);
+
+  QFile m_file;
+  QByteArray m_buffer{};
+  QElapsedTimer m_clock{};
+  qint64 m_lastUs{0};
+  quint64 m_records{0};
+};
+
+// Reads a capture file record by record.
+class CaptureReader
+{
+ public:
+  explicit CaptureReader(QString const& path);
+
+  // Opens the file and checks the header.
+  auto open() -> bool;
+  auto errorString() const -> QString;
+  auto startTime() const -> qint64;
+
+  // False at the end of the file or when a record is cut short.
+  auto next(CaptureFormat::Record& record) -> bool;
+  auto atEnd() const -> bool;
+  // Whether reading stopped at a truncated or malformed record.
+  auto corrupted() const -> bool;
+  // Rewinds to the first record.
+  void restart();
+
+ private:
+  auto readVarint(quint64& value) -> bool;
+
+  QFile m_file;
+  QString m_error{};
+  qint64 m_startTime{0};
+  qint64 m_timestampUs{0};
+  bool m_corrupted{false};
+};
@@ -0,0 +1,196 @@
+#include "connectionpool.hpp"
+
+#include <algorithm>
+
+ConnectionPool::ConnectionPool(QObject* parent) : QObject{parent} {}
+
+void ConnectionPool::setServiceUuid(QBluetoothUuid const& serviceUuid) {
+  m_serviceUuid = serviceUuid;
+}
+
+void ConnectionPool::setCharUuid(QBluetoothUuid const& charUuid) {
+  m_charUuid = charUuid;
+}
+
+void ConnectionPool::setExtendedFramingEnabled(bool enabled) {
+  m_extendedFraming = enabled;
+}
+
+void ConnectionPool::setMaxConnections(int connections) {
+  m_maxConnections = std::max(connections, 1);
+}
+
+int ConnectionPool::maxConnections() const { return m_maxConnections; }
+
+void ConnectionPool::setTransportFactory(TransportFactory factory) {
+  m_transportFactory = std::move(factory);
+}
+
+BLERFComm* ConnectionPool::connectToDevice(QBluetoothDeviceInfo const& device) {
+  if (auto* comm = connection(device.address())) {
+    return comm;
+  }
+  if (m_connections.size() >= m_maxConnections) {
+    return nullptr;
+  }
+
+  auto* comm = createConnection(device);
+  m_connections.insert(device.address(), comm);
+  comm->connectToDevice(device);
+  return comm;
+}
+
+void ConnectionPool::disconnectFromDevice(QBluetoothAddress const& address) {
+  auto* comm = connection(address);
+  if (comm == nullptr) {
+    return;
+  }
+
+  // a connection that is still being set up never reports the disconnection,
+  // so don't wait for it
+  comm->disconnect(this);
+  comm->disconnectFromDevice();
+  releaseConnection(address);
+}
+
+void ConnectionPool::disconnectAll() {
+  for (auto const& address : addresses()) {
+    disconnectFromDevice(address);
+  }
+}
+
+BLERFComm* ConnectionPool::connection(QBluetoothAddress const& address) const {
+  return m_connections.value(address, nullptr);
+}
+
+QList<QBluetoothAddress> ConnectionPool::addresses() const {
+  return m_connections.keys();
+}
+
+int ConnectionPool::connectionCount() const { return m_connections.size(); }
+
+int ConnectionPool::readyCount() const {
+  return static_cast<int>(
+      std::count_if(m_connections.cbegin(), m_connections.cend(),
+                    [](BLERFComm* comm) { return comm->isDeviceReady(); }));
+}
+
+void ConnectionPool::addToGroup(QString const& group,
+                                QBluetoothAddress const& address) {
+  auto& members = m_groups[group];
+  if (!members.contains(address)) {
+    members.append(address);
+  }
+}
+
+void ConnectionPool::removeFromGroup(QString const& group,
+                                     QBluetoothAddress const& address) {
+  auto members = m_groups.find(group);
+  if (members == m_groups.end()) {
+    return;
+  }
+
+  members->removeAll(address);
+  if (members->isEmpty()) {
+    m_groups.erase(members);
+  }
+}
+
+void ConnectionPool::removeGroup(QString const& group) {
+  m_groups.remove(group);
+}
+
+QList<QBluetoothAddress> ConnectionPool::group(QString const& group) const {
+  return m_groups.value(group);
+}
+
+quint64 ConnectionPool::sendData(QBluetoothAddress const& address,
+                                 QByteArray const& data,
+                                 BLERFComm::Priority priority) {
+  auto* comm = connection(address);
+  if (comm == nullptr) {
+    return 0;
+  }
+  return comm->sendData(data, priority);
+}
+
+int ConnectionPool::sendToGroup(QString const& group, QByteArray const& data,
+                                BLERFComm::Priority priority) {
+  return sendToAll(m_groups.value(group), data, priority);
+}
+
+int ConnectionPool::broadcast(QByteArray const& data,
+                              BLERFComm::Priority priority) {
+  return sendToAll(addresses(), data, priority);
+}
+
+BLERFComm* ConnectionPool::createConnection(
+    QBluetoothDeviceInfo const& device) {
+  auto* comm = new BLERFComm{this};
+  if (m_transportFactory) {
+    comm->setTransport(m_transportFactory(device));
+  }
+  comm->setServiceUuid(m_serviceUuid);
+  comm->setCharUuid(m_charUuid);
+  comm->setExtendedFramingEnabled(m_extendedFraming);
+
+  auto const address = device.address();
+  QObject::connect(comm, &BLERFComm::connectedToDevice, this,
+                   [this, address]() { emit deviceConnected(address); });
+  QObject::connect(comm, &BLERFComm::deviceReady, this,
+                   [this, address]() { emit deviceReady(address); });
+  QObject::connect(comm, &BLERFComm::disconnectedFromDevice, this,
+                   [this, address]() { releaseConnection(address); });
+  QObject::connect(
+      comm, &BLERFComm::connectionError, this,
+      [this, comm, address](BLEComm::Error error, QString const& description) {
+        emit connectionError(address, error, description);
+        // failed attempts end without a disconnection
+        if (!comm->isDeviceConnected()) {
+          releaseConnection(address);
+        }
+      });
+  QObject::connect(comm, &BLERFComm::dataReceived, this,
+                   [this, address](QByteArray const& data) {
+                     emit dataReceived(address, data);
+                   });
+  QObject::connect(comm, &BLERFComm::messageSent, this,
+                   [this, address](quint64 messageId) {
+                     emit messageSent(address, messageId);
+                   });
+  QObject::connect(comm, &BLERFComm::messageDropped, this,
+                   [this, address](quint64 messageId) {
+                     emit messageDropped(address, messageId);
+                   });
+  QObject::connect(comm, &BLERFComm::congestionChanged, this,
+                   [this, address](bool congested) {
+                     emit congestionChanged(address, congested);
+                   });
+  return comm;
+}
+
+void ConnectionPool::releaseConnection(QBluetoothAddress const& address) {
+  auto* comm = m_connections.take(address);
+  if (comm == nullptr) {
+    return;
+  }
+
+  // we might be inside one of its signals
+  comm->disconnect(this);
+  comm->deleteLater();
+  emit deviceDisconnected(address);
+}
+
+int ConnectionPool::sendToAll(QList<QBluetoothAddress> const& addresses,
+                              QByteArray const& data,
+                              BLERFComm::Priority priority) {
+  int accepted{0};
+  for (auto const& address : addresses) {
+    auto* comm = connection(address);
+    if (comm != nullptr && comm->isDeviceReady() &&
+        comm->sendData(data, priority) != 0) {
+      accepted++;
+    }
+  }
+  return accepted;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <functional>
+
+#include "blerfcomm.hpp"
+
+// Keeps one BLERFComm - and with it its own transport, transmit queue and
+// receive arena - per connected peripheral and routes data by device address.
+// Devices can be put into named groups to send the same message to all of
+// them at once.
+class ConnectionPool : public QObject
+{
+  Q_OBJECT
+
+ public:
+  using TransportFactory =
+      std::function<BLETransport*(QBluetoothDeviceInfo const& device)>;
+
+ private:
+  QMap<QBluetoothAddress, BLERFComm*> m_connections{};
+  QHash<QString, QList<QBluetoothAddress>> m_groups{};
+  TransportFactory m_transportFactory{};
+  int m_maxConnections{8};
+
+  QBluetoothUuid m_serviceUuid{};
+  QBluetoothUuid m_charUuid{};
+  bool m_extendedFraming{false};
+
+ public:
+  explicit ConnectionPool(QObject* parent = nullptr);
+
+  // UUIDs and framing used for connections opened from now on.
+  void setServiceUuid(QBluetoothUuid const& serviceUuid);
+  void setCharUuid(QBluetoothUuid const& charUuid);
+  void setExtendedFramingEnabled(bool enabled);
+  void setMaxConnections(int connections);
+  int maxConnections() const;
+
+  // Creates the transport of every new connection, GattTransport if unset.
+  void setTransportFactory(TransportFactory factory);
+
+  // Returns the connection to the device, opening it if needed, or nullptr
+  // when the pool is full.
+  BLERFComm* connectToDevice(QBluetoothDeviceInfo const& device);
+  void disconnectFromDevice(QBluetoothAddress const& address);
+  void disconnectAll();
+
+  BLERFComm* connection(QBluetoothAddress const& address) const;
+  QList<QBluetoothAddress> addresses() const;
+  int connectionCount() const;
+  int readyCount() const;
+
+  void addToGroup(QString const& group, QBluetoothAddress const& address);
+  void removeFromGroup(QString const& group, QBluetoothAddress const& address);
+  void removeGroup(QString const& group);
+  QList<QBluetoothAddress> group(QString const& group) const;
+
+  // Same as BLERFComm::sendData, 0 if the device isn't connected.
+  quint64 sendData(QBluetoothAddress const& address, QByteArray const& data,
+                   BLERFComm::Priority priority = BLERFComm::Priority::Normal);
+  // Queues the message on every ready member of the group (or every ready
+  // device) and returns how many accepted it.
+  int sendToGroup(QString const& group, QByteArray const& data,
+                  BLERFComm::Priority priority = BLERFComm::Priority::Normal);
+  int broadcast(QByteArray const& data,
+                BLERFComm::Priority priority = BLERFComm::Priority::Normal);
+
+ signals:
+  void deviceConnected(QBluetoothAddress const& address);
+  void deviceReady(QBluetoothAddress const& address);
+  void deviceDisconnected(QBluetoothAddress const& address);
+  void connectionError(QBluetoothAddress const& address, BLEComm::Error error,
+                       QString const& description);
+  void dataReceived(QBluetoothAddress const& address, QByteArray const& data);
+  void messageSent(QBluetoothAddress const& address, quint64 messageId);
+  void messageDropped(QBluetoothAddress const& address, quint64 messageId);
+  void congestionChanged(QBluetoothAddress const& address, bool congested);
+
+ private:
+  BLERFComm* createConnection(QBluetoothDeviceInfo const& device);
+  void releaseConnection(QBluetoothAddress const& address);
+  int sendToAll(QList<QBluetoothAddress> const& addresses,
+                QByteArray const& data, BLERFComm::Priority priority);
+};
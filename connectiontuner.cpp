@@ -0,0 +1,238 @@
+#include "connectiontuner.hpp"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <algorithm>
+
+#include "bletransport.hpp"
+
+namespace {
+auto makeParameters(double minInterval, double maxInterval, int latency,
+                    int supervisionTimeout) -> QLowEnergyConnectionParameters {
+  QLowEnergyConnectionParameters parameters{};
+  parameters.setIntervalRange(minInterval, maxInterval);
+  parameters.setLatency(latency);
+  parameters.setSupervisionTimeout(supervisionTimeout);
+  return parameters;
+}
+}  // namespace
+
+auto ConnectionPolicy::busyParameters() const
+    -> QLowEnergyConnectionParameters {
+  return makeParameters(busyMinInterval, busyMaxInterval, busyLatency,
+                        supervisionTimeout);
+}
+
+auto ConnectionPolicy::idleParameters() const
+    -> QLowEnergyConnectionParameters {
+  return makeParameters(idleMinInterval, idleMaxInterval, idleLatency,
+                        supervisionTimeout);
+}
+
+auto ConnectionPolicy::fromJson(QJsonObject const& json,
+                                ConnectionPolicy const& base)
+    -> ConnectionPolicy {
+  ConnectionPolicy policy{base};
+  policy.adaptive = json["adaptive"].toBool(base.adaptive);
+  policy.busyMinInterval =
+      json["busyMinInterval"].toDouble(base.busyMinInterval);
+  policy.busyMaxInterval =
+      json["busyMaxInterval"].toDouble(base.busyMaxInterval);
+  policy.busyLatency = json["busyLatency"].toInt(base.busyLatency);
+  policy.idleMinInterval =
+      json["idleMinInterval"].toDouble(base.idleMinInterval);
+  policy.idleMaxInterval =
+      json["idleMaxInterval"].toDouble(base.idleMaxInterval);
+  policy.idleLatency = json["idleLatency"].toInt(base.idleLatency);
+  policy.supervisionTimeout =
+      json["supervisionTimeout"].toInt(base.supervisionTimeout);
+  policy.busyThreshold = json["busyThreshold"].toInt(base.busyThreshold);
+  policy.idlePeriod = std::max(json["idlePeriod"].toInt(base.idlePeriod), 100);
+  return policy;
+}
+
+auto ConnectionTuner::loadProfiles(QString const& path,
+                                   ConnectionProfiles& profiles,
+                                   QString* error) -> bool {
+  QFile file{path};
+  if (!file.open(QIODevice::ReadOnly)) {
+    if (error != nullptr) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+
+  QJsonParseError parseError{};
+  auto const document = QJsonDocument::fromJson(file.readAll(), &parseError);
+  if (!document.isObject()) {
+    if (error != nullptr) {
+      *error = parseError.error != QJsonParseError::NoError
+                   ? parseError.errorString()
+                   : QString("Expected an object of policies");
+    }
+    return false;
+  }
+
+  // every profile starts out from the default one
+  auto const root = document.object();
+  auto const defaults =
+      ConnectionPolicy::fromJson(root["default"].toObject(), {});
+  profiles.clear();
+  for (auto it = root.begin(); it != root.end(); ++it) {
+    auto const json = it.value().toObject();
+    profiles.insert(it.key(), ConnectionPolicy::fromJson(json, defaults));
+  }
+  profiles.insert("default", defaults);
+  return true;
+}
+
+auto ConnectionTuner::modeName(Mode mode) -> char const* {
+  switch (mode) {
+    case Mode::Default:
+      return "default";
+    case Mode::Busy:
+      return "busy";
+    case Mode::Idle:
+      return "idle";
+  }
+  return "unknown";
+}
+
+ConnectionTuner::ConnectionTuner(std::shared_ptr<LinkMetrics> metrics,
+                                 QObject* parent)
+    : QObject{parent}, m_metrics{std::move(metrics)} {
+  m_activityTimer = new QTimer{this};
+  QObject::connect(m_activityTimer, &QTimer::timeout, this,
+                   &ConnectionTuner::checkActivity);
+
+  m_effectTimer = new QTimer{this};
+  m_effectTimer->setSingleShot(true);
+  QObject::connect(m_effectTimer, &QTimer::timeout, this,
+                   &ConnectionTuner::measureEffect);
+}
+
+void ConnectionTuner::setPolicy(ConnectionPolicy const& policy) {
+  m_policy = policy;
+  m_activityTimer->setInterval(m_policy.idlePeriod);
+  if (!m_policy.adaptive) {
+    m_activityTimer->stop();
+  } else if (m_transport != nullptr) {
+    m_activityTimer->start();
+  }
+}
+
+auto ConnectionTuner::policy() const -> ConnectionPolicy { return m_policy; }
+
+auto ConnectionTuner::mode() const -> Mode { return m_mode; }
+
+auto ConnectionTuner::parameters() const -> QLowEnergyConnectionParameters {
+  return m_parameters;
+}
+
+void ConnectionTuner::start(BLETransport* transport) {
+  stop();
+  m_transport = transport;
+  QObject::connect(m_transport, &BLETransport::connectionUpdated, this,
+                   &ConnectionTuner::handleConnectionUpdated);
+
+  m_mode = Mode::Default;
+  m_requestedMode = Mode::Default;
+  m_activityBytes = 0;
+  restartSample();
+  if (m_policy.adaptive) {
+    m_activityTimer->start(m_policy.idlePeriod);
+  }
+}
+
+void ConnectionTuner::stop() {
+  if (m_transport != nullptr) {
+    m_transport->disconnect(this);
+    m_transport = nullptr;
+  }
+  m_activityTimer->stop();
+  m_effectTimer->stop();
+}
+
+void ConnectionTuner::noteActivity(int bytes) {
+  if (m_transport == nullptr || !m_policy.adaptive) {
+    return;
+  }
+
+  // speed up as soon as the traffic picks up, slow down only after a quiet
+  // period
+  m_activityBytes += bytes;
+  if (m_activityBytes >= m_policy.busyThreshold &&
+      m_requestedMode != Mode::Busy) {
+    request(Mode::Busy);
+  }
+}
+
+void ConnectionTuner::checkActivity() {
+  if (m_activityBytes < m_policy.busyThreshold / 4 &&
+      m_requestedMode != Mode::Idle) {
+    request(Mode::Idle);
+  }
+  m_activityBytes = 0;
+}
+
+void ConnectionTuner::request(Mode mode) {
+  auto const parameters = mode == Mode::Busy ? m_policy.busyParameters()
+                                             : m_policy.idleParameters();
+  if (!m_transport->requestConnectionUpdate(parameters)) {
+    // nothing to adapt, stop trying
+    m_activityTimer->stop();
+    m_requestedMode = mode;
+    return;
+  }
+
+  m_requestedMode = mode;
+  m_before = sampleSince(m_sampleStart);
+  emit updateRequested(mode, parameters);
+}
+
+void ConnectionTuner::handleConnectionUpdated(
+    QLowEnergyConnectionParameters const& parameters) {
+  // also updates the peripheral asked for itself
+  m_parameters = parameters;
+  m_mode = m_requestedMode;
+  m_metrics->add(LinkMetrics::ConnectionUpdates);
+  emit parametersApplied(m_mode, parameters);
+
+  restartSample();
+  m_effectTimer->start(EffectWindow);
+}
+
+void ConnectionTuner::measureEffect() {
+  auto const after = sampleSince(m_sampleStart);
+  emit effectMeasured(m_mode, m_before, after);
+}
+
+auto ConnectionTuner::sampleSince(LinkMetrics::Snapshot const& start) const
+    -> Sample {
+  auto const now = m_metrics->snapshot();
+  Sample sample{};
+
+  auto const elapsedMs = now.timestamp - start.timestamp;
+  if (elapsedMs > 0) {
+    auto const bytes = now.counter(LinkMetrics::BytesWritten) +
+                       now.counter(LinkMetrics::BytesReceived) -
+                       start.counter(LinkMetrics::BytesWritten) -
+                       start.counter(LinkMetrics::BytesReceived);
+    sample.bytesPerSecond = static_cast<double>(bytes) * 1000.0 /
+                            static_cast<double>(elapsedMs);
+  }
+
+  auto const writes = now.count(LinkMetrics::WriteLatency) -
+                      start.count(LinkMetrics::WriteLatency);
+  if (writes > 0) {
+    auto const latency = now.sums[LinkMetrics::WriteLatency] -
+                         start.sums[LinkMetrics::WriteLatency];
+    sample.writeLatencyUs =
+        static_cast<double>(latency) / static_cast<double>(writes);
+  }
+  return sample;
+}
+
+void ConnectionTuner::restartSample() {
+  m_sampleStart = m_metrics->snapshot();
+}
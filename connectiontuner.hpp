@@ -0,0 +1,122 @@
+#pragma once
+#include <QHash>
+#include <QJsonObject>
+#include <QLowEnergyConnectionParameters>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+#include "linkmetrics.hpp"
+
+class BLETransport;
+
+// When and how the connection parameters of a device are adapted to its
+// traffic. Intervals in ms, supervision timeout in ms.
+struct ConnectionPolicy {
+  bool adaptive{false};
+  // while data flows: short intervals, the peripheral listens every event
+  double busyMinInterval{7.5};
+  double busyMaxInterval{15.0};
+  int busyLatency{0};
+  // otherwise: long intervals, the peripheral may sleep through a few events
+  double idleMinInterval{50.0};
+  double idleMaxInterval{100.0};
+  int idleLatency{4};
+  int supervisionTimeout{6000};
+  // the link counts as busy once this many bytes moved within one idle
+  // period, and as idle after a period with less than a quarter of them
+  int busyThreshold{256};
+  int idlePeriod{2000};
+
+  auto busyParameters() const -> QLowEnergyConnectionParameters;
+  auto idleParameters() const -> QLowEnergyConnectionParameters;
+
+  // Fields missing from the JSON object are taken from base; the keys are
+  // the field names.
+  static auto fromJson(QJsonObject const& json, ConnectionPolicy const& base)
+      -> ConnectionPolicy;
+};
+
+// Policies by device address or name; "default" applies to all others.
+using ConnectionProfiles = QHash<QString, ConnectionPolicy>;
+
+// Switches a BLETransport between the busy and idle parameters of its
+// policy as the traffic reported by noteActivity comes and goes, and
+// measures what each switch did to throughput and write latency.
+class ConnectionTuner : public QObject
+{
+  Q_OBJECT
+
+ public:
+  enum class Mode { Default, Busy, Idle };
+  Q_ENUM(Mode)
+
+  // Throughput (bytes written and received) and mean write latency over a
+  // stretch of time.
+  struct Sample {
+    double bytesPerSecond{0.0};
+    double writeLatencyUs{0.0};
+  };
+
+  // how long after an update its effect is measured (ms)
+  static constexpr int EffectWindow{1000};
+
+  // JSON object of policies by device address or name, see fromJson.
+  static auto loadProfiles(QString const& path, ConnectionProfiles& profiles,
+                           QString* error = nullptr) -> bool;
+  static auto modeName(Mode mode) -> char const*;
+
+  explicit ConnectionTuner(std::shared_ptr<LinkMetrics> metrics,
+                           QObject* parent = nullptr);
+
+  void setPolicy(ConnectionPolicy const& policy);
+  auto policy() const -> ConnectionPolicy;
+  auto mode() const -> Mode;
+  // Last applied parameters, default constructed until the first update.
+  auto parameters() const -> QLowEnergyConnectionParameters;
+
+  // Between the link getting ready and going down.
+  void start(BLETransport* transport);
+  void stop();
+  void noteActivity(int bytes);
+
+ signals:
+  void updateRequested(ConnectionTuner::Mode mode,
+                       QLowEnergyConnectionParameters const& parameters);
+  void parametersApplied(ConnectionTuner::Mode mode,
+                         QLowEnergyConnectionParameters const& parameters);
+  // Link performance under the previous parameters and in the EffectWindow
+  // after the new ones were applied.
+  void effectMeasured(ConnectionTuner::Mode mode,
+                      ConnectionTuner::Sample before,
+                      ConnectionTuner::Sample after);
+
+ private slots:
+  void handleConnectionUpdated(
+      QLowEnergyConnectionParameters const& parameters);
+  void checkActivity();
+  void measureEffect();
+
+ private:
+  void request(Mode mode);
+  auto sampleSince(LinkMetrics::Snapshot const& start) const -> Sample;
+  void restartSample();
+
+  std::shared_ptr<LinkMetrics> m_metrics{};
+  BLETransport* m_transport{nullptr};
+  ConnectionPolicy m_policy{};
+  Mode m_mode{Mode::Default};
+  Mode m_requestedMode{Mode::Default};
+  QLowEnergyConnectionParameters m_parameters{};
+
+  QTimer* m_activityTimer{nullptr};
+  QTimer* m_effectTimer{nullptr};
+  qint64 m_activityBytes{0};
+
+  // performance since the last update, and before the pending one
+  LinkMetrics::Snapshot m_sampleStart{};
+  Sample m_before{};
+};
+
+Q_DECLARE_METATYPE(ConnectionTuner::Sample)
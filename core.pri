@@ -0,0 +1,55 @@
+# BLE RFComm communication stack, shared by the terminal app and benchmarks.
+
+QT += network
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+        $$PWD/blecomm.cpp \
+        $$PWD/blerfcomm.cpp \
+        $$PWD/blescanner.cpp \
+        $$PWD/blobtransfer.cpp \
+        $$PWD/capturefile.cpp \
+        $$PWD/connectionpool.cpp \
+        $$PWD/connectiontuner.cpp \
+        $$PWD/devicecache.cpp \
+        $$PWD/frameassembler.cpp \
+        $$PWD/gatttransport.cpp \
+        $$PWD/linkbridge.cpp \
+        $$PWD/linkmetrics.cpp \
+        $$PWD/lzcodec.cpp \
+        $$PWD/metricsreporter.cpp \
+        $$PWD/pseudoterminal.cpp \
+        $$PWD/reliablechannel.cpp \
+        $$PWD/replaytransport.cpp \
+        $$PWD/rfcommprotocol.cpp \
+        $$PWD/rpcclient.cpp \
+        $$PWD/rpcreply.cpp \
+        $$PWD/simulatedtransport.cpp \
+        $$PWD/transmitqueue.cpp
+
+HEADERS += \
+    $$PWD/blecomm.hpp \
+    $$PWD/blerfcomm.hpp \
+    $$PWD/blescanner.hpp \
+    $$PWD/bletransport.hpp \
+    $$PWD/blobtransfer.hpp \
+    $$PWD/capturefile.hpp \
+    $$PWD/connectionpool.hpp \
+    $$PWD/connectiontuner.hpp \
+    $$PWD/devicecache.hpp \
+    $$PWD/frameassembler.hpp \
+    $$PWD/gatttransport.hpp \
+    $$PWD/linkbridge.hpp \
+    $$PWD/linkmetrics.hpp \
+    $$PWD/lzcodec.hpp \
+    $$PWD/messageschema.hpp \
+    $$PWD/metricsreporter.hpp \
+    $$PWD/pseudoterminal.hpp \
+    $$PWD/reliablechannel.hpp \
+    $$PWD/replaytransport.hpp \
+    $$PWD/rfcommprotocol.hpp \
+    $$PWD/rpcclient.hpp \
+    $$PWD/rpcreply.hpp \
+    $$PWD/simulatedtransport.hpp \
+    $$PWD/transmitqueue.hpp
@@ -0,0 +1,185 @@
+#include "devicecache.hpp"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+
+namespace {
+constexpr int FormatVersion{1};
+}  // namespace
+
+auto DeviceCache::Entry::deviceInfo() const -> QBluetoothDeviceInfo {
+  QBluetoothDeviceInfo info{address, name, 0};
+  info.setCoreConfigurations(
+      QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+  info.setServiceUuids({serviceUuid});
+  return info;
+}
+
+DeviceCache::DeviceCache(QString path) : m_path{std::move(path)} {}
+
+auto DeviceCache::defaultPath() -> QString {
+  return QDir{QStandardPaths::writableLocation(
+                  QStandardPaths::AppLocalDataLocation)}
+      .filePath("device-cache.json");
+}
+
+auto DeviceCache::path() const -> QString { return m_path; }
+
+auto DeviceCache::load() -> bool {
+  QFile file{m_path};
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  auto const document = QJsonDocument::fromJson(file.readAll());
+  auto const root = document.object();
+  if (root.value("version").toInt() != FormatVersion) {
+    return false;
+  }
+
+  std::vector<Entry> entries{};
+  for (auto const& value : root.value("devices").toArray()) {
+    auto const object = value.toObject();
+    Entry entry{};
+    entry.address = QBluetoothAddress{object.value("address").toString()};
+    entry.name = object.value("name").toString();
+    entry.serviceUuid = QBluetoothUuid{object.value("service").toString()};
+    entry.charUuid = QBluetoothUuid{object.value("characteristic").toString()};
+    entry.charHandle =
+        static_cast<quint16>(object.value("characteristicHandle").toInt());
+    entry.charProperties = object.value("characteristicProperties").toInt();
+    entry.lastUsed =
+        static_cast<qint64>(object.value("lastUsed").toDouble());
+    entry.failures = object.value("failures").toInt();
+
+    if (!entry.address.isNull() && !entry.serviceUuid.isNull() &&
+        !entry.charUuid.isNull()) {
+      entries.push_back(std::move(entry));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock{m_mutex};
+  m_entries = std::move(entries);
+  evictStale();
+  return true;
+}
+
+auto DeviceCache::save() const -> bool {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return writeFile();
+}
+
+auto DeviceCache::find(QBluetoothAddress const& address) const
+    -> std::optional<Entry> {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto const index = indexOf(address);
+  if (index < 0) {
+    return std::nullopt;
+  }
+  return m_entries[static_cast<std::size_t>(index)];
+}
+
+auto DeviceCache::entries() const -> std::vector<Entry> {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  return m_entries;
+}
+
+void DeviceCache::store(Entry entry) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+  entry.failures = 0;
+
+  auto const index = indexOf(entry.address);
+  if (index >= 0) {
+    m_entries.erase(m_entries.begin() + index);
+  }
+  m_entries.insert(m_entries.begin(), std::move(entry));
+
+  evictStale();
+  writeFile();
+}
+
+void DeviceCache::recordFailure(QBluetoothAddress const& address) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto const index = indexOf(address);
+  if (index < 0) {
+    return;
+  }
+
+  auto& entry = m_entries[static_cast<std::size_t>(index)];
+  if (++entry.failures >= MaxFailures) {
+    m_entries.erase(m_entries.begin() + index);
+  }
+  writeFile();
+}
+
+void DeviceCache::evict(QBluetoothAddress const& address) {
+  std::lock_guard<std::mutex> lock{m_mutex};
+  auto const index = indexOf(address);
+  if (index >= 0) {
+    m_entries.erase(m_entries.begin() + index);
+    writeFile();
+  }
+}
+
+auto DeviceCache::indexOf(QBluetoothAddress const& address) const -> int {
+  auto const found = std::find_if(
+      m_entries.cbegin(), m_entries.cend(),
+      [&](Entry const& entry) { return entry.address == address; });
+  if (found == m_entries.cend()) {
+    return -1;
+  }
+  return static_cast<int>(found - m_entries.cbegin());
+}
+
+void DeviceCache::evictStale() {
+  auto const oldest = QDateTime::currentMSecsSinceEpoch() - MaxAgeMs;
+  m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                                 [&](Entry const& entry) {
+                                   return entry.lastUsed < oldest ||
+                                          entry.failures >= MaxFailures;
+                                 }),
+                  m_entries.end());
+
+  std::stable_sort(m_entries.begin(), m_entries.end(),
+                   [](Entry const& a, Entry const& b) {
+                     return a.lastUsed > b.lastUsed;
+                   });
+  if (m_entries.size() > static_cast<std::size_t>(MaxEntries)) {
+    m_entries.resize(static_cast<std::size_t>(MaxEntries));
+  }
+}
+
+auto DeviceCache::writeFile() const -> bool {
+  QJsonArray devices{};
+  for (auto const& entry : m_entries) {
+    devices.append(QJsonObject{
+        {"address", entry.address.toString()},
+        {"name", entry.name},
+        {"service", entry.serviceUuid.toString()},
+        {"characteristic", entry.charUuid.toString()},
+        {"characteristicHandle", entry.charHandle},
+        {"characteristicProperties", entry.charProperties},
+        {"lastUsed", static_cast<double>(entry.lastUsed)},
+        {"failures", entry.failures},
+    });
+  }
+
+  QDir{}.mkpath(QFileInfo{m_path}.absolutePath());
+  QSaveFile file{m_path};
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+
+  QJsonObject const root{{"version", FormatVersion}, {"devices", devices}};
+  file.write(QJsonDocument{root}.toJson(QJsonDocument::Compact));
+  return file.commit();
+}
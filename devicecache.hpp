@@ -0,0 +1,64 @@
+#pragma once
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QString>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// On-disk record of the devices we've been connected to, keyed by address:
+// how they were found, which service and characteristic were used and what
+// the characteristic looked like. Lets the app offer known devices without a
+// scan and lets GattTransport set up the link without waiting for the whole
+// service discovery. Shared between threads, every call is synchronized.
+class DeviceCache
+{
+ public:
+  struct Entry {
+    QBluetoothAddress address{};
+    QString name{};
+    QBluetoothUuid serviceUuid{};
+    QBluetoothUuid charUuid{};
+    quint16 charHandle{0};
+    int charProperties{0};
+    // ms since epoch
+    qint64 lastUsed{0};
+    // failed connection attempts since the last successful one
+    int failures{0};
+
+    auto deviceInfo() const -> QBluetoothDeviceInfo;
+  };
+
+  static constexpr int MaxEntries{32};
+  static constexpr qint64 MaxAgeMs{30LL * 24 * 60 * 60 * 1000};
+  static constexpr int MaxFailures{3};
+
+  explicit DeviceCache(QString path = defaultPath());
+
+  static auto defaultPath() -> QString;
+  auto path() const -> QString;
+
+  // Reads the file, dropping malformed and stale entries.
+  auto load() -> bool;
+  auto save() const -> bool;
+
+  auto find(QBluetoothAddress const& address) const -> std::optional<Entry>;
+  // Most recently used first.
+  auto entries() const -> std::vector<Entry>;
+
+  // Records a successful connection and saves the cache.
+  void store(Entry entry);
+  // Evicts the device after MaxFailures failures in a row.
+  void recordFailure(QBluetoothAddress const& address);
+  void evict(QBluetoothAddress const& address);
+
+ private:
+  auto indexOf(QBluetoothAddress const& address) const -> int;
+  void evictStale();
+  auto writeFile() const -> bool;
+
+  QString m_path{};
+  mutable std::mutex m_mutex{};
+  std::vector<Entry> m_entries{};
+};
@@ -0,0 +1,77 @@
+#include "devicemodel.hpp"
+
+DeviceModel::DeviceModel(BLEScanner* scanner, QObject* parent)
+    : QAbstractListModel{parent}, m_scanner{scanner} {
+  m_rows = m_scanner->deviceList().size();
+
+  QObject::connect(m_scanner, &BLEScanner::deviceDiscovered, this,
+                   &DeviceModel::handleDeviceDiscovered);
+  QObject::connect(m_scanner, &BLEScanner::deviceUpdated, this,
+                   &DeviceModel::handleDeviceUpdated);
+  QObject::connect(m_scanner, &BLEScanner::devicesCleared, this,
+                   &DeviceModel::handleDevicesCleared);
+}
+
+int DeviceModel::rowCount(QModelIndex const& parent) const {
+  return parent.isValid() ? 0 : m_rows;
+}
+
+QVariant DeviceModel::data(QModelIndex const& index, int role) const {
+  if (!index.isValid() || index.row() >= m_rows) {
+    return QVariant{};
+  }
+
+  auto const& device = m_scanner->deviceList().at(index.row());
+  switch (role) {
+    case NameRole:
+      return device.name();
+    case AddressRole:
+      return device.address().toString();
+    case RssiRole:
+      return device.rssi();
+    case Qt::DisplayRole:
+    case DescriptionRole:
+      return QString("%1 (%2) %3 dBm")
+          .arg(device.name(), device.address().toString())
+          .arg(device.rssi());
+    default:
+      return QVariant{};
+  }
+}
+
+QHash<int, QByteArray> DeviceModel::roleNames() const {
+  return {
+      {NameRole, "name"},
+      {AddressRole, "address"},
+      {RssiRole, "rssi"},
+      {DescriptionRole, "description"},
+  };
+}
+
+int DeviceModel::count() const { return m_rows; }
+
+void DeviceModel::handleDeviceDiscovered(int index) {
+  if (index < m_rows) {
+    return;
+  }
+
+  beginInsertRows(QModelIndex{}, m_rows, index);
+  m_rows = index + 1;
+  endInsertRows();
+  emit countChanged(m_rows);
+}
+
+void DeviceModel::handleDeviceUpdated(int index) {
+  if (index < m_rows) {
+    auto const row = createIndex(index, 0);
+    emit dataChanged(row, row,
+                     {Qt::DisplayRole, NameRole, RssiRole, DescriptionRole});
+  }
+}
+
+void DeviceModel::handleDevicesCleared() {
+  beginResetModel();
+  m_rows = 0;
+  endResetModel();
+  emit countChanged(m_rows);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QHash>
+
+#include "blescanner.hpp"
+
+// Live view of the scanner's device list - rows are added and updated as
+// advertisements come in, instead of the whole list being rebuilt after the
+// scan.
+class DeviceModel : public QAbstractListModel
+{
+  Q_OBJECT
+
+  Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+ public:
+  enum Role {
+    NameRole = Qt::UserRole + 1,
+    AddressRole,
+    RssiRole,
+    DescriptionRole
+  };
+
+ private:
+  BLEScanner* m_scanner{nullptr};
+  // rows announced to the views so far
+  int m_rows{0};
+
+ public:
+  explicit DeviceModel(BLEScanner* scanner, QObject* parent = nullptr);
+
+  int rowCount(QModelIndex const& parent = QModelIndex{}) const override;
+  QVariant data(QModelIndex const& index,
+                int role = Qt::DisplayRole) const override;
+  QHash<int, QByteArray> roleNames() const override;
+
+  int count() const;
+
+ signals:
+  void countChanged(int count);
+
+ private slots:
+  void handleDeviceDiscovered(int index);
+  void handleDeviceUpdated(int index);
+  void handleDevicesCleared();
+};
@@ -0,0 +1,114 @@
+#include "frameassembler.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+FrameAssembler::FrameAssembler(int initialCapacity) {
+  // reserve() marks the capacity as reserved, so resizing down to zero
+  // keeps the buffer instead of freeing it
+  m_arena.reserve(initialCapacity);
+}
+
+auto FrameAssembler::feed(char const* data, int size) -> int {
+  m_frameComplete = false;
+  if (size <= 0) {
+    return 0;
+  }
+
+  if (!m_inProgress) {
+    startFrame();
+  }
+
+  // the extended header might be split between notifications
+  int consumed{0};
+  while (m_headerFill < m_headerNeeded && consumed < size) {
+    m_header[m_headerFill++] = data[consumed++];
+
+    if (m_headerFill == 1 && m_header[0] == RFCommProtocol::ExtendedMarker) {
+      m_headerNeeded = RFCommProtocol::ExtendedHeaderSize;
+    }
+  }
+
+  if (m_headerFill < m_headerNeeded) {
+    return consumed;
+  }
+  if (m_expectedBytes < 0) {
+    parseHeader();
+  }
+
+  // anything past the announced length belongs to the next frame
+  int const used = std::min(size - consumed, m_expectedBytes);
+  append(data + consumed, used);
+  m_expectedBytes -= used;
+  consumed += used;
+
+  m_inProgress = m_expectedBytes > 0;
+  m_frameComplete = !m_inProgress;
+  return consumed;
+}
+
+void FrameAssembler::reset() {
+  rewind();
+  m_headerFill = 0;
+  m_expectedBytes = 0;
+  m_inProgress = false;
+  m_frameComplete = false;
+}
+
+auto FrameAssembler::inProgress() const -> bool { return m_inProgress; }
+
+auto FrameAssembler::frameComplete() const -> bool { return m_frameComplete; }
+
+auto FrameAssembler::frame() const -> QByteArray const& { return m_arena; }
+
+auto FrameAssembler::frameFlags() const -> quint8 { return m_flags; }
+
+void FrameAssembler::startFrame() {
+  rewind();
+  m_headerFill = 0;
+  m_headerNeeded = RFCommProtocol::LegacyHeaderSize;
+  m_expectedBytes = -1;
+  m_flags = RFCommProtocol::NoFlags;
+  m_inProgress = true;
+}
+
+void FrameAssembler::parseHeader() {
+  // casting to prevent getting negative lengths
+  auto const byteAt = [this](int index) {
+    return static_cast<int>(static_cast<std::uint8_t>(m_header[index]));
+  };
+
+  if (m_headerNeeded == RFCommProtocol::LegacyHeaderSize) {
+    m_expectedBytes = byteAt(0);
+  } else {
+    m_flags = static_cast<quint8>(byteAt(1));
+    m_expectedBytes = byteAt(2) | (byteAt(3) << 8);
+  }
+
+  // grows once for the largest frame seen, then stays reserved
+  if (m_expectedBytes > m_arena.capacity()) {
+    m_arena.reserve(m_expectedBytes);
+  }
+}
+
+void FrameAssembler::rewind() {
+  if (m_arena.isDetached()) {
+    m_arena.resize(0);
+  } else {
+    // somebody kept the previous frame - leave it to them
+    int const capacity = m_arena.capacity();
+    m_arena = QByteArray{};
+    m_arena.reserve(capacity);
+  }
+}
+
+void FrameAssembler::append(char const* data, int size) {
+  if (size <= 0) {
+    return;
+  }
+
+  int const offset = m_arena.size();
+  m_arena.resize(offset + size);
+  std::memcpy(m_arena.data() + offset, data, static_cast<std::size_t>(size));
+}
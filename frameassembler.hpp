@@ -0,0 +1,45 @@
+#pragma once
+#include <QByteArray>
+
+#include "rfcommprotocol.hpp"
+
+// Reassembles RFComm frames from the notification byte stream into a
+// preallocated arena. Frames may start anywhere in a notification and a single
+// notification may carry several of them.
+// Every received byte is copied exactly once, into its final place. The
+// completed frame is handed out as an implicitly shared QByteArray pointing at
+// the arena, so as long as receivers don't keep it around, the next frame is
+// written into the same memory without a single allocation. A receiver that
+// does keep it simply makes the next write detach.
+class FrameAssembler
+{
+ public:
+  explicit FrameAssembler(
+      int initialCapacity = RFCommProtocol::MaxLegacyPayload);
+
+  // Consumes bytes up to the end of the next frame and returns how many were
+  // used. When the frame got completed, frameComplete() is true and frame()
+  // stays valid until the next call.
+  auto feed(char const* data, int size) -> int;
+  void reset();
+
+  auto inProgress() const -> bool;
+  auto frameComplete() const -> bool;
+  auto frame() const -> QByteArray const&;
+  auto frameFlags() const -> quint8;
+
+ private:
+  void startFrame();
+  void parseHeader();
+  void rewind();
+  void append(char const* data, int size);
+
+  QByteArray m_arena{};
+  char m_header[RFCommProtocol::ExtendedHeaderSize]{};
+  int m_headerFill{0};
+  int m_headerNeeded{RFCommProtocol::LegacyHeaderSize};
+  int m_expectedBytes{0};
+  quint8 m_flags{RFCommProtocol::NoFlags};
+  bool m_inProgress{false};
+  bool m_frameComplete{false};
+};
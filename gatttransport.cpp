@@ -0,0 +1,392 @@
+#include "gatttransport.hpp"
+
+#include <QTimer>
+#include <utility>
+
+GattTransport::GattTransport(QObject* parent) : BLETransport{parent} {}
+
+void GattTransport::connectToDevice(QBluetoothDeviceInfo const& device,
+                                    QBluetoothUuid const& serviceUuid,
+                                    QBluetoothUuid const& charUuid) {
+  if (m_controller != nullptr) {
+    disconnectFromDevice();
+  }
+
+  m_serviceUuid = serviceUuid;
+  m_charUuid = charUuid;
+  m_deviceAddress = device.address();
+
+  auto const cached =
+      m_cache ? m_cache->find(m_deviceAddress) : std::nullopt;
+  m_fromCache = cached && cached->serviceUuid == serviceUuid &&
+                cached->charUuid == charUuid;
+
+  m_controller = QLowEnergyController::createCentral(device, this);
+
+  // queued, so it may arrive after the controller has been replaced
+  auto* controller = m_controller;
+  QObject::connect(
+      m_controller, &QLowEnergyController::disconnected, this,
+      [this, controller]() {
+        if (controller == m_controller) {
+          disconnectFromDevice();
+        }
+      },
+      Qt::QueuedConnection);
+  QObject::connect(m_controller, &QLowEnergyController::connected, this,
+                   &GattTransport::handleConnection, Qt::QueuedConnection);
+  QObject::connect(m_controller, &QLowEnergyController::serviceDiscovered,
+                   this, &GattTransport::handleServiceDiscovered,
+                   Qt::QueuedConnection);
+  QObject::connect(m_controller, &QLowEnergyController::discoveryFinished,
+                   this, &GattTransport::handleDiscovery,
+                   Qt::QueuedConnection);
+  QObject::connect(m_controller, &QLowEnergyController::mtuChanged, this,
+                   &GattTransport::mtuChanged);
+  QObject::connect(m_controller, &QLowEnergyController::connectionUpdated,
+                   this, &GattTransport::connectionUpdated);
+  QObject::connect(
+      m_controller,
+      static_cast<void (QLowEnergyController::*)(QLowEnergyController::Error)>(
+          &QLowEnergyController::error),
+      [&](QLowEnergyController::Error errorCode) {
+        if (m_cache && !ready()) {
+          m_cache->recordFailure(m_deviceAddress);
+        }
+        emit connectionError(BLETransport::Error::ConnectonError,
+                             QString("Connection error: %1 (code %2)")
+                                 .arg(m_controller->errorString())
+                                 .arg(errorCode));
+        disconnectFromDevice();
+      });
+
+  m_controller->connectToDevice();
+}
+
+void GattTransport::disconnectFromDevice() {
+  m_bulkChars.clear();
+  m_writesWithResponse.clear();
+  m_notifySetups = 0;
+  if (m_service != nullptr) {
+    m_service->deleteLater();
+    m_service = nullptr;
+  }
+
+  if (m_controller != nullptr) {
+    m_controller->disconnectFromDevice();
+    m_controller->deleteLater();
+    m_controller = nullptr;
+  }
+
+  if (m_linkUp) {
+    m_linkUp = false;
+    emit disconnectedFromDevice();
+  }
+}
+
+void GattTransport::write(QByteArray const& data, WriteMode mode) {
+  if (!connected() || m_service == nullptr) {
+    QTimer::singleShot(0, this, &GattTransport::writeFailed);
+    return;
+  }
+  writeCharacteristic(m_char, data, mode, MainChannel);
+}
+
+void GattTransport::writeBulk(int channel, QByteArray const& data,
+                              WriteMode mode) {
+  if (!connected() || m_service == nullptr || channel < 0 ||
+      channel >= m_bulkChars.size()) {
+    QTimer::singleShot(0, this,
+                       [this, channel]() { emit bulkWriteFailed(channel); });
+    return;
+  }
+
+  // bulk characteristics may lack unacknowledged writes even if the main
+  // one has them
+  auto const& characteristic = m_bulkChars[channel];
+  if (!characteristic.properties().testFlag(
+          QLowEnergyCharacteristic::WriteNoResponse)) {
+    mode = WriteMode::WithResponse;
+  }
+  writeCharacteristic(characteristic, data, mode, channel);
+}
+
+auto GattTransport::connected() const -> bool {
+  return (m_controller != nullptr &&
+          (m_controller->state() == QLowEnergyController::ConnectedState ||
+           m_controller->state() == QLowEnergyController::DiscoveredState));
+}
+
+auto GattTransport::ready() const -> bool {
+  if (m_service != nullptr) {
+    return m_service->state() == QLowEnergyService::ServiceDiscovered;
+  }
+  return false;
+}
+
+auto GattTransport::remoteName() const -> QString {
+  if (connected()) {
+    return m_controller->remoteName();
+  }
+  return QString{};
+}
+
+auto GattTransport::remoteAddress() const -> QBluetoothAddress {
+  if (connected()) {
+    return m_controller->remoteAddress();
+  }
+  return QBluetoothAddress{};
+}
+
+auto GattTransport::mtu() const -> int {
+  if (m_controller != nullptr) {
+    return m_controller->mtu();
+  }
+  return DefaultMtu;
+}
+
+auto GattTransport::supportsWriteWithoutResponse() const -> bool {
+  return m_char.isValid() && m_char.properties().testFlag(
+                                 QLowEnergyCharacteristic::WriteNoResponse);
+}
+
+void GattTransport::setDeviceCache(std::shared_ptr<DeviceCache> cache) {
+  m_cache = std::move(cache);
+}
+
+auto GattTransport::connectedFromCache() const -> bool { return m_fromCache; }
+
+void GattTransport::setBulkCharacteristics(
+    QList<QBluetoothUuid> const& charUuids) {
+  m_bulkCharUuids = charUuids;
+}
+
+auto GattTransport::bulkChannelCount() const -> int {
+  return m_bulkChars.size();
+}
+
+auto GattTransport::requestConnectionUpdate(
+    QLowEnergyConnectionParameters const& parameters) -> bool {
+  if (!connected()) {
+    return false;
+  }
+  // not every backend supports it (macOS and iOS don't), those ignore it
+  m_controller->requestConnectionUpdate(parameters);
+  return true;
+}
+
+void GattTransport::handleConnection() {
+  m_linkUp = true;
+  emit connectedToDevice();
+  m_controller->discoverServices();
+}
+
+void GattTransport::handleServiceDiscovered(
+    QBluetoothUuid const& serviceUuid) {
+  if (m_fromCache && m_service == nullptr && serviceUuid == m_serviceUuid) {
+    setUpService();
+  }
+}
+
+void GattTransport::handleDiscovery() {
+  if (m_service != nullptr) {
+    return;
+  }
+
+  if (!m_controller->services().contains(m_serviceUuid)) {
+    // whatever we knew about the device doesn't hold anymore
+    if (m_cache) {
+      m_cache->evict(m_deviceAddress);
+    }
+    emit connectionError(
+        BLETransport::Error::ServiceError,
+        QString("Cannot find service %1 on device %2!")
+            .arg(m_serviceUuid.toString(), m_controller->remoteName()));
+    disconnectFromDevice();
+  } else {
+    setUpService();
+  }
+}
+
+void GattTransport::setUpService() {
+  m_service = m_controller->createServiceObject(m_serviceUuid, this);
+  if (m_service == nullptr) {
+    // not usable before the discovery is over on this backend
+    return;
+  }
+  emit serviceDiscovered();
+
+  QObject::connect(
+      m_service,
+      static_cast<void (QLowEnergyService::*)(
+          QLowEnergyService::ServiceError)>(&QLowEnergyService::error),
+      [&](QLowEnergyService::ServiceError errorCode) {
+        if (errorCode == QLowEnergyService::CharacteristicWriteError) {
+          // Qt doesn't say which characteristic it was, but it's the
+          // oldest write in flight
+          int channel{MainChannel};
+          if (!m_writesWithResponse.empty()) {
+            channel = m_writesWithResponse.front();
+            m_writesWithResponse.pop_front();
+          }
+          if (channel == MainChannel) {
+            emit writeFailed();
+          } else {
+            emit bulkWriteFailed(channel);
+          }
+        } else if (errorCode == QLowEnergyService::DescriptorWriteError &&
+                   m_notifySetups > 0) {
+          // that bulk characteristic stays quiet, the rest still work - not
+          // an error of the link, which is still being set up
+          finishNotifySetup();
+          return;
+        }
+        emit connectionError(
+            BLETransport::Error::ServiceError,
+            QString("An unknown service error happened (code %1)")
+                .arg(errorCode));
+      });
+
+  QObject::connect(m_service, &QLowEnergyService::characteristicChanged, this,
+                   &GattTransport::handleData, Qt::QueuedConnection);
+  QObject::connect(m_service, &QLowEnergyService::characteristicWritten, this,
+                   [this](QLowEnergyCharacteristic const& characteristic,
+                          QByteArray const& value) {
+                     if (!m_writesWithResponse.empty()) {
+                       m_writesWithResponse.pop_front();
+                     }
+                     if (characteristic == m_char) {
+                       emit dataWritten(value.size());
+                       return;
+                     }
+                     int const channel = m_bulkChars.indexOf(characteristic);
+                     if (channel >= 0) {
+                       emit bulkDataWritten(channel, value.size());
+                     }
+                   });
+
+  QObject::connect(m_service, &QLowEnergyService::descriptorWritten, this,
+                   [this](QLowEnergyDescriptor const&, QByteArray const&) {
+                     finishNotifySetup();
+                   });
+
+  QObject::connect(m_service, &QLowEnergyService::stateChanged,
+                   [&](QLowEnergyService::ServiceState newState) {
+                     if (newState == QLowEnergyService::ServiceDiscovered) {
+                       handleServiceReady();
+                     }
+                   });
+
+  m_service->discoverDetails();
+}
+
+void GattTransport::handleServiceReady() {
+  m_char = m_service->characteristic(m_charUuid);
+
+  if (!m_char.isValid()) {
+    if (m_cache) {
+      m_cache->evict(m_deviceAddress);
+    }
+    emit connectionError(
+        BLETransport::Error::CharacteristicError,
+        QString("Invalid characteristic %1 on device %2!")
+            .arg(m_charUuid.toString(), m_controller->remoteName()));
+    disconnectFromDevice();
+    return;
+  }
+
+  // bulk characteristics are optional, the device may have fewer of them
+  m_bulkChars.clear();
+  for (auto const& uuid : qAsConst(m_bulkCharUuids)) {
+    auto const characteristic = m_service->characteristic(uuid);
+    if (characteristic.isValid() && characteristic != m_char) {
+      m_bulkChars.append(characteristic);
+    }
+  }
+
+  if (m_cache) {
+    // a characteristic that moved or changed means the device's database
+    // did too, so the cached details didn't really apply
+    auto const cached = m_cache->find(m_deviceAddress);
+    if (m_fromCache && cached &&
+        (cached->charHandle != m_char.handle() ||
+         cached->charProperties != static_cast<int>(m_char.properties()))) {
+      m_fromCache = false;
+    }
+
+    // refreshes the entry, handles included, whether it was valid or not
+    DeviceCache::Entry entry{};
+    entry.address = m_deviceAddress;
+    entry.name = m_controller->remoteName();
+    entry.serviceUuid = m_serviceUuid;
+    entry.charUuid = m_charUuid;
+    entry.charHandle = m_char.handle();
+    entry.charProperties = static_cast<int>(m_char.properties());
+    m_cache->store(std::move(entry));
+  }
+
+  // the peer only notifies on the bulk characteristics once asked to, so
+  // the link is ready when they all are
+  m_notifySetups = 0;
+  for (auto const& characteristic : qAsConst(m_bulkChars)) {
+    auto const config = characteristic.descriptor(
+        QBluetoothUuid::ClientCharacteristicConfiguration);
+    if ((characteristic.properties() & QLowEnergyCharacteristic::Notify) &&
+        config.isValid()) {
+      m_notifySetups++;
+      m_service->writeDescriptor(config, QByteArray::fromHex("0100"));
+    }
+  }
+  if (m_notifySetups == 0) {
+    emit commsReady();
+  }
+}
+
+void GattTransport::finishNotifySetup() {
+  if (m_notifySetups == 0) {
+    return;
+  }
+  m_notifySetups--;
+  if (m_notifySetups == 0) {
+    emit commsReady();
+  }
+}
+
+void GattTransport::handleData(QLowEnergyCharacteristic const& characteristic,
+                               QByteArray const& data) {
+  if (characteristic == m_char) {
+    emit dataReceived(data);
+    return;
+  }
+  int const channel = m_bulkChars.indexOf(characteristic);
+  if (channel >= 0) {
+    emit bulkDataReceived(channel, data);
+  }
+}
+
+void GattTransport::writeCharacteristic(
+    QLowEnergyCharacteristic const& characteristic, QByteArray const& data,
+    WriteMode mode, int channel) {
+  if (mode == WriteMode::WithResponse) {
+    // completion is reported by characteristicWritten, failure by the
+    // service's error
+    m_writesWithResponse.push_back(channel);
+    m_service->writeCharacteristic(characteristic, data,
+                                   QLowEnergyService::WriteWithResponse);
+    return;
+  }
+
+  // Qt reports neither success nor failure of unacknowledged writes, so the
+  // best we can do is to consider the write done once control returns to the
+  // event loop and the stack had a chance to push it out
+  m_service->writeCharacteristic(characteristic, data,
+                                 QLowEnergyService::WriteWithoutResponse);
+  int const size = data.size();
+  QTimer::singleShot(0, this, [this, channel, size]() {
+    if (channel == MainChannel) {
+      emit dataWritten(size);
+    } else {
+      emit bulkDataWritten(channel, size);
+    }
+  });
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QList>
+#include <QLowEnergyCharacteristic>
+#include <QLowEnergyController>
+#include <QLowEnergyService>
+#include <QString>
+#include <deque>
+#include <memory>
+
+#include "bletransport.hpp"
+#include "devicecache.hpp"
+
+class GattTransport : public BLETransport
+{
+  Q_OBJECT
+
+ public:
+  explicit GattTransport(QObject* parent = nullptr);
+
+  void connectToDevice(QBluetoothDeviceInfo const& device,
+                       QBluetoothUuid const& serviceUuid,
+                       QBluetoothUuid const& charUuid) override;
+  void disconnectFromDevice() override;
+
+  void write(QByteArray const& data, WriteMode mode) override;
+
+  auto connected() const -> bool override;
+  auto ready() const -> bool override;
+  auto remoteName() const -> QString override;
+  auto remoteAddress() const -> QBluetoothAddress override;
+  auto mtu() const -> int override;
+  auto supportsWriteWithoutResponse() const -> bool override;
+
+  void setBulkCharacteristics(QList<QBluetoothUuid> const& charUuids) override;
+  auto bulkChannelCount() const -> int override;
+  void writeBulk(int channel, QByteArray const& data, WriteMode mode) override;
+
+  void setDeviceCache(std::shared_ptr<DeviceCache> cache) override;
+  auto connectedFromCache() const -> bool override;
+  auto requestConnectionUpdate(
+      QLowEnergyConnectionParameters const& parameters) -> bool override;
+
+ private slots:
+  void handleConnection();
+  void handleServiceDiscovered(QBluetoothUuid const& serviceUuid);
+  void handleDiscovery();
+  void handleData(QLowEnergyCharacteristic const& characteristic,
+                  QByteArray const& data);
+
+ private:
+  // channel of writes to the main characteristic
+  static constexpr int MainChannel{-1};
+
+  void setUpService();
+  void handleServiceReady();
+  void finishNotifySetup();
+  void writeCharacteristic(QLowEnergyCharacteristic const& characteristic,
+                           QByteArray const& data, WriteMode mode,
+                           int channel);
+
+  QLowEnergyController* m_controller{nullptr};
+  QLowEnergyService* m_service{nullptr};
+  QLowEnergyCharacteristic m_char{};
+  QList<QLowEnergyCharacteristic> m_bulkChars{};
+  // channels of the writes with response in flight, which the service
+  // completes in order
+  std::deque<int> m_writesWithResponse{};
+  // bulk characteristics whose notifications are still being enabled
+  int m_notifySetups{0};
+
+  QBluetoothUuid m_serviceUuid{};
+  QBluetoothUuid m_charUuid{};
+  QList<QBluetoothUuid> m_bulkCharUuids{};
+  QBluetoothAddress m_deviceAddress{};
+
+  // connectedToDevice has been emitted, disconnectedFromDevice is owed
+  bool m_linkUp{false};
+
+  std::shared_ptr<DeviceCache> m_cache{};
+  // the device is known to have the service, so there's no need to wait
+  // for the discovery of all the others
+  bool m_fromCache{false};
+};
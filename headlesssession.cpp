@@ -0,0 +1,357 @@
+#include "headlesssession.hpp"
+
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <utility>
+
+#ifdef Q_OS_WIN
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "simulatedtransport.hpp"
+
+namespace {
+constexpr int LengthPrefixSize{2};
+
+int readStdin(char *buffer, int size) {
+#ifdef Q_OS_WIN
+  return _read(0, buffer, static_cast<unsigned>(size));
+#else
+  ssize_t result{0};
+  do {
+    result = ::read(STDIN_FILENO, buffer, static_cast<size_t>(size));
+  } while (result < 0 && errno == EINTR);
+  return static_cast<int>(result);
+#endif
+}
+}  // namespace
+
+void StdinReader::release(int chunks) { m_credits.release(chunks); }
+
+void StdinReader::run() {
+  while (true) {
+    m_credits.acquire();
+
+    QByteArray chunk{ChunkSize, Qt::Uninitialized};
+    int const size = readStdin(chunk.data(), chunk.size());
+    if (size <= 0) {
+      emit endOfInput();
+      return;
+    }
+
+    chunk.resize(size);
+    emit dataRead(chunk);
+  }
+}
+
+HeadlessSession::HeadlessSession(Options options, QObject *parent)
+    : QObject(parent), m_options{std::move(options)} {
+  m_scanner = new BLEScanner{this};
+  m_comm = new BLERFComm{this};
+
+  m_connectTimer = new QTimer{this};
+  m_connectTimer->setSingleShot(true);
+  QObject::connect(m_connectTimer, &QTimer::timeout, this,
+                   [&]() { fail("Timed out connecting to the device"); });
+
+  QObject::connect(m_scanner, &BLEScanner::scanCompleted, this,
+                   &HeadlessSession::handleScanCompleted);
+  QObject::connect(m_scanner, &BLEScanner::scanError, this,
+                   [&](QBluetoothDeviceDiscoveryAgent::Error,
+                       QString const &description) {
+                     fail(QString("Scan failed: %1").arg(description));
+                   });
+
+  QObject::connect(m_comm, &BLERFComm::deviceReady, this,
+                   &HeadlessSession::handleReady);
+  QObject::connect(m_comm, &BLERFComm::dataReceived, this,
+                   &HeadlessSession::writeMessage);
+  QObject::connect(m_comm, &BLERFComm::messageSent, this,
+                   &HeadlessSession::sendPendingInput);
+  QObject::connect(m_comm, &BLERFComm::messageDropped, this, [&]() {
+    m_droppedMessages++;
+    sendPendingInput();
+  });
+  QObject::connect(m_comm, &BLERFComm::connectionError, this,
+                   [&](BLEComm::Error, QString const &description) {
+                     fail(description);
+                   });
+  QObject::connect(m_comm, &BLERFComm::disconnectedFromDevice, this,
+                   [&]() { fail("Disconnected from the device"); });
+
+  auto *tuner = m_comm->comm()->connectionTuner();
+  QObject::connect(
+      tuner, &ConnectionTuner::parametersApplied, this,
+      [this](ConnectionTuner::Mode mode,
+             QLowEnergyConnectionParameters const &parameters) {
+        status(QString("Connection parameters (%1): interval %2-%3 ms, "
+                       "latency %4")
+                   .arg(ConnectionTuner::modeName(mode))
+                   .arg(parameters.minimumInterval())
+                   .arg(parameters.maximumInterval())
+                   .arg(parameters.latency()));
+      });
+  QObject::connect(tuner, &ConnectionTuner::effectMeasured, this,
+                   [this](ConnectionTuner::Mode, ConnectionTuner::Sample before,
+                          ConnectionTuner::Sample after) {
+                     status(QString("Throughput %1 -> %2 B/s, write latency "
+                                    "%3 -> %4 us")
+                                .arg(before.bytesPerSecond, 0, 'f', 0)
+                                .arg(after.bytesPerSecond, 0, 'f', 0)
+                                .arg(before.writeLatencyUs, 0, 'f', 0)
+                                .arg(after.writeLatencyUs, 0, 'f', 0));
+                   });
+}
+
+void HeadlessSession::start() {
+#ifdef Q_OS_WIN
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  m_stdout.open(stdout, QIODevice::WriteOnly);
+
+  m_comm->setServiceUuid(m_options.serviceUuid);
+  m_comm->setCharUuid(m_options.charUuid);
+  m_comm->setExtendedFramingEnabled(m_options.extendedFraming);
+  m_comm->setReliableDeliveryEnabled(m_options.reliableDelivery);
+  m_comm->setCompressionEnabled(m_options.compression);
+  m_comm->setBulkCharUuids(m_options.bulkCharUuids);
+  m_comm->comm()->setConnectionProfiles(m_options.connectionProfiles);
+
+  if (!m_options.bridge.isEmpty()) {
+    m_bridge = new LinkBridge{m_comm, this};
+    if (!m_bridge->listen(m_options.bridge)) {
+      fail(QString("Cannot open the bridge: %1").arg(m_bridge->errorString()));
+      return;
+    }
+    // clients need to know where to go, verbose or not
+    warn(QString("Bridge on %1").arg(m_bridge->endpoint()));
+    QObject::connect(m_bridge, &LinkBridge::clientConnected, this,
+                     [this]() { status("Bridge client connected"); });
+    QObject::connect(m_bridge, &LinkBridge::clientDisconnected, this,
+                     [this]() { status("Bridge client disconnected"); });
+  }
+
+  m_connectTimer->start(m_options.connectTimeoutMs);
+
+  if (m_options.simulate) {
+    m_comm->setTransport(new SimulatedTransport{});
+    connectToDevice(QBluetoothDeviceInfo{QBluetoothAddress{}, "Simulated", 0});
+    return;
+  }
+
+  m_cache = std::make_shared<DeviceCache>();
+  m_cache->load();
+  m_comm->setDeviceCache(m_cache);
+
+  // known devices don't need a scan
+  QBluetoothAddress const address{m_options.device};
+  if (!address.isNull()) {
+    auto const cached = m_cache->find(address);
+    if (cached && cached->serviceUuid == m_options.serviceUuid) {
+      connectToDevice(cached->deviceInfo());
+      return;
+    }
+  }
+
+  BLEScanner::Filter filter{};
+  filter.stopOnFirstMatch = true;
+  if (!address.isNull()) {
+    filter.address = address;
+  } else if (!m_options.device.isEmpty()) {
+    filter.namePattern = QRegularExpression{
+        QRegularExpression::anchoredPattern(
+            QRegularExpression::escape(m_options.device))};
+  } else {
+    filter.serviceUuids.append(m_options.serviceUuid);
+  }
+
+  status("Scanning...");
+  m_scanner->scanFor(filter, m_options.connectTimeoutMs);
+}
+
+void HeadlessSession::handleScanCompleted(int devicesFound) {
+  if (devicesFound == 0) {
+    fail("No matching device found");
+    return;
+  }
+  connectToDevice(m_scanner->deviceList().front());
+}
+
+void HeadlessSession::connectToDevice(QBluetoothDeviceInfo const &device) {
+  status(QString("Connecting to %1 (%2)...")
+             .arg(device.name(), device.address().toString()));
+  m_comm->connectToDevice(device);
+}
+
+void HeadlessSession::handleReady() {
+  m_connectTimer->stop();
+  status(QString("Ready, messages up to %1 bytes")
+             .arg(m_comm->maximumMessageSize()));
+  if (m_bridge == nullptr) {
+    startReading();
+  }
+}
+
+void HeadlessSession::startReading() {
+  if (m_reading) {
+    sendPendingInput();
+    return;
+  }
+  m_reading = true;
+
+  auto *thread = new QThread{};
+  thread->setObjectName("stdin");
+  m_reader = new StdinReader{};
+  m_reader->moveToThread(thread);
+
+  QObject::connect(thread, &QThread::started, m_reader, &StdinReader::run);
+  QObject::connect(m_reader, &StdinReader::dataRead, this,
+                   &HeadlessSession::handleInput);
+  QObject::connect(m_reader, &StdinReader::endOfInput, this,
+                   &HeadlessSession::handleEndOfInput);
+  thread->start();
+}
+
+void HeadlessSession::handleInput(QByteArray const &data) {
+  m_input.append(data);
+  m_chunksHeld++;
+  sendPendingInput();
+}
+
+void HeadlessSession::handleEndOfInput() {
+  m_inputEnded = true;
+  status("End of input");
+  sendPendingInput();
+}
+
+void HeadlessSession::sendPendingInput() {
+  if (m_finished || !m_comm->isDeviceReady()) {
+    return;
+  }
+
+  QByteArray message{};
+  int consumed{0};
+  while (peekMessage(message, consumed)) {
+    if (message.size() > m_comm->maximumMessageSize()) {
+      warn(QString("Dropping a %1 byte message, the limit is %2")
+               .arg(message.size())
+               .arg(m_comm->maximumMessageSize()));
+      m_droppedMessages++;
+    } else if (m_comm->sendData(message) == 0) {
+      // queue full - picked up again once a message has been sent
+      return;
+    }
+    m_input.remove(0, consumed);
+  }
+
+  // whatever is left isn't a complete message, more input is needed
+  if (m_chunksHeld > 0) {
+    m_reader->release(m_chunksHeld);
+    m_chunksHeld = 0;
+  }
+
+  finishWhenDone();
+}
+
+bool HeadlessSession::peekMessage(QByteArray &message, int &consumed) const {
+  if (m_options.framing == Framing::Raw) {
+    if (m_input.isEmpty()) {
+      return false;
+    }
+    consumed = std::min(m_input.size(), m_comm->maximumMessageSize());
+    message = m_input.left(consumed);
+    return true;
+  }
+
+  if (m_input.size() < LengthPrefixSize) {
+    return false;
+  }
+  int const size = static_cast<quint8>(m_input[0]) |
+                   (static_cast<quint8>(m_input[1]) << 8);
+  if (m_input.size() < LengthPrefixSize + size) {
+    return false;
+  }
+  consumed = LengthPrefixSize + size;
+  message = m_input.mid(LengthPrefixSize, size);
+  return true;
+}
+
+void HeadlessSession::writeMessage(QByteArray const &message) {
+  if (m_bridge != nullptr) {
+    return;
+  }
+  if (m_options.framing == Framing::LengthPrefixed) {
+    char const prefix[]{static_cast<char>(message.size() & 0xFF),
+                        static_cast<char>((message.size() >> 8) & 0xFF)};
+    m_stdout.write(prefix, LengthPrefixSize);
+  }
+  m_stdout.write(message);
+
+  // one flush for everything received in this round of the event loop
+  if (!m_flushScheduled) {
+    m_flushScheduled = true;
+    QTimer::singleShot(0, this, [this]() {
+      m_flushScheduled = false;
+      m_stdout.flush();
+    });
+  }
+}
+
+void HeadlessSession::finishWhenDone() {
+  if (!m_inputEnded || m_comm->queuedMessages() > 0) {
+    return;
+  }
+  if (!m_input.isEmpty()) {
+    status(QString("Ignoring %1 bytes of incomplete message at the end")
+               .arg(m_input.size()));
+    m_input.clear();
+  }
+
+  // replies might still be on their way
+  int const exitCode = m_droppedMessages == 0 ? 0 : 1;
+  QTimer::singleShot(m_options.lingerMs, this,
+                     [this, exitCode]() { finish(exitCode); });
+  m_inputEnded = false;
+}
+
+void HeadlessSession::fail(QString const &reason) {
+  if (m_finished) {
+    return;
+  }
+  warn(reason);
+  finish(1);
+}
+
+void HeadlessSession::finish(int exitCode) {
+  if (m_finished) {
+    return;
+  }
+  m_finished = true;
+
+  m_connectTimer->stop();
+  m_scanner->stop();
+  m_stdout.flush();
+  if (m_droppedMessages > 0) {
+    warn(QString("%1 messages could not be sent").arg(m_droppedMessages));
+  }
+  m_comm->disconnectFromDevice();
+  emit finished(exitCode);
+}
+
+void HeadlessSession::status(QString const &text) {
+  if (m_options.verbose) {
+    warn(text);
+  }
+}
+
+void HeadlessSession::warn(QString const &text) {
+  QTextStream{stderr} << text << "\n";
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+#include "blerfcomm.hpp"
+#include "blescanner.hpp"
+#include "devicecache.hpp"
+#include "linkbridge.hpp"
+
+// Reads stdin on its own thread, since there's no portable way to wait for
+// it in the event loop. Stays ahead of the consumer by at most
+// MaxChunksAhead chunks, which the consumer hands back with release().
+class StdinReader : public QObject
+{
+  Q_OBJECT
+
+ public:
+  static constexpr int ChunkSize{4096};
+  static constexpr int MaxChunksAhead{8};
+
+  void release(int chunks);
+
+ public slots:
+  // Blocks until the end of the input.
+  void run();
+
+ signals:
+  void dataRead(QByteArray const& data);
+  void endOfInput();
+
+ private:
+  QSemaphore m_credits{MaxChunksAhead};
+};
+
+// Terminal without the UI: connects to one device, sends everything that
+// comes in on stdin and writes every received message to stdout. Ends once
+// stdin is closed and everything has been sent (and the linger time has
+// passed), or as soon as something goes wrong. Status goes to stderr.
+// With a bridge, clients of the bridge take the place of stdin and stdout,
+// and the session goes on until the link drops.
+class HeadlessSession : public QObject
+{
+  Q_OBJECT
+
+ public:
+  // Raw: stdin is sent in messages as large as possible, as it comes, and
+  // received messages are written out back to back.
+  // LengthPrefixed: every message, both ways, is preceded by its length as
+  // 16 bit little endian.
+  enum class Framing { Raw, LengthPrefixed };
+
+  struct Options {
+    // address or exact name; the first device with the service if empty
+    QString device{};
+    QBluetoothUuid serviceUuid{};
+    QBluetoothUuid charUuid{};
+    Framing framing{Framing::Raw};
+    bool extendedFraming{false};
+    bool reliableDelivery{false};
+    bool compression{false};
+    // characteristics to stripe bulk data over, next to charUuid
+    QList<QBluetoothUuid> bulkCharUuids{};
+    ConnectionProfiles connectionProfiles{};
+    // for scanning plus connecting
+    int connectTimeoutMs{10000};
+    // how long to keep receiving after everything has been sent
+    int lingerMs{0};
+    // serve the link on a socket or terminal (see LinkBridge::listen)
+    // instead of stdin and stdout
+    QString bridge{};
+    // talk to an in-process echo peripheral instead of a real device
+    bool simulate{false};
+    bool verbose{false};
+  };
+
+  explicit HeadlessSession(Options options, QObject* parent = nullptr);
+
+  void start();
+
+ signals:
+  void finished(int exitCode);
+
+ private slots:
+  void handleInput(QByteArray const& data);
+  void handleEndOfInput();
+  void handleReady();
+  void handleScanCompleted(int devicesFound);
+
+ private:
+  void connectToDevice(QBluetoothDeviceInfo const& device);
+  void startReading();
+  void sendPendingInput();
+  // Next complete message at the front of the input and how many bytes of
+  // the input it takes, if there is one.
+  bool peekMessage(QByteArray& message, int& consumed) const;
+  void writeMessage(QByteArray const& message);
+  void finishWhenDone();
+  void fail(QString const& reason);
+  void finish(int exitCode);
+  // only with verbose set
+  void status(QString const& text);
+  void warn(QString const& text);
+
+  Options m_options;
+  BLEScanner* m_scanner{nullptr};
+  BLERFComm* m_comm{nullptr};
+  std::shared_ptr<DeviceCache> m_cache{};
+  LinkBridge* m_bridge{nullptr};
+  QTimer* m_connectTimer{nullptr};
+
+  // never deleted, it may stay blocked on stdin until the process exits
+  StdinReader* m_reader{nullptr};
+  QByteArray m_input{};
+  int m_chunksHeld{0};
+  bool m_reading{false};
+  bool m_inputEnded{false};
+  int m_droppedMessages{0};
+
+  QFile m_stdout{};
+  bool m_flushScheduled{false};
+  bool m_finished{false};
+};
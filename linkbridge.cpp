@@ -0,0 +1,274 @@
+#include "linkbridge.hpp"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "pseudoterminal.hpp"
+
+LinkBridge::LinkBridge(BLERFComm* comm, QObject* parent)
+    : QObject{parent}, m_comm{comm} {
+  QObject::connect(m_comm, &BLERFComm::dataReceived, this,
+                   &LinkBridge::forwardToClient);
+
+  // everything that makes room in the transmit queue resumes reading
+  QObject::connect(m_comm, &BLERFComm::deviceReady, this,
+                   &LinkBridge::forwardToLink);
+  QObject::connect(m_comm, &BLERFComm::messageSent, this,
+                   &LinkBridge::forwardToLink);
+  QObject::connect(m_comm, &BLERFComm::messageDropped, this,
+                   &LinkBridge::forwardToLink);
+  QObject::connect(m_comm, &BLERFComm::congestionChanged, this,
+                   [this](bool congested) {
+                     if (!congested) {
+                       forwardToLink();
+                     }
+                   });
+}
+
+LinkBridge::~LinkBridge() { close(); }
+
+auto LinkBridge::listenTcp(QHostAddress const& address, quint16 port)
+    -> bool {
+  close();
+
+  m_tcpServer = new QTcpServer{this};
+  if (!m_tcpServer->listen(address, port)) {
+    m_error = m_tcpServer->errorString();
+    close();
+    return false;
+  }
+
+  QObject::connect(m_tcpServer, &QTcpServer::newConnection, this,
+                   &LinkBridge::handleNewTcpConnection);
+  m_kind = Kind::Tcp;
+  return true;
+}
+
+auto LinkBridge::listenLocal(QString const& name) -> bool {
+  close();
+
+  // left behind by a process that didn't get to clean up
+  QLocalServer::removeServer(name);
+  m_localServer = new QLocalServer{this};
+  if (!m_localServer->listen(name)) {
+    m_error = m_localServer->errorString();
+    close();
+    return false;
+  }
+
+  QObject::connect(m_localServer, &QLocalServer::newConnection, this,
+                   &LinkBridge::handleNewLocalConnection);
+  m_kind = Kind::Local;
+  return true;
+}
+
+auto LinkBridge::openPty() -> bool {
+  close();
+
+  m_pty = new PseudoTerminal{this};
+  if (!m_pty->open(QIODevice::ReadWrite)) {
+    m_error = m_pty->errorString();
+    close();
+    return false;
+  }
+
+  // the terminal is there for whoever opens it, there's no connecting
+  m_kind = Kind::Pty;
+  attachClient(m_pty);
+  return true;
+}
+
+auto LinkBridge::listen(QString const& spec) -> bool {
+  if (spec == "pty") {
+    return openPty();
+  }
+  if (spec.startsWith("local:")) {
+    return listenLocal(spec.mid(6));
+  }
+  if (!spec.startsWith("tcp:")) {
+    m_error = QString("Unknown bridge %1").arg(spec);
+    return false;
+  }
+
+  auto const address = spec.mid(4);
+  auto const colon = address.lastIndexOf(':');
+  QHostAddress host{QHostAddress::LocalHost};
+  if (colon >= 0) {
+    auto hostName = address.left(colon);
+    if (hostName.startsWith('[') && hostName.endsWith(']')) {
+      hostName = hostName.mid(1, hostName.size() - 2);
+    }
+    if (!host.setAddress(hostName)) {
+      m_error = QString("Invalid address %1").arg(hostName);
+      return false;
+    }
+  }
+
+  bool ok{false};
+  auto const port = address.mid(colon + 1).toUShort(&ok);
+  if (!ok) {
+    m_error = QString("Invalid port in %1").arg(spec);
+    return false;
+  }
+  return listenTcp(host, port);
+}
+
+void LinkBridge::close() {
+  detachClient();
+
+  delete m_tcpServer;
+  m_tcpServer = nullptr;
+  delete m_localServer;
+  m_localServer = nullptr;
+  delete m_pty;
+  m_pty = nullptr;
+  m_kind = Kind::None;
+}
+
+auto LinkBridge::kind() const -> Kind { return m_kind; }
+
+auto LinkBridge::endpoint() const -> QString {
+  switch (m_kind) {
+    case Kind::Tcp:
+      return QString("%1:%2")
+          .arg(m_tcpServer->serverAddress().toString())
+          .arg(m_tcpServer->serverPort());
+    case Kind::Local:
+      return m_localServer->fullServerName();
+    case Kind::Pty:
+      return m_pty->slavePath();
+    default:
+      return {};
+  }
+}
+
+auto LinkBridge::hasClient() const -> bool { return !m_client.isNull(); }
+
+auto LinkBridge::errorString() const -> QString { return m_error; }
+
+auto LinkBridge::bytesFromClient() const -> quint64 {
+  return m_bytesFromClient;
+}
+
+auto LinkBridge::bytesToClient() const -> quint64 { return m_bytesToClient; }
+
+auto LinkBridge::bytesDropped() const -> quint64 { return m_bytesDropped; }
+
+void LinkBridge::handleNewTcpConnection() {
+  while (auto* socket = m_tcpServer->nextPendingConnection()) {
+    if (m_client) {
+      socket->abort();
+      socket->deleteLater();
+      continue;
+    }
+
+    // stop taking data off the kernel once this much is waiting
+    socket->setReadBufferSize(ReadBufferSize);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    QObject::connect(socket, &QTcpSocket::disconnected, this,
+                     &LinkBridge::handleClientGone);
+    attachClient(socket);
+  }
+}
+
+void LinkBridge::handleNewLocalConnection() {
+  while (auto* socket = m_localServer->nextPendingConnection()) {
+    if (m_client) {
+      socket->abort();
+      socket->deleteLater();
+      continue;
+    }
+
+    socket->setReadBufferSize(ReadBufferSize);
+    QObject::connect(socket, &QLocalSocket::disconnected, this,
+                     &LinkBridge::handleClientGone);
+    attachClient(socket);
+  }
+}
+
+void LinkBridge::handleClientGone() {
+  if (sender() != m_client.data()) {
+    return;
+  }
+  m_clientClosing = true;
+  forwardToLink();
+}
+
+void LinkBridge::forwardToLink() {
+  if (!m_client) {
+    return;
+  }
+  if (!m_comm->isDeviceReady()) {
+    // nothing more is coming, and nothing can be sent for now
+    if (m_clientClosing) {
+      detachClient();
+    }
+    return;
+  }
+
+  while (!m_comm->isCongested()) {
+    int const maxSize = m_comm->maximumMessageSize();
+    if (m_pending.isEmpty()) {
+      m_pending = m_client->read(maxSize);
+      if (m_pending.isEmpty()) {
+        if (m_clientClosing) {
+          detachClient();
+        }
+        return;
+      }
+      m_bytesFromClient += static_cast<quint64>(m_pending.size());
+    }
+
+    // the limit can shrink when reconnecting to a peer without extended
+    // framing
+    auto const message =
+        m_pending.size() > maxSize ? m_pending.left(maxSize) : m_pending;
+    if (m_comm->sendData(message) == 0) {
+      // queue full - picked up again once a message has been sent
+      return;
+    }
+    m_pending.remove(0, message.size());
+  }
+}
+
+void LinkBridge::forwardToClient(QByteArray const& data) {
+  if (!m_client) {
+    return;
+  }
+
+  if (m_client->bytesToWrite() > MaxClientBacklog) {
+    m_bytesDropped += static_cast<quint64>(data.size());
+    emit dataDropped(data.size());
+    return;
+  }
+
+  m_client->write(data);
+  m_bytesToClient += static_cast<quint64>(data.size());
+}
+
+void LinkBridge::attachClient(QIODevice* client) {
+  m_client = client;
+  m_clientClosing = false;
+  m_pending.clear();
+  QObject::connect(client, &QIODevice::readyRead, this,
+                   &LinkBridge::forwardToLink);
+  emit clientConnected();
+  forwardToLink();
+}
+
+void LinkBridge::detachClient() {
+  if (!m_client) {
+    return;
+  }
+
+  m_client->disconnect(this);
+  if (m_client.data() != m_pty) {
+    m_client->deleteLater();
+  }
+  m_client = nullptr;
+  m_clientClosing = false;
+  m_pending.clear();
+  emit clientDisconnected();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <QByteArray>
+#include <QHostAddress>
+#include <QIODevice>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+#include "blerfcomm.hpp"
+
+class QLocalServer;
+class QTcpServer;
+class PseudoTerminal;
+
+// Exposes the link of a BLERFComm to other processes as a local TCP socket, a
+// local (Unix domain) socket or a pseudo-terminal, so tools that speak TCP
+// or serial can talk to the device. The bridge is a byte stream like a
+// serial port: what the client writes is sent in messages as large as the
+// link allows, and every received message is written to the client as it
+// is.
+//
+// The client is only read while the transmit queue isn't congested, so it
+// can't write faster than the link sends - the rest waits in the socket or
+// terminal and eventually blocks the writer. One client at a time; others
+// are turned away while it's connected. The bridge must live on the thread
+// of the BLERFComm.
+class LinkBridge : public QObject
+{
+  Q_OBJECT
+
+ public:
+  enum class Kind { None, Tcp, Local, Pty };
+  Q_ENUM(Kind)
+
+  // bytes read ahead from a socket client at most
+  static constexpr int ReadBufferSize{16 * 1024};
+  // received messages are dropped while the client has this much unread
+  static constexpr qint64 MaxClientBacklog{1024 * 1024};
+
+  explicit LinkBridge(BLERFComm* comm, QObject* parent = nullptr);
+  ~LinkBridge() override;
+
+  auto listenTcp(QHostAddress const& address, quint16 port) -> bool;
+  // A name or path; see QLocalServer::listen.
+  auto listenLocal(QString const& name) -> bool;
+  auto openPty() -> bool;
+  // "tcp:[host:]port", "local:name" or "pty"; TCP listens on localhost
+  // unless told otherwise.
+  auto listen(QString const& spec) -> bool;
+  void close();
+
+  auto kind() const -> Kind;
+  // Where clients connect: address and port, socket path or terminal path.
+  auto endpoint() const -> QString;
+  auto hasClient() const -> bool;
+  auto errorString() const -> QString;
+  auto bytesFromClient() const -> quint64;
+  auto bytesToClient() const -> quint64;
+  auto bytesDropped() const -> quint64;
+
+ signals:
+  void clientConnected();
+  void clientDisconnected();
+  // Received data the client didn't keep up with.
+  void dataDropped(int bytes);
+
+ private slots:
+  void handleNewTcpConnection();
+  void handleNewLocalConnection();
+  void handleClientGone();
+  void forwardToLink();
+  void forwardToClient(QByteArray const& data);
+
+ private:
+  void attachClient(QIODevice* client);
+  void detachClient();
+
+  BLERFComm* m_comm{nullptr};
+  Kind m_kind{Kind::None};
+  QTcpServer* m_tcpServer{nullptr};
+  QLocalServer* m_localServer{nullptr};
+  PseudoTerminal* m_pty{nullptr};
+  QPointer<QIODevice> m_client{};
+  QString m_error{};
+
+  // read from the client but not accepted by the transmit queue yet
+  QByteArray m_pending{};
+  // the client went away, but what it wrote is still being sent
+  bool m_clientClosing{false};
+
+  quint64 m_bytesFromClient{0};
+  quint64 m_bytesToClient{0};
+  quint64 m_bytesDropped{0};
+};
@@ -0,0 +1,238 @@
+#include "linkmetrics.hpp"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// percentiles reported by the JSON and CSV dumps
+constexpr double DumpedPercentiles[]{0.5, 0.9, 0.99};
+
+auto percentileName(double p) -> QString {
+  return QString("p%1").arg(static_cast<int>(std::round(p * 100)));
+}
+
+}  // namespace
+
+auto LinkMetrics::Snapshot::counter(Counter counter) const -> quint64 {
+  return counters[counter];
+}
+
+auto LinkMetrics::Snapshot::count(Histogram histogram) const -> quint64 {
+  quint64 total{0};
+  for (auto const bucket : buckets[histogram]) {
+    total += bucket;
+  }
+  return total;
+}
+
+auto LinkMetrics::Snapshot::mean(Histogram histogram) const -> double {
+  auto const samples = count(histogram);
+  if (samples == 0) {
+    return 0.0;
+  }
+  return static_cast<double>(sums[histogram]) / static_cast<double>(samples);
+}
+
+auto LinkMetrics::Snapshot::percentile(Histogram histogram, double p) const
+    -> quint64 {
+  auto const samples = count(histogram);
+  if (samples == 0) {
+    return 0;
+  }
+
+  auto rank = static_cast<quint64>(
+      std::ceil(std::clamp(p, 0.0, 1.0) * static_cast<double>(samples)));
+  rank = std::max<quint64>(rank, 1);
+
+  quint64 seen{0};
+  for (int bucket = 0; bucket < BucketCount; bucket++) {
+    seen += buckets[histogram][bucket];
+    if (seen >= rank) {
+      return bucketUpperBound(bucket);
+    }
+  }
+  return bucketUpperBound(BucketCount - 1);
+}
+
+auto LinkMetrics::Snapshot::toJson() const -> QJsonObject {
+  QJsonObject json{};
+  json["timestamp"] = timestamp;
+
+  QJsonObject counterValues{};
+  for (int i = 0; i < CounterCount; i++) {
+    auto const id = static_cast<Counter>(i);
+    counterValues[counterName(id)] = static_cast<qint64>(counter(id));
+  }
+  json["counters"] = counterValues;
+
+  QJsonObject histograms{};
+  for (int i = 0; i < HistogramCount; i++) {
+    auto const id = static_cast<Histogram>(i);
+    QJsonObject histogram{};
+    histogram["count"] = static_cast<qint64>(count(id));
+    histogram["mean"] = mean(id);
+    for (auto const p : DumpedPercentiles) {
+      histogram[percentileName(p)] = static_cast<qint64>(percentile(id, p));
+    }
+
+    // trailing empty buckets are left out
+    int used = BucketCount;
+    while (used > 0 && buckets[id][used - 1] == 0) {
+      used--;
+    }
+    QJsonArray bucketValues{};
+    for (int bucket = 0; bucket < used; bucket++) {
+      bucketValues.append(static_cast<qint64>(buckets[id][bucket]));
+    }
+    histogram["buckets"] = bucketValues;
+
+    histograms[histogramName(id)] = histogram;
+  }
+  json["histograms"] = histograms;
+
+  return json;
+}
+
+auto LinkMetrics::Snapshot::toCsv() const -> QString {
+  QStringList columns{QString::number(timestamp)};
+  for (int i = 0; i < CounterCount; i++) {
+    columns.append(QString::number(counter(static_cast<Counter>(i))));
+  }
+  for (int i = 0; i < HistogramCount; i++) {
+    auto const id = static_cast<Histogram>(i);
+    columns.append(QString::number(count(id)));
+    columns.append(QString::number(mean(id), 'f', 1));
+    for (auto const p : DumpedPercentiles) {
+      columns.append(QString::number(percentile(id, p)));
+    }
+  }
+  return columns.join(',');
+}
+
+auto LinkMetrics::Snapshot::csvHeader() -> QString {
+  QStringList columns{"timestamp"};
+  for (int i = 0; i < CounterCount; i++) {
+    columns.append(counterName(static_cast<Counter>(i)));
+  }
+  for (int i = 0; i < HistogramCount; i++) {
+    QString const name = histogramName(static_cast<Histogram>(i));
+    columns.append(name + "_count");
+    columns.append(name + "_mean");
+    for (auto const p : DumpedPercentiles) {
+      columns.append(name + '_' + percentileName(p));
+    }
+  }
+  return columns.join(',');
+}
+
+auto LinkMetrics::snapshot() const -> Snapshot {
+  Snapshot snapshot{};
+  snapshot.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+  // not a consistent cut across all values, which doesn't matter for
+  // monotonic counters read at intervals
+  for (int i = 0; i < CounterCount; i++) {
+    snapshot.counters[i] = m_counters[i].load(std::memory_order_relaxed);
+  }
+  for (int i = 0; i < HistogramCount; i++) {
+    for (int bucket = 0; bucket < BucketCount; bucket++) {
+      snapshot.buckets[i][bucket] =
+          m_buckets[i][bucket].load(std::memory_order_relaxed);
+    }
+    snapshot.sums[i] = m_sums[i].load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void LinkMetrics::reset() {
+  for (auto& counter : m_counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+  for (auto& histogram : m_buckets) {
+    for (auto& bucket : histogram) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+  for (auto& sum : m_sums) {
+    sum.store(0, std::memory_order_relaxed);
+  }
+}
+
+auto LinkMetrics::counterName(Counter counter) -> char const* {
+  switch (counter) {
+    case BytesWritten:
+      return "bytes_written";
+    case BytesDropped:
+      return "bytes_dropped";
+    case WritesCompleted:
+      return "writes_completed";
+    case WritesDropped:
+      return "writes_dropped";
+    case NotificationsReceived:
+      return "notifications_received";
+    case BytesReceived:
+      return "bytes_received";
+    case FramesReceived:
+      return "frames_received";
+    case MessagesQueued:
+      return "messages_queued";
+    case MessagesRejected:
+      return "messages_rejected";
+    case MessagesSent:
+      return "messages_sent";
+    case MessagesDropped:
+      return "messages_dropped";
+    case ConnectionErrors:
+      return "connection_errors";
+    case LinkLosses:
+      return "link_losses";
+    case ReconnectAttempts:
+      return "reconnect_attempts";
+    case Retransmissions:
+      return "retransmissions";
+    case CorruptPackets:
+      return "corrupt_packets";
+    case CompressedMessages:
+      return "compressed_messages";
+    case CompressionSavedBytes:
+      return "compression_saved_bytes";
+    case UndecodableMessages:
+      return "undecodable_messages";
+    case ConnectionUpdates:
+      return "connection_updates";
+    case SkippedStripes:
+      return "skipped_stripes";
+    case CounterCount:
+      break;
+  }
+  return "unknown";
+}
+
+auto LinkMetrics::histogramName(Histogram histogram) -> char const* {
+  switch (histogram) {
+    case WriteLatency:
+      return "write_latency_us";
+    case ReassemblyTime:
+      return "reassembly_time_us";
+    case NotificationsPerFrame:
+      return "notifications_per_frame";
+    case HistogramCount:
+      break;
+  }
+  return "unknown";
+}
+
+auto LinkMetrics::bucketUpperBound(int bucket) -> quint64 {
+  if (bucket <= 0) {
+    return 0;
+  }
+  // the last bucket is open-ended, its lower bound is the best we know
+  if (bucket >= BucketCount - 1) {
+    return quint64{1} << (BucketCount - 2);
+  }
+  return (quint64{1} << bucket) - 1;
+}
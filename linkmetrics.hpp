@@ -0,0 +1,100 @@
+#pragma once
+#include <QJsonObject>
+#include <QString>
+#include <QtAlgorithms>
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+// Always-on counters and histograms of one link, filled from the TX/RX paths
+// of BLEComm and BLERFComm. Recording an event is a relaxed atomic add or
+// two, so the metrics can be read from any thread while the link runs.
+// Histograms have fixed power-of-two buckets: bucket 0 holds zeros, bucket n
+// the values in [2^(n-1), 2^n), the last one everything above.
+class LinkMetrics
+{
+ public:
+  enum Counter {
+    BytesWritten,
+    BytesDropped,
+    WritesCompleted,
+    WritesDropped,
+    NotificationsReceived,
+    BytesReceived,
+    FramesReceived,
+    MessagesQueued,
+    MessagesRejected,
+    MessagesSent,
+    MessagesDropped,
+    ConnectionErrors,
+    LinkLosses,
+    ReconnectAttempts,
+    Retransmissions,
+    CorruptPackets,
+    CompressedMessages,
+    CompressionSavedBytes,
+    UndecodableMessages,
+    ConnectionUpdates,
+    SkippedStripes,
+    CounterCount
+  };
+
+  enum Histogram {
+    // microseconds from issuing a write to its completion
+    WriteLatency,
+    // microseconds from the first notification of a frame to the last one
+    ReassemblyTime,
+    NotificationsPerFrame,
+    HistogramCount
+  };
+
+  static constexpr int BucketCount{32};
+
+  struct Snapshot {
+    // ms since epoch
+    qint64 timestamp{0};
+    std::array<quint64, CounterCount> counters{};
+    std::array<std::array<quint64, BucketCount>, HistogramCount> buckets{};
+    std::array<quint64, HistogramCount> sums{};
+
+    auto counter(Counter counter) const -> quint64;
+    auto count(Histogram histogram) const -> quint64;
+    auto mean(Histogram histogram) const -> double;
+    // Upper bound of the bucket holding the nearest-rank percentile, p in
+    // [0, 1].
+    auto percentile(Histogram histogram, double p) const -> quint64;
+
+    auto toJson() const -> QJsonObject;
+    // One line, without the line break, in the column order of csvHeader().
+    auto toCsv() const -> QString;
+    static auto csvHeader() -> QString;
+  };
+
+  void add(Counter counter, quint64 value = 1) {
+    m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void record(Histogram histogram, quint64 value) {
+    m_buckets[histogram][bucketOf(value)].fetch_add(
+        1, std::memory_order_relaxed);
+    m_sums[histogram].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  auto snapshot() const -> Snapshot;
+  void reset();
+
+  static auto counterName(Counter counter) -> char const*;
+  static auto histogramName(Histogram histogram) -> char const*;
+  static auto bucketUpperBound(int bucket) -> quint64;
+
+  static auto bucketOf(quint64 value) -> int {
+    int const bits = 64 - qCountLeadingZeroBits(value);
+    return bits < BucketCount ? bits : BucketCount - 1;
+  }
+
+ private:
+  std::array<std::atomic<quint64>, CounterCount> m_counters{};
+  std::array<std::array<std::atomic<quint64>, BucketCount>, HistogramCount>
+      m_buckets{};
+  std::array<std::atomic<quint64>, HistogramCount> m_sums{};
+};
@@ -0,0 +1,134 @@
+#include "logmodel.hpp"
+
+#include <QDateTime>
+#include <algorithm>
+
+LogModel::LogModel(QObject* parent) : QAbstractListModel{parent} {
+  m_entries.resize(static_cast<std::size_t>(m_capacity));
+}
+
+int LogModel::rowCount(QModelIndex const& parent) const {
+  return parent.isValid() ? 0 : count();
+}
+
+QVariant LogModel::data(QModelIndex const& index, int role) const {
+  if (!index.isValid() || index.row() >= count()) {
+    return QVariant{};
+  }
+
+  auto const& item = entry(index.row());
+  switch (role) {
+    case Qt::DisplayRole:
+    case TextRole:
+      return item.text;
+    case TimestampRole:
+      return item.timestamp;
+    case TimeRole:
+      return QDateTime::fromMSecsSinceEpoch(item.timestamp)
+          .toString("hh:mm:ss.zzz");
+    case DirectionRole:
+      return item.direction;
+    case SeverityRole:
+      return item.severity;
+    default:
+      return QVariant{};
+  }
+}
+
+QHash<int, QByteArray> LogModel::roleNames() const {
+  return {
+      {TextRole, "text"},           {TimestampRole, "timestamp"},
+      {TimeRole, "time"},           {DirectionRole, "direction"},
+      {SeverityRole, "severity"},
+  };
+}
+
+int LogModel::capacity() const { return m_capacity; }
+
+int LogModel::count() const { return m_count; }
+
+LogModel::Entry const& LogModel::entry(int row) const {
+  return m_entries[(m_first + static_cast<std::size_t>(row)) %
+                   m_entries.size()];
+}
+
+void LogModel::setCapacity(int capacity) {
+  capacity = std::max(capacity, 1);
+  if (m_capacity == capacity) {
+    return;
+  }
+
+  // keep the newest entries, in order, at the start of the buffer
+  int const kept = std::min(count(), capacity);
+  std::vector<Entry> entries(static_cast<std::size_t>(capacity));
+  for (int row = 0; row < kept; row++) {
+    entries[static_cast<std::size_t>(row)] = entry(count() - kept + row);
+  }
+
+  bool const shrinks = kept < count();
+  beginResetModel();
+  m_entries = std::move(entries);
+  m_first = 0;
+  m_count = kept;
+  m_capacity = capacity;
+  endResetModel();
+
+  emit capacityChanged(m_capacity);
+  if (shrinks) {
+    emit countChanged(count());
+  }
+}
+
+void LogModel::append(QString const& text, Direction direction,
+                      Severity severity) {
+  std::vector<Entry> entries{};
+  entries.push_back(
+      Entry{QDateTime::currentMSecsSinceEpoch(), direction, severity, text});
+  append(std::move(entries));
+}
+
+void LogModel::append(std::vector<Entry> entries) {
+  if (entries.empty()) {
+    return;
+  }
+
+  // whatever wouldn't survive this batch is not worth inserting
+  if (entries.size() > m_entries.size()) {
+    entries.erase(entries.begin(),
+                  entries.end() - static_cast<std::ptrdiff_t>(m_capacity));
+  }
+
+  int const incoming = static_cast<int>(entries.size());
+  int const overflow = std::max(m_count + incoming - m_capacity, 0);
+  if (overflow > 0) {
+    beginRemoveRows(QModelIndex{}, 0, overflow - 1);
+    m_first = (m_first + static_cast<std::size_t>(overflow)) % m_entries.size();
+    m_count -= overflow;
+    endRemoveRows();
+  }
+
+  beginInsertRows(QModelIndex{}, m_count, m_count + incoming - 1);
+  for (auto& item : entries) {
+    m_entries[(m_first + static_cast<std::size_t>(m_count)) %
+              m_entries.size()] = std::move(item);
+    m_count++;
+  }
+  endInsertRows();
+
+  if (overflow != incoming) {
+    emit countChanged(m_count);
+  }
+}
+
+void LogModel::clear() {
+  if (m_count == 0) {
+    return;
+  }
+
+  beginResetModel();
+  std::fill(m_entries.begin(), m_entries.end(), Entry{});
+  m_first = 0;
+  m_count = 0;
+  endResetModel();
+  emit countChanged(0);
+}
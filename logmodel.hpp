@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QString>
+#include <vector>
+
+// Terminal log kept in a ring buffer of at most capacity entries - the oldest
+// ones are dropped as new ones come in. Meant to be shown in a ListView, so
+// only the visible rows are ever turned into text items.
+class LogModel : public QAbstractListModel
+{
+  Q_OBJECT
+
+  Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY
+                 capacityChanged)
+  Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+ public:
+  enum Direction { Local, Incoming, Outgoing };
+  Q_ENUM(Direction)
+
+  enum Severity { Normal, Info, Warning, Error };
+  Q_ENUM(Severity)
+
+  enum Role {
+    TextRole = Qt::UserRole + 1,
+    TimestampRole,
+    TimeRole,
+    DirectionRole,
+    SeverityRole
+  };
+
+  struct Entry {
+    qint64 timestamp{0};
+    Direction direction{Local};
+    Severity severity{Normal};
+    QString text{};
+  };
+
+  static constexpr int DefaultCapacity{100000};
+
+ private:
+  // always capacity long, rows start at m_first and wrap around
+  std::vector<Entry> m_entries{};
+  std::size_t m_first{0};
+  int m_count{0};
+  int m_capacity{DefaultCapacity};
+
+ public:
+  explicit LogModel(QObject* parent = nullptr);
+
+  int rowCount(QModelIndex const& parent = QModelIndex{}) const override;
+  QVariant data(QModelIndex const& index,
+                int role = Qt::DisplayRole) const override;
+  QHash<int, QByteArray> roleNames() const override;
+
+  int capacity() const;
+  int count() const;
+  Entry const& entry(int row) const;
+
+  // Adds a whole batch with a single row insertion (and removal, if the
+  // buffer overflows), which is much cheaper for the view than one by one.
+  void append(std::vector<Entry> entries);
+
+ public slots:
+  void setCapacity(int capacity);
+  void append(QString const& text, LogModel::Direction direction = Local,
+              LogModel::Severity severity = Info);
+  void clear();
+
+ signals:
+  void capacityChanged(int capacity);
+  void countChanged(int count);
+};
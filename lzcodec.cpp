@@ -0,0 +1,211 @@
+#include "lzcodec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+// the last literals and the shortest input a match may start in, as the
+// format requires
+constexpr int LastLiterals{5};
+constexpr int MatchFindLimit{12};
+constexpr int MaxHashBits{12};
+
+auto load32(uchar const* data) -> quint32 {
+  quint32 value{};
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+auto hash(quint32 value, int bits) -> quint32 {
+  return (value * 2654435761U) >> (32 - bits);
+}
+
+// bytes needed to continue a length that doesn't fit its nibble
+auto extraLengthBytes(int length) -> int {
+  return length >= 15 ? (length - 15) / 255 + 1 : 0;
+}
+
+auto writeLength(uchar* out, int length) -> uchar* {
+  length -= 15;
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = static_cast<uchar>(length);
+  return out;
+}
+
+auto readLength(uchar const*& in, uchar const* end, int limit, int& length)
+    -> bool {
+  uchar byte{255};
+  while (byte == 255) {
+    if (in >= end || length > limit) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  }
+  return true;
+}
+
+// Appends a sequence, without a match when matchLength is 0. Returns
+// nullptr if it doesn't fit.
+auto writeSequence(uchar* out, uchar const* outEnd, uchar const* literals,
+                   int literalLength, int offset, int matchLength) -> uchar* {
+  int const matchCode = matchLength > 0 ? matchLength - LzCodec::MinMatch : 0;
+  int const needed = 1 + extraLengthBytes(literalLength) + literalLength +
+                     (matchLength > 0 ? 2 + extraLengthBytes(matchCode) : 0);
+  if (outEnd - out < needed) {
+    return nullptr;
+  }
+
+  uchar* token = out++;
+  *token = static_cast<uchar>(std::min(literalLength, 15) << 4);
+  if (literalLength >= 15) {
+    out = writeLength(out, literalLength);
+  }
+  if (literalLength > 0) {
+    std::memcpy(out, literals, static_cast<size_t>(literalLength));
+    out += literalLength;
+  }
+
+  if (matchLength > 0) {
+    *out++ = static_cast<uchar>(offset & 0xFF);
+    *out++ = static_cast<uchar>((offset >> 8) & 0xFF);
+    *token |= static_cast<uchar>(std::min(matchCode, 15));
+    if (matchCode >= 15) {
+      out = writeLength(out, matchCode);
+    }
+  }
+  return out;
+}
+}  // namespace
+
+auto LzCodec::compress(char const* data, int size, char* out, int capacity)
+    -> int {
+  if (size < 0 || size > MaxInputSize || capacity <= 0) {
+    return -1;
+  }
+
+  auto const* in = reinterpret_cast<uchar const*>(data);
+  auto* op = reinterpret_cast<uchar*>(out);
+  auto const* const outEnd = op + capacity;
+  int anchor{0};
+
+  if (size > MatchFindLimit) {
+    // positions + 1, 0 for none; a small table for short messages keeps
+    // clearing it cheap
+    int const bits = size < 1024 ? 10 : MaxHashBits;
+    std::array<quint16, 1 << MaxHashBits> table;
+    std::fill_n(table.begin(), 1 << bits, quint16{0});
+
+    int const matchLimit = size - LastLiterals;
+    int const searchLimit = size - MatchFindLimit;
+    int ip{0};
+    while (ip < searchLimit) {
+      // literals alone already take more than there's room for
+      if (ip - anchor >= capacity) {
+        return -1;
+      }
+
+      auto const sequence = load32(in + ip);
+      auto& slot = table[hash(sequence, bits)];
+      int const candidate = slot - 1;
+      slot = static_cast<quint16>(ip + 1);
+      if (candidate < 0 || ip - candidate > MaxOffset ||
+          load32(in + candidate) != sequence) {
+        // skip ahead faster the longer nothing matched
+        ip += 1 + ((ip - anchor) >> 5);
+        continue;
+      }
+
+      int const offset = ip - candidate;
+      int start = ip;
+      while (start > anchor && start - offset > 0 &&
+             in[start - 1] == in[start - 1 - offset]) {
+        start--;
+      }
+      int end = ip + MinMatch;
+      while (end < matchLimit && in[end] == in[end - offset]) {
+        end++;
+      }
+
+      op = writeSequence(op, outEnd, in + anchor, start - anchor, offset,
+                         end - start);
+      if (op == nullptr) {
+        return -1;
+      }
+      anchor = end;
+      ip = end;
+      if (ip - 2 < searchLimit) {
+        table[hash(load32(in + ip - 2), bits)] = static_cast<quint16>(ip - 1);
+      }
+    }
+  }
+
+  op = writeSequence(op, outEnd, in + anchor, size - anchor, 0, 0);
+  if (op == nullptr) {
+    return -1;
+  }
+  return static_cast<int>(op - reinterpret_cast<uchar*>(out));
+}
+
+auto LzCodec::decompress(char const* data, int size, char* out, int outSize)
+    -> bool {
+  auto const* ip = reinterpret_cast<uchar const*>(data);
+  auto const* const inEnd = ip + size;
+  auto* const outStart = reinterpret_cast<uchar*>(out);
+  auto* op = outStart;
+  auto* const outEnd = outStart + outSize;
+
+  while (ip < inEnd) {
+    uchar const token = *ip++;
+
+    int literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(ip, inEnd, outSize, literalLength)) {
+      return false;
+    }
+    if (literalLength > inEnd - ip || literalLength > outEnd - op) {
+      return false;
+    }
+    std::memcpy(op, ip, static_cast<size_t>(literalLength));
+    ip += literalLength;
+    op += literalLength;
+
+    // the last sequence has no match
+    if (ip == inEnd) {
+      return op == outEnd;
+    }
+
+    if (inEnd - ip < 2) {
+      return false;
+    }
+    int const offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op - outStart) {
+      return false;
+    }
+
+    int matchLength = token & 0x0F;
+    if (matchLength == 15 && !readLength(ip, inEnd, outSize, matchLength)) {
+      return false;
+    }
+    matchLength += MinMatch;
+    if (matchLength > outEnd - op) {
+      return false;
+    }
+
+    uchar const* match = op - offset;
+    if (offset >= matchLength) {
+      std::memcpy(op, match, static_cast<size_t>(matchLength));
+      op += matchLength;
+    } else {
+      // overlapping - repeats the last offset bytes
+      for (int i = 0; i < matchLength; i++) {
+        *op++ = *match++;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <QtGlobal>
+
+// LZ4 block format codec for compressed messages. The format needs no
+// dictionary, no state between messages and no memory on the decoding side
+// besides the output, so MCU peers can use any LZ4 implementation (or the
+// 50 lines of decoder it takes) to read and write them.
+//
+// Sequence: | token | literal length+ | literals | offset (16 bit LE) |
+//           | match length+ |
+//
+// The token holds the literal length in its high and the match length - 4
+// in its low nibble; a nibble of 15 is continued in extra bytes, added up
+// until one is below 255. The last sequence has only literals, and covers
+// at least the last 5 bytes.
+namespace LzCodec {
+constexpr int MinMatch{4};
+constexpr int MaxOffset{0xFFFF};
+constexpr int MaxInputSize{0xFFFF};
+
+// Compresses size bytes of data to out and returns the compressed size, or
+// -1 if it doesn't fit in capacity bytes - callers pass the size the result
+// has to stay below to be worth it, so incompressible data is given up on
+// early.
+auto compress(char const* data, int size, char* out, int capacity) -> int;
+// Decompresses a block to exactly size bytes of out. Returns false for
+// blocks that are malformed or don't decompress to size bytes.
+auto decompress(char const* data, int size, char* out, int outSize) -> bool;
+}  // namespace LzCodec
@@ -1,18 +1,223 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
 #include <QString>
+#include <QTextStream>
+#include <QtQml>
+#include <algorithm>
+#include <cstring>
 
+#include "connectiontuner.hpp"
+#include "devicemodel.hpp"
+#include "headlesssession.hpp"
+#include "logmodel.hpp"
+#include "metricsreporter.hpp"
 #include "uicontroller.hpp"
 
+namespace {
+bool isHeadless(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--headless") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 16 bit UUIDs in hex, anything else in the usual string form
+QBluetoothUuid parseUuid(QString const &text) {
+  bool ok{false};
+  auto const shortUuid = text.toUShort(&ok, 16);
+  if (ok && text.size() <= 4) {
+    return QBluetoothUuid{shortUuid};
+  }
+  return QBluetoothUuid{text};
+}
+
+// --connection-profiles, with --adaptive-connection turning adaptation on
+// for every device without a profile of its own.
+bool connectionProfiles(QCommandLineParser const &parser,
+                        ConnectionProfiles &profiles) {
+  if (parser.isSet("connection-profiles")) {
+    QString error{};
+    if (!ConnectionTuner::loadProfiles(parser.value("connection-profiles"),
+                                       profiles, &error)) {
+      QTextStream{stderr} << "Cannot load "
+                          << parser.value("connection-profiles") << ": "
+                          << error << "\n";
+      return false;
+    }
+  }
+  if (parser.isSet("adaptive-connection")) {
+    profiles["default"].adaptive = true;
+  }
+  return true;
+}
+
+// No QML engine and no GUI, so it starts about as fast as the BLE stack
+// itself allows.
+int runHeadless(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  QCommandLineParser parser{};
+  parser.setApplicationDescription(
+      "Sends stdin to a BLE RFComm device and writes whatever it sends to "
+      "stdout.");
+  parser.addHelpOption();
+  parser.addOptions({
+      {"headless", "Run without the UI."},
+      {"device",
+       "Address or name of the device (default: the first one advertising "
+       "the service).",
+       "device"},
+      {"service", "RFComm service UUID.", "uuid"},
+      {"characteristic", "RFComm characteristic UUID.", "uuid"},
+      {"length-prefixed",
+       "Precede every message on stdin and stdout with its length (16 bit "
+       "little endian)."},
+      {"extended-framing", "Allow messages of up to 64 KiB."},
+      {"reliable",
+       "Use acked, checksummed delivery if the device supports it."},
+      {"compress", "Compress messages if the device supports it."},
+      {"bulk-characteristics",
+       "Spread messages over these further characteristics of the service "
+       "if the device supports it (needs --extended-framing).",
+       "uuid,..."},
+      {"adaptive-connection",
+       "Request short connection intervals while data flows and long ones "
+       "while the link is idle."},
+      {"connection-profiles",
+       "Connection parameter policies by device, as a JSON <file>.", "file"},
+      {"timeout", "Give up connecting after this long.", "ms", "10000"},
+      {"linger", "Keep receiving this long after everything has been sent.",
+       "ms", "0"},
+      {"bridge",
+       "Serve the link on tcp:[host:]port, local:<name> or pty instead of "
+       "stdin and stdout.",
+       "bridge"},
+      {"simulate", "Talk to an in-process echo peripheral instead."},
+      {"verbose", "Report progress on stderr."},
+  });
+  parser.process(app);
+
+  HeadlessSession::Options options{};
+  options.device = parser.value("device");
+  options.serviceUuid = parseUuid(parser.value("service"));
+  options.charUuid = parseUuid(parser.value("characteristic"));
+  options.framing = parser.isSet("length-prefixed")
+                        ? HeadlessSession::Framing::LengthPrefixed
+                        : HeadlessSession::Framing::Raw;
+  options.extendedFraming = parser.isSet("extended-framing");
+  options.reliableDelivery = parser.isSet("reliable");
+  options.compression = parser.isSet("compress");
+  for (auto const &uuid :
+       parser.value("bulk-characteristics").split(',', Qt::SkipEmptyParts)) {
+    options.bulkCharUuids.append(parseUuid(uuid.trimmed()));
+  }
+  options.connectTimeoutMs = std::max(parser.value("timeout").toInt(), 1);
+  options.lingerMs = std::max(parser.value("linger").toInt(), 0);
+  options.bridge = parser.value("bridge");
+  options.simulate = parser.isSet("simulate");
+  options.verbose = parser.isSet("verbose");
+  if (!connectionProfiles(parser, options.connectionProfiles)) {
+    return 2;
+  }
+
+  if (!options.simulate &&
+      (options.serviceUuid.isNull() || options.charUuid.isNull())) {
+    QTextStream{stderr} << "Both --service and --characteristic are needed\n";
+    return 2;
+  }
+
+  HeadlessSession session{options};
+  QObject::connect(&session, &HeadlessSession::finished, &app,
+                   &QCoreApplication::exit, Qt::QueuedConnection);
+  session.start();
+  return app.exec();
+}
+}  // namespace
+
 int main(int argc, char *argv[])
 {
+  if (isHeadless(argc, argv)) {
+    return runHeadless(argc, argv);
+  }
+
 #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
   QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
 #endif
 
   QGuiApplication app(argc, argv);
-  UIController controller{};
+
+  QCommandLineParser parser{};
+  parser.addHelpOption();
+  parser.addOption({"headless", "Run without the UI, see --headless --help."});
+  parser.addOption({"io-thread", "Run the BLE stack on its own thread."});
+  parser.addOption(
+      {"reconnect", "Reconnect automatically when the link drops."});
+  parser.addOption({"reliable",
+                    "Use acked, checksummed delivery with devices that "
+                    "support it."});
+  parser.addOption(
+      {"compress", "Compress messages for devices that support it."});
+  parser.addOption({"adaptive-connection",
+                    "Request short connection intervals while data flows "
+                    "and long ones while the link is idle."});
+  parser.addOption({"connection-profiles",
+                    "Connection parameter policies by device, as a JSON "
+                    "<file>.",
+                    "file"});
+  parser.addOption({"metrics-file",
+                    "Append link metrics to <file>, as CSV if it ends with "
+                    ".csv, as JSON lines otherwise.",
+                    "file"});
+  parser.addOption({"metrics-interval",
+                    "Sample link metrics every <ms> milliseconds.", "ms",
+                    QString::number(MetricsReporter::DefaultInterval)});
+  parser.addOption({"capture", "Record the raw BLE traffic to <file>.",
+                    "file"});
+  parser.addOption({"replay",
+                    "Play a capture <file> back instead of talking to a "
+                    "device.",
+                    "file"});
+  parser.addOption(
+      {"replay-realtime", "Keep the recorded timing when replaying."});
+  parser.process(app);
+
+  qmlRegisterUncreatableType<DeviceModel>(
+      "BLERFCommTerminal", 1, 0, "DeviceModel",
+      "DeviceModel is provided by uiController");
+  qmlRegisterUncreatableType<LogModel>("BLERFCommTerminal", 1, 0, "LogModel",
+                                       "LogModel is provided by uiController");
+  qmlRegisterUncreatableType<MetricsReporter>(
+      "BLERFCommTerminal", 1, 0, "MetricsReporter",
+      "MetricsReporter is provided by uiController");
+  UIController controller{parser.isSet("io-thread")
+                              ? UIController::IoMode::WorkerThread
+                              : UIController::IoMode::GuiThread};
+  controller.setAutoReconnect(parser.isSet("reconnect"));
+  controller.setReliableDelivery(parser.isSet("reliable"));
+  controller.setCompression(parser.isSet("compress"));
+  ConnectionProfiles profiles{};
+  if (connectionProfiles(parser, profiles)) {
+    controller.setConnectionProfiles(profiles);
+  }
+  controller.metrics()->setInterval(
+      parser.value("metrics-interval").toInt());
+  if (parser.isSet("metrics-file") &&
+      !controller.metrics()->setDumpFile(parser.value("metrics-file"))) {
+    qWarning("Cannot open metrics file %s",
+             qPrintable(parser.value("metrics-file")));
+  }
+  if (parser.isSet("capture")) {
+    controller.startCapture(parser.value("capture"));
+  }
+  if (parser.isSet("replay")) {
+    controller.replayCapture(parser.value("replay"),
+                             parser.isSet("replay-realtime"));
+  }
 
   QQmlApplicationEngine engine;
   const QUrl url(QStringLiteral("qrc:/main.qml"));
@@ -3,6 +3,7 @@ import QtQuick.Window 2.15
 import QtQuick.Controls 2.15
 import QtQuick.Layouts 1.15
 import QtQuick.Controls.Material 2.15
+import BLERFCommTerminal 1.0
 
 ApplicationWindow {
     id: mainWindow
@@ -11,26 +12,33 @@ ApplicationWindow {
     visible: true
     title: qsTr("BLE RFComm terminal")
 
-    function logColor(logText, color) {
-        textAreaLog.text += "<p style='color: %1; margin-top: 0em; margin-bottom: 0em;'>%2</p>".arg(color).arg(logText);
-
-        logAreaFlickable.contentY = textAreaLog.height - logAreaFlickable.height
-    }
+    function logColor(direction, severity) {
+        if (direction === LogModel.Outgoing) {
+            return "#91d184";
+        }
 
-    function log(logText) {
-        logColor(logText, "#dedede");
+        switch (severity) {
+        case LogModel.Info:
+            return Material.color(Material.Blue);
+        case LogModel.Warning:
+            return Material.color(Material.Orange);
+        case LogModel.Error:
+            return Material.color(Material.Red);
+        default:
+            return "#dedede";
+        }
     }
 
     function logInfo(logText) {
-        logColor(logText, Material.color(Material.Blue));
+        uiController.logMessage(logText, LogModel.Info);
     }
 
     function logWarning(logText) {
-        logColor(logText, Material.color(Material.Orange));
+        uiController.logMessage(logText, LogModel.Warning);
     }
 
     function logError(logText) {
-        logColor(logText, Material.color(Material.Red));
+        uiController.logMessage(logText, LogModel.Error);
     }
 
     function sendMessage(message) {
@@ -40,12 +48,11 @@ ApplicationWindow {
                 return;
             }
 
-            if (message.length > 254) {
+            if (message.length > uiController.maximumMessageSize) {
                 logError("Message is too long!");
                 return;
             }
 
-            logColor("ᐅ %1".arg(message), "#91d184");
             uiController.sendMessageToDevice(message);
         }
     }
@@ -62,10 +69,6 @@ ApplicationWindow {
             logError("BLE scan error: %1".arg(error_message));
         }
 
-        function onMessageReceived(message) {
-            log(message);
-        }
-
         function onBleDeviceConnected() {
             logInfo("Connected! Checking if device has specified characteristic...");
             buttonConnect.text = "Disconnect"
@@ -92,14 +95,15 @@ ApplicationWindow {
         anchors.leftMargin: 10
         anchors.topMargin: 10
         anchors.bottomMargin: 10
-        columns: 5
-        rows: 3
+        columns: 6
+        rows: 4
 
         ComboBox {
             id: comboBoxAvailableDevices
             Layout.preferredWidth: 250
             Layout.fillWidth: true
-            model: uiController.bleDeviceDescriptionList
+            model: uiController.devices
+            textRole: "description"
         }
 
         Button {
@@ -115,6 +119,7 @@ ApplicationWindow {
         TextField {
             id: textFieldServiceUUID
             placeholderText: qsTr("Service UUID")
+            text: uiController.serviceUuid === -1 ? "" : uiController.serviceUuid.toString(16).toUpperCase()
             validator: RegularExpressionValidator {
                 regularExpression: /^[0-9a-fA-F]{4}/
             }
@@ -123,11 +128,19 @@ ApplicationWindow {
         TextField {
             id: textFieldCharUUID
             placeholderText: qsTr("Char UUID")
+            text: uiController.charUuid === -1 ? "" : uiController.charUuid.toString(16).toUpperCase()
             validator: RegularExpressionValidator {
                 regularExpression: /^[0-9a-fA-F]{4}/
             }
         }
 
+        CheckBox {
+            id: checkBoxExtendedFraming
+            text: qsTr("Extended framing")
+            checked: uiController.extendedFraming
+            onToggled: uiController.extendedFraming = checked
+        }
+
         Button {
             id: buttonConnect
             text: qsTr("Connect")
@@ -140,12 +153,6 @@ ApplicationWindow {
                     uiController.disconnectFromDevice();
                 } else {
                     // Not connected
-                    // Check if any device is selected
-                    if (comboBoxAvailableDevices.currentIndex === -1) {
-                        logError("Scan for devices and pick one from the list before trying to connect!");
-                        return;
-                    }
-
                     // Set the UUIDs in the backend
                     if (textFieldServiceUUID.text.length > 0) {
                         uiController.setServiceUuid(textFieldServiceUUID.text);
@@ -172,6 +179,14 @@ ApplicationWindow {
                         return;
                     }
 
+                    // Without a picked device, look for the first one with the service
+                    if (comboBoxAvailableDevices.currentIndex === -1) {
+                        logInfo("Looking for a device with service 0x%1...".arg(
+                                    uiController.serviceUuid.toString(16).toUpperCase()));
+                        uiController.connectToFirstDevice();
+                        return;
+                    }
+
                     logInfo("Connecting to device %1 @ service 0x%2, characteristic 0x%3...".arg(
                                 comboBoxAvailableDevices.currentText).arg(
                                 uiController.serviceUuid.toString(16).toUpperCase()).arg(
@@ -181,24 +196,48 @@ ApplicationWindow {
             }
         }
 
-        Flickable {
-            id: logAreaFlickable
-            boundsMovement: Flickable.FollowBoundsBehavior
-            flickableDirection: Flickable.VerticalFlick
-            contentHeight: 0
+        ListView {
+            id: listViewLog
+            // stick to the newest entry unless the user scrolled away
+            property bool followTail: true
+
             Layout.fillWidth: true
             Layout.fillHeight: true
-            Layout.columnSpan: 5
+            Layout.columnSpan: 6
             clip: true
-
-            TextArea.flickable: TextArea {
-                id: textAreaLog
-                wrapMode: TextArea.Wrap
+            boundsBehavior: Flickable.StopAtBounds
+            model: uiController.log
+
+            delegate: Label {
+                width: listViewLog.width
+                text: model.text
+                color: logColor(model.direction, model.severity)
+                textFormat: Text.PlainText
+                wrapMode: Text.Wrap
                 font.hintingPreference: Font.PreferFullHinting
                 font.pointSize: 10
-                textFormat: Text.RichText
-                placeholderText: qsTr("Device log")
-                readOnly: true
+            }
+
+            onMovementEnded: followTail = atYEnd
+
+            Connections {
+                // a full log drops a row for every new one, so the count
+                // alone doesn't tell about new entries
+                target: uiController.log
+
+                function onRowsInserted() {
+                    if (listViewLog.followTail) {
+                        Qt.callLater(listViewLog.positionViewAtEnd);
+                    }
+                }
+            }
+
+            Label {
+                anchors.fill: parent
+                visible: listViewLog.count === 0
+                text: qsTr("Device log")
+                opacity: 0.5
+                font.pointSize: 10
             }
 
             ScrollBar.vertical: ScrollBar {}
@@ -208,11 +247,11 @@ ApplicationWindow {
             id: textFieldMessage
             placeholderText: qsTr("Enter message here")
             Layout.fillWidth: true
-            Layout.columnSpan: 4
+            Layout.columnSpan: 5
             validator: RegularExpressionValidator {
                 regularExpression: /[\x00-\xff]+/
             }
-            maximumLength: 254
+            maximumLength: uiController.maximumMessageSize
 
             onAccepted: {
                 sendMessage(text);
@@ -230,5 +269,22 @@ ApplicationWindow {
                 sendMessage(textFieldMessage.text);
             }
         }
+
+        Label {
+            id: labelLinkMetrics
+            property var metrics: uiController.metrics
+
+            Layout.fillWidth: true
+            Layout.columnSpan: 6
+            opacity: 0.7
+            font.pointSize: 9
+            text: qsTr("TX %1 B/s, RX %2 B/s, write latency p50/p99 %3/%4 us, %5 notifications/frame, %6 errors").arg(
+                      metrics.writeRate.toFixed(0)).arg(
+                      metrics.receiveRate.toFixed(0)).arg(
+                      metrics.writeLatencyP50).arg(
+                      metrics.writeLatencyP99).arg(
+                      metrics.notificationsPerFrame.toFixed(1)).arg(
+                      metrics.errors)
+        }
     }
 }
@@ -0,0 +1,237 @@
+#pragma once
+#include <QByteArray>
+#include <QtGlobal>
+#include <array>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+// Typed messages, declared once as a struct with a message id and a
+// constexpr list of its fields:
+//
+//   struct Telemetry {
+//     static constexpr quint8 MessageId{0x10};
+//     quint32 seq;
+//     float temperature;
+//     MessageSchema::Bytes note;
+//
+//     static constexpr auto fields() {
+//       return MessageSchema::fields(&Telemetry::seq, &Telemetry::temperature,
+//                                    &Telemetry::note);
+//     }
+//   };
+//
+// On the wire a message is its id byte followed by the fields in the order
+// listed, packed and little endian: numbers and enums as they are, bools as
+// one byte, std::arrays element by element and Bytes as a 16 bit length and
+// the bytes. The layout is resolved at compile time, so encoding is a series
+// of stores into the output and decoding one of loads from the input - no
+// allocations, no intermediate buffers. Bytes following the last field are
+// ignored, so peers can append fields to a message without breaking older
+// receivers.
+namespace MessageSchema {
+// Variable length field. Decoded ones point into the buffer they were
+// decoded from and are only valid as long as it is.
+struct Bytes {
+  char const* data{nullptr};
+  int size{0};
+};
+
+template <typename... Members>
+constexpr auto fields(Members... members) -> std::tuple<Members...> {
+  return std::tuple<Members...>{members...};
+}
+
+namespace detail {
+template <std::size_t Size>
+struct UnsignedOf;
+template <>
+struct UnsignedOf<1> {
+  using Type = quint8;
+};
+template <>
+struct UnsignedOf<2> {
+  using Type = quint16;
+};
+template <>
+struct UnsignedOf<4> {
+  using Type = quint32;
+};
+template <>
+struct UnsignedOf<8> {
+  using Type = quint64;
+};
+
+template <typename Member>
+struct MemberTraits;
+template <typename Msg, typename T>
+struct MemberTraits<T Msg::*> {
+  using Type = T;
+};
+template <typename Member>
+using FieldType = typename MemberTraits<Member>::Type;
+
+template <typename T>
+struct Codec {
+  static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>,
+                "fields are numbers, enums, std::arrays of them or Bytes");
+  using Bits = typename UnsignedOf<sizeof(T)>::Type;
+  static constexpr int MinSize{static_cast<int>(sizeof(T))};
+
+  static constexpr auto size(T const&) -> int { return MinSize; }
+
+  static void write(char*& out, T const& value) {
+    Bits bits{};
+    if constexpr (std::is_same_v<T, bool>) {
+      bits = value ? 1 : 0;
+    } else {
+      std::memcpy(&bits, &value, sizeof(T));
+    }
+    for (std::size_t i = 0; i < sizeof(T); i++) {
+      out[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+    }
+    out += sizeof(T);
+  }
+
+  static auto read(char const*& in, char const* end, T& value) -> bool {
+    if (end - in < MinSize) {
+      return false;
+    }
+    Bits bits{0};
+    for (std::size_t i = 0; i < sizeof(T); i++) {
+      bits |= static_cast<Bits>(static_cast<Bits>(static_cast<quint8>(in[i]))
+                                << (8 * i));
+    }
+    if constexpr (std::is_same_v<T, bool>) {
+      value = bits != 0;
+    } else {
+      std::memcpy(&value, &bits, sizeof(T));
+    }
+    in += sizeof(T);
+    return true;
+  }
+};
+
+template <typename T, std::size_t N>
+struct Codec<std::array<T, N>> {
+  static constexpr int MinSize{static_cast<int>(N) * Codec<T>::MinSize};
+
+  static constexpr auto size(std::array<T, N> const& value) -> int {
+    int total{0};
+    for (auto const& element : value) {
+      total += Codec<T>::size(element);
+    }
+    return total;
+  }
+
+  static void write(char*& out, std::array<T, N> const& value) {
+    for (auto const& element : value) {
+      Codec<T>::write(out, element);
+    }
+  }
+
+  static auto read(char const*& in, char const* end, std::array<T, N>& value)
+      -> bool {
+    for (auto& element : value) {
+      if (!Codec<T>::read(in, end, element)) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+template <>
+struct Codec<Bytes> {
+  static constexpr int MinSize{2};
+
+  static constexpr auto size(Bytes const& value) -> int {
+    return MinSize + value.size;
+  }
+
+  static void write(char*& out, Bytes const& value) {
+    Codec<quint16>::write(out, static_cast<quint16>(value.size));
+    if (value.size > 0) {
+      std::memcpy(out, value.data, static_cast<std::size_t>(value.size));
+    }
+    out += value.size;
+  }
+
+  static auto read(char const*& in, char const* end, Bytes& value) -> bool {
+    quint16 size{0};
+    if (!Codec<quint16>::read(in, end, size) || end - in < size) {
+      return false;
+    }
+    value = Bytes{in, size};
+    in += size;
+    return true;
+  }
+};
+
+template <typename Member>
+using FieldCodec = Codec<FieldType<Member>>;
+}  // namespace detail
+
+// Size of the message with every Bytes field empty.
+template <typename Msg>
+constexpr auto minimumSize() -> int {
+  return std::apply(
+      [](auto... members) {
+        return (1 + ... + detail::FieldCodec<decltype(members)>::MinSize);
+      },
+      Msg::fields());
+}
+
+template <typename Msg>
+constexpr auto encodedSize(Msg const& message) -> int {
+  return std::apply(
+      [&](auto... members) {
+        return (1 + ... +
+                detail::FieldCodec<decltype(members)>::size(message.*members));
+      },
+      Msg::fields());
+}
+
+// Writes encodedSize(message) bytes to out and returns the end of them.
+template <typename Msg>
+auto encode(Msg const& message, char* out) -> char* {
+  *out++ = static_cast<char>(Msg::MessageId);
+  std::apply(
+      [&](auto... members) {
+        (detail::FieldCodec<decltype(members)>::write(out, message.*members),
+         ...);
+      },
+      Msg::fields());
+  return out;
+}
+
+template <typename Msg>
+auto encode(Msg const& message) -> QByteArray {
+  QByteArray data{encodedSize(message), Qt::Uninitialized};
+  encode(message, data.data());
+  return data;
+}
+
+template <typename Msg>
+auto matches(char const* data, int size) -> bool {
+  return size > 0 && static_cast<quint8>(data[0]) == Msg::MessageId;
+}
+
+// False if the data is not a Msg or too short for one.
+template <typename Msg>
+auto decode(char const* data, int size, Msg& message) -> bool {
+  if (!matches<Msg>(data, size)) {
+    return false;
+  }
+
+  char const* in = data + 1;
+  char const* const end = data + size;
+  return std::apply(
+      [&](auto... members) {
+        return (detail::FieldCodec<decltype(members)>::read(
+                    in, end, message.*members) &&
+                ...);
+      },
+      Msg::fields());
+}
+}  // namespace MessageSchema
@@ -0,0 +1,154 @@
+#include "metricsreporter.hpp"
+
+#include <QJsonDocument>
+#include <algorithm>
+#include <utility>
+
+MetricsReporter::MetricsReporter(QObject* parent) : QObject{parent} {
+  m_timer = new QTimer{this};
+  m_timer->setInterval(DefaultInterval);
+  QObject::connect(m_timer, &QTimer::timeout, this, &MetricsReporter::sample);
+}
+
+void MetricsReporter::setMetrics(std::shared_ptr<LinkMetrics const> metrics) {
+  m_metrics = std::move(metrics);
+  m_last = m_metrics ? m_metrics->snapshot() : LinkMetrics::Snapshot{};
+  m_writeRate = 0.0;
+  m_receiveRate = 0.0;
+
+  if (m_metrics) {
+    m_timer->start();
+  } else {
+    m_timer->stop();
+  }
+  emit updated();
+}
+
+auto MetricsReporter::setDumpFile(QString const& path) -> bool {
+  if (m_file.isOpen()) {
+    m_file.close();
+  }
+  m_file.setFileName(path);
+
+  bool opened{true};
+  if (!path.isEmpty()) {
+    opened = m_file.open(QIODevice::WriteOnly | QIODevice::Append |
+                         QIODevice::Text);
+    m_csv = path.endsWith(".csv", Qt::CaseInsensitive);
+    if (opened && m_csv && m_file.size() == 0) {
+      m_file.write(LinkMetrics::Snapshot::csvHeader().toUtf8() + '\n');
+      m_file.flush();
+    }
+  }
+
+  emit dumpFileChanged(dumpFile());
+  return opened;
+}
+
+void MetricsReporter::setInterval(int milliseconds) {
+  milliseconds = std::max(milliseconds, 1);
+  if (interval() == milliseconds) {
+    return;
+  }
+
+  m_timer->setInterval(milliseconds);
+  emit intervalChanged(milliseconds);
+}
+
+auto MetricsReporter::interval() const -> int { return m_timer->interval(); }
+
+auto MetricsReporter::dumpFile() const -> QString {
+  return m_file.isOpen() ? m_file.fileName() : QString{};
+}
+
+auto MetricsReporter::lastSnapshot() const -> LinkMetrics::Snapshot const& {
+  return m_last;
+}
+
+auto MetricsReporter::bytesWritten() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::BytesWritten));
+}
+
+auto MetricsReporter::bytesReceived() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::BytesReceived));
+}
+
+auto MetricsReporter::messagesSent() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::MessagesSent));
+}
+
+auto MetricsReporter::messagesDropped() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::MessagesDropped));
+}
+
+auto MetricsReporter::framesReceived() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::FramesReceived));
+}
+
+auto MetricsReporter::errors() const -> qint64 {
+  return static_cast<qint64>(m_last.counter(LinkMetrics::ConnectionErrors) +
+                             m_last.counter(LinkMetrics::WritesDropped));
+}
+
+auto MetricsReporter::writeRate() const -> double { return m_writeRate; }
+
+auto MetricsReporter::receiveRate() const -> double { return m_receiveRate; }
+
+auto MetricsReporter::writeLatencyP50() const -> qint64 {
+  return static_cast<qint64>(m_last.percentile(LinkMetrics::WriteLatency, 0.5));
+}
+
+auto MetricsReporter::writeLatencyP99() const -> qint64 {
+  return static_cast<qint64>(
+      m_last.percentile(LinkMetrics::WriteLatency, 0.99));
+}
+
+auto MetricsReporter::reassemblyTimeP99() const -> qint64 {
+  return static_cast<qint64>(
+      m_last.percentile(LinkMetrics::ReassemblyTime, 0.99));
+}
+
+auto MetricsReporter::notificationsPerFrame() const -> double {
+  return m_last.mean(LinkMetrics::NotificationsPerFrame);
+}
+
+void MetricsReporter::sample() {
+  if (!m_metrics) {
+    return;
+  }
+
+  auto const previous = m_last;
+  m_last = m_metrics->snapshot();
+
+  auto const seconds =
+      static_cast<double>(std::max<qint64>(
+          m_last.timestamp - previous.timestamp, 1)) /
+      1000.0;
+  auto const rate = [&](LinkMetrics::Counter counter) {
+    auto const now = m_last.counter(counter);
+    auto const before = previous.counter(counter);
+    // the metrics might have been reset in between
+    return now >= before ? static_cast<double>(now - before) / seconds : 0.0;
+  };
+  m_writeRate = rate(LinkMetrics::BytesWritten);
+  m_receiveRate = rate(LinkMetrics::BytesReceived);
+
+  emit updated();
+  auto const json = m_last.toJson();
+  emit sampled(json);
+  dump(json);
+}
+
+void MetricsReporter::dump(QJsonObject const& json) {
+  if (!m_file.isOpen()) {
+    return;
+  }
+
+  if (m_csv) {
+    m_file.write(m_last.toCsv().toUtf8() + '\n');
+  } else {
+    m_file.write(QJsonDocument{json}.toJson(QJsonDocument::Compact) + '\n');
+  }
+  // keep the file useful if the process gets killed
+  m_file.flush();
+}
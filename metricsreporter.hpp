@@ -0,0 +1,86 @@
+#pragma once
+#include <QFile>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+#include "linkmetrics.hpp"
+
+// Samples LinkMetrics at a fixed interval. Every sample updates the
+// properties below (readable from QML), is emitted as JSON for external
+// collectors and, with a dump file set, appended to it - as CSV when the
+// file name ends with ".csv", as one JSON object per line otherwise.
+// Rates are per second over the last interval, latencies in microseconds.
+class MetricsReporter : public QObject
+{
+  Q_OBJECT
+
+  Q_PROPERTY(int interval READ interval WRITE setInterval NOTIFY
+                 intervalChanged)
+  Q_PROPERTY(QString dumpFile READ dumpFile NOTIFY dumpFileChanged)
+  Q_PROPERTY(qint64 bytesWritten READ bytesWritten NOTIFY updated)
+  Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY updated)
+  Q_PROPERTY(qint64 messagesSent READ messagesSent NOTIFY updated)
+  Q_PROPERTY(qint64 messagesDropped READ messagesDropped NOTIFY updated)
+  Q_PROPERTY(qint64 framesReceived READ framesReceived NOTIFY updated)
+  Q_PROPERTY(qint64 errors READ errors NOTIFY updated)
+  Q_PROPERTY(double writeRate READ writeRate NOTIFY updated)
+  Q_PROPERTY(double receiveRate READ receiveRate NOTIFY updated)
+  Q_PROPERTY(qint64 writeLatencyP50 READ writeLatencyP50 NOTIFY updated)
+  Q_PROPERTY(qint64 writeLatencyP99 READ writeLatencyP99 NOTIFY updated)
+  Q_PROPERTY(qint64 reassemblyTimeP99 READ reassemblyTimeP99 NOTIFY updated)
+  Q_PROPERTY(double notificationsPerFrame READ notificationsPerFrame NOTIFY
+                 updated)
+
+ public:
+  static constexpr int DefaultInterval{1000};
+
+  explicit MetricsReporter(QObject* parent = nullptr);
+
+  void setMetrics(std::shared_ptr<LinkMetrics const> metrics);
+  // Starts appending samples to the file; an empty path stops it.
+  auto setDumpFile(QString const& path) -> bool;
+  void setInterval(int milliseconds);
+
+  auto interval() const -> int;
+  auto dumpFile() const -> QString;
+  auto lastSnapshot() const -> LinkMetrics::Snapshot const&;
+
+  auto bytesWritten() const -> qint64;
+  auto bytesReceived() const -> qint64;
+  auto messagesSent() const -> qint64;
+  auto messagesDropped() const -> qint64;
+  auto framesReceived() const -> qint64;
+  // connection errors plus dropped writes
+  auto errors() const -> qint64;
+  auto writeRate() const -> double;
+  auto receiveRate() const -> double;
+  auto writeLatencyP50() const -> qint64;
+  auto writeLatencyP99() const -> qint64;
+  auto reassemblyTimeP99() const -> qint64;
+  auto notificationsPerFrame() const -> double;
+
+ public slots:
+  // Takes a sample right away.
+  void sample();
+
+ signals:
+  void updated();
+  void sampled(QJsonObject const& metrics);
+  void intervalChanged(int milliseconds);
+  void dumpFileChanged(QString const& path);
+
+ private:
+  void dump(QJsonObject const& json);
+
+  std::shared_ptr<LinkMetrics const> m_metrics{};
+  QTimer* m_timer{nullptr};
+  QFile m_file{};
+  bool m_csv{false};
+
+  LinkMetrics::Snapshot m_last{};
+  double m_writeRate{0.0};
+  double m_receiveRate{0.0};
+};
@@ -0,0 +1,151 @@
+#include "pseudoterminal.hpp"
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+PseudoTerminal::PseudoTerminal(QObject* parent) : QIODevice{parent} {}
+
+PseudoTerminal::~PseudoTerminal() { close(); }
+
+auto PseudoTerminal::open(OpenMode mode) -> bool {
+#ifdef Q_OS_UNIX
+  if (isOpen()) {
+    return true;
+  }
+
+  m_master = ::posix_openpt(O_RDWR | O_NOCTTY);
+  if (m_master < 0 || ::grantpt(m_master) != 0 || ::unlockpt(m_master) != 0) {
+    setErrorString(QString("Cannot create a pseudo-terminal: %1")
+                       .arg(qt_error_string(errno)));
+    close();
+    return false;
+  }
+
+  m_slavePath = QString::fromLocal8Bit(::ptsname(m_master));
+  m_slave = ::open(::ptsname(m_master), O_RDWR | O_NOCTTY);
+
+  // no echo, no line editing, no translation - bytes go through as they are
+  termios attributes{};
+  if (::tcgetattr(m_master, &attributes) == 0) {
+    ::cfmakeraw(&attributes);
+    ::tcsetattr(m_master, TCSANOW, &attributes);
+  }
+  ::fcntl(m_master, F_SETFL, ::fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+  m_readNotifier = new QSocketNotifier{m_master, QSocketNotifier::Read, this};
+  QObject::connect(m_readNotifier, &QSocketNotifier::activated, this,
+                   &PseudoTerminal::handleReadable);
+  m_writeNotifier =
+      new QSocketNotifier{m_master, QSocketNotifier::Write, this};
+  m_writeNotifier->setEnabled(false);
+  QObject::connect(m_writeNotifier, &QSocketNotifier::activated, this,
+                   &PseudoTerminal::flushWriteBuffer);
+
+  return QIODevice::open(mode | Unbuffered);
+#else
+  Q_UNUSED(mode)
+  setErrorString("Pseudo-terminals are not supported on this platform");
+  return false;
+#endif
+}
+
+void PseudoTerminal::close() {
+  if (isOpen()) {
+    QIODevice::close();
+  }
+
+  delete m_readNotifier;
+  m_readNotifier = nullptr;
+  delete m_writeNotifier;
+  m_writeNotifier = nullptr;
+  m_writeBuffer.clear();
+  m_slavePath.clear();
+
+#ifdef Q_OS_UNIX
+  if (m_slave >= 0) {
+    ::close(m_slave);
+  }
+  if (m_master >= 0) {
+    ::close(m_master);
+  }
+#endif
+  m_slave = -1;
+  m_master = -1;
+}
+
+auto PseudoTerminal::isSequential() const -> bool { return true; }
+
+auto PseudoTerminal::bytesToWrite() const -> qint64 {
+  return m_writeBuffer.size();
+}
+
+auto PseudoTerminal::slavePath() const -> QString { return m_slavePath; }
+
+auto PseudoTerminal::readData(char* data, qint64 maxSize) -> qint64 {
+#ifdef Q_OS_UNIX
+  if (m_master < 0) {
+    return -1;
+  }
+
+  ssize_t result{0};
+  do {
+    result = ::read(m_master, data, static_cast<size_t>(maxSize));
+  } while (result < 0 && errno == EINTR);
+
+  // watch for more once the reader came back for it
+  m_readNotifier->setEnabled(true);
+  if (result < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+  }
+  return result;
+#else
+  Q_UNUSED(data)
+  Q_UNUSED(maxSize)
+  return -1;
+#endif
+}
+
+auto PseudoTerminal::writeData(char const* data, qint64 maxSize) -> qint64 {
+  if (m_master < 0) {
+    return -1;
+  }
+
+  // order matters, so nothing bypasses what's already waiting
+  m_writeBuffer.append(data, static_cast<int>(maxSize));
+  flushWriteBuffer();
+  return maxSize;
+}
+
+void PseudoTerminal::handleReadable() {
+  m_readNotifier->setEnabled(false);
+  emit readyRead();
+}
+
+void PseudoTerminal::flushWriteBuffer() {
+#ifdef Q_OS_UNIX
+  qint64 written{0};
+  while (written < m_writeBuffer.size()) {
+    auto const result =
+        ::write(m_master, m_writeBuffer.constData() + written,
+                static_cast<size_t>(m_writeBuffer.size() - written));
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    written += result;
+  }
+
+  m_writeBuffer.remove(0, static_cast<int>(written));
+  m_writeNotifier->setEnabled(!m_writeBuffer.isEmpty());
+  if (written > 0) {
+    emit bytesWritten(written);
+  }
+#endif
+}
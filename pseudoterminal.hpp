@@ -0,0 +1,46 @@
+#pragma once
+#include <QByteArray>
+#include <QIODevice>
+#include <QSocketNotifier>
+#include <QString>
+
+// Master side of a pseudo-terminal in raw mode, as a sequential QIODevice.
+// Whatever opens slavePath() gets a serial port look-alike. Only available
+// on Unix; open() fails everywhere else.
+//
+// readyRead is emitted once per batch of input: the terminal isn't watched
+// again until the input has been read, so a reader that stops reading holds
+// the input back in the terminal - and with it the writer on the other side.
+class PseudoTerminal : public QIODevice
+{
+  Q_OBJECT
+
+ public:
+  explicit PseudoTerminal(QObject* parent = nullptr);
+  ~PseudoTerminal() override;
+
+  auto open(OpenMode mode) -> bool override;
+  void close() override;
+  auto isSequential() const -> bool override;
+  auto bytesToWrite() const -> qint64 override;
+
+  // Path of the terminal for other processes to open, empty while closed.
+  auto slavePath() const -> QString;
+
+ protected:
+  auto readData(char* data, qint64 maxSize) -> qint64 override;
+  auto writeData(char const* data, qint64 maxSize) -> qint64 override;
+
+ private:
+  void handleReadable();
+  void flushWriteBuffer();
+
+  int m_master{-1};
+  // kept open so the master doesn't hang up while nobody has the terminal
+  // open
+  int m_slave{-1};
+  QString m_slavePath{};
+  QSocketNotifier* m_readNotifier{nullptr};
+  QSocketNotifier* m_writeNotifier{nullptr};
+  QByteArray m_writeBuffer{};
+};
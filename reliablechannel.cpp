@@ -0,0 +1,365 @@
+#include "reliablechannel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+auto read16(char const* data) -> quint16 {
+  return static_cast<quint16>(static_cast<quint8>(data[0]) |
+                              (static_cast<quint8>(data[1]) << 8));
+}
+
+auto read32(char const* data) -> quint32 {
+  return static_cast<quint32>(read16(data)) |
+         (static_cast<quint32>(read16(data + 2)) << 16);
+}
+
+void write16(char* data, quint16 value) {
+  data[0] = static_cast<char>(value & 0xFF);
+  data[1] = static_cast<char>((value >> 8) & 0xFF);
+}
+
+void write32(char* data, quint32 value) {
+  write16(data, static_cast<quint16>(value & 0xFFFF));
+  write16(data + 2, static_cast<quint16>(value >> 16));
+}
+}  // namespace
+
+void ReliableChannel::setMetrics(std::shared_ptr<LinkMetrics> metrics) {
+  m_metrics = std::move(metrics);
+}
+
+void ReliableChannel::reset() {
+  m_window.clear();
+  m_nextSeq = 0;
+  m_retransmissions.clear();
+  m_ackedBytes = 0;
+  m_smoothedRtt = -1.0;
+  m_rttVariance = 0.0;
+  m_retransmitTimeout = InitialRetransmitTimeout;
+  m_failed = false;
+
+  m_rxBuffer.clear();
+  m_expectedSeq = 0;
+  m_held.fill(QByteArray{});
+  m_isHeld.reset();
+  m_delivered.clear();
+  m_ackUrgency = AckUrgency::None;
+  m_packetsSinceAck = 0;
+}
+
+auto ReliableChannel::canSend() const -> bool {
+  return static_cast<int>(m_window.size()) < WindowSize;
+}
+
+auto ReliableChannel::wrap(QByteArray const& segment, qint64 now)
+    -> QByteArray {
+  auto const seq = m_nextSeq++;
+  m_window.push_back(Outgoing{seq, segment, now, 1, false});
+
+  // the ack rides along, but only an ack packet can report gaps
+  if (!m_isHeld.any()) {
+    m_ackUrgency = AckUrgency::None;
+    m_packetsSinceAck = 0;
+  }
+  return encode(RFCommProtocol::NoFlags, seq, segment.constData(),
+                segment.size());
+}
+
+auto ReliableChannel::takeRetransmissions(qint64 now)
+    -> std::vector<QByteArray> {
+  bool timedOut{false};
+  for (auto& packet : m_window) {
+    if (!packet.selectivelyAcked &&
+        now - packet.sentAt >= m_retransmitTimeout) {
+      retransmit(packet, now);
+      timedOut = true;
+    }
+  }
+  if (timedOut) {
+    m_retransmitTimeout =
+        std::min(2 * m_retransmitTimeout, MaxRetransmitTimeout);
+  }
+  return std::exchange(m_retransmissions, {});
+}
+
+auto ReliableChannel::nextTimeout() const -> qint64 {
+  qint64 next{-1};
+  for (auto const& packet : m_window) {
+    if (!packet.selectivelyAcked &&
+        (next < 0 || packet.sentAt + m_retransmitTimeout < next)) {
+      next = packet.sentAt + m_retransmitTimeout;
+    }
+  }
+  return next;
+}
+
+auto ReliableChannel::takeAckedBytes() -> qint64 {
+  return std::exchange(m_ackedBytes, 0);
+}
+
+auto ReliableChannel::unackedPackets() const -> int {
+  return static_cast<int>(m_window.size());
+}
+
+auto ReliableChannel::failed() const -> bool { return m_failed; }
+
+void ReliableChannel::receive(char const* data, int size, qint64 now) {
+  m_rxBuffer.append(data, size);
+
+  int offset{0};
+  while (true) {
+    int const start = m_rxBuffer.indexOf(RFCommProtocol::ExtendedMarker,
+                                         offset);
+    if (start < 0) {
+      offset = m_rxBuffer.size();
+      break;
+    }
+
+    int const packetSize = checkPacket(start);
+    if (packetSize == 0) {
+      offset = start;
+      break;
+    }
+    if (packetSize < 0) {
+      // not a packet header, keep looking
+      offset = start + 1;
+      continue;
+    }
+
+    char const* packet = m_rxBuffer.constData() + start;
+    int const checked = packetSize - RFCommProtocol::ReliableTrailerSize;
+    if (RFCommProtocol::crc32(packet, checked) != read32(packet + checked)) {
+      // the next packet may start anywhere in this one
+      add(LinkMetrics::CorruptPackets);
+      offset = start + 1;
+      continue;
+    }
+
+    handlePacket(packet, packetSize, now);
+    offset = start + packetSize;
+  }
+
+  m_rxBuffer.remove(0, offset);
+}
+
+auto ReliableChannel::takeDelivered(QByteArray& segment) -> bool {
+  if (m_delivered.empty()) {
+    return false;
+  }
+  segment = std::move(m_delivered.front());
+  m_delivered.pop_front();
+  return true;
+}
+
+auto ReliableChannel::ackUrgency() const -> AckUrgency {
+  return m_ackUrgency;
+}
+
+auto ReliableChannel::makeAck() -> QByteArray {
+  // bit i: packet m_expectedSeq + 1 + i arrived
+  quint32 selectiveAcks{0};
+  for (int i = 0; i < WindowSize - 1; i++) {
+    if (m_isHeld.test((m_expectedSeq + 1 + i) % WindowSize)) {
+      selectiveAcks |= 1u << i;
+    }
+  }
+
+  char bitmap[4]{};
+  write32(bitmap, selectiveAcks);
+  m_ackUrgency = AckUrgency::None;
+  m_packetsSinceAck = 0;
+  return encode(RFCommProtocol::AckOnly, m_nextSeq, bitmap,
+                int{sizeof(bitmap)});
+}
+
+auto ReliableChannel::encode(quint8 flags, quint16 seq, char const* segment,
+                             int size) -> QByteArray {
+  int const packetSize = RFCommProtocol::ReliableOverhead + size;
+  QByteArray packet{packetSize, Qt::Uninitialized};
+  char* data = packet.data();
+
+  data[0] = RFCommProtocol::ExtendedMarker;
+  data[1] = static_cast<char>(flags | RFCommProtocol::ReliablePacket);
+  write16(data + 2, static_cast<quint16>(
+                        packetSize - RFCommProtocol::ExtendedHeaderSize));
+  write16(data + 4, seq);
+  write16(data + 6, m_expectedSeq);
+  write16(data + 8, RFCommProtocol::crc16(data, 8));
+  if (size > 0) {
+    std::memcpy(data + RFCommProtocol::ReliableHeaderSize, segment,
+                static_cast<std::size_t>(size));
+  }
+
+  int const checked = packetSize - RFCommProtocol::ReliableTrailerSize;
+  write32(data + checked, RFCommProtocol::crc32(data, checked));
+  return packet;
+}
+
+auto ReliableChannel::checkPacket(int offset) const -> int {
+  if (m_rxBuffer.size() - offset < RFCommProtocol::ReliableHeaderSize) {
+    return 0;
+  }
+
+  char const* header = m_rxBuffer.constData() + offset;
+  if ((static_cast<quint8>(header[1]) & RFCommProtocol::ReliablePacket) ==
+      0) {
+    return -1;
+  }
+  int const packetSize =
+      RFCommProtocol::ExtendedHeaderSize + read16(header + 2);
+  if (packetSize < RFCommProtocol::ReliableOverhead ||
+      packetSize > MaxPacketSize ||
+      RFCommProtocol::crc16(header, 8) != read16(header + 8)) {
+    return -1;
+  }
+
+  return m_rxBuffer.size() - offset < packetSize ? 0 : packetSize;
+}
+
+void ReliableChannel::handlePacket(char const* packet, int size, qint64 now) {
+  auto const flags = static_cast<quint8>(packet[1]);
+  auto const seq = read16(packet + 4);
+  auto const ack = read16(packet + 6);
+  char const* segment = packet + RFCommProtocol::ReliableHeaderSize;
+  int const segmentSize = size - RFCommProtocol::ReliableOverhead;
+
+  if ((flags & RFCommProtocol::AckOnly) != 0) {
+    handleAck(ack, segmentSize >= 4 ? read32(segment) : 0, now);
+    return;
+  }
+
+  handleAck(ack, 0, now);
+  handleSegment(seq, QByteArray{segment, segmentSize});
+}
+
+void ReliableChannel::handleAck(quint16 ack, quint32 selectiveAcks,
+                                qint64 now) {
+  auto const base = m_window.empty() ? m_nextSeq : m_window.front().seq;
+  auto const acked = static_cast<quint16>(ack - base);
+  if (acked > static_cast<int>(m_window.size())) {
+    // older than what's been acked already
+    return;
+  }
+
+  for (int i = 0; i < acked; i++) {
+    auto const& packet = m_window.front();
+    // Only the newest packet acked is timed: the ack for the others may
+    // have waited for a gap to be filled, and one for a retransmitted packet
+    // might belong to any of its transmissions.
+    if (i == acked - 1 && packet.transmissions == 1 &&
+        !packet.selectivelyAcked) {
+      updateRoundTripTime(now - packet.sentAt);
+    }
+    m_ackedBytes += packet.segment.size();
+    m_window.pop_front();
+  }
+  if (acked > 0 && m_smoothedRtt >= 0) {
+    // progress, so no more backing off
+    updateRetransmitTimeout();
+  }
+
+  if (selectiveAcks == 0) {
+    return;
+  }
+
+  // m_window[i] has seq ack + i, bit i - 1 tells whether it arrived
+  int lastArrived{-1};
+  int const covered = std::min(static_cast<int>(m_window.size()), WindowSize);
+  for (int i = 1; i < covered; i++) {
+    if ((selectiveAcks & (1u << (i - 1))) != 0) {
+      m_window[static_cast<std::size_t>(i)].selectivelyAcked = true;
+      lastArrived = i;
+    }
+  }
+
+  // whatever is missing before a packet that arrived got lost, unless it
+  // has just been sent again
+  double const roundTrip =
+      m_smoothedRtt >= 0 ? m_smoothedRtt : m_retransmitTimeout;
+  for (int i = 0; i < lastArrived; i++) {
+    auto& packet = m_window[static_cast<std::size_t>(i)];
+    if (!packet.selectivelyAcked && now - packet.sentAt >= roundTrip) {
+      retransmit(packet, now);
+    }
+  }
+}
+
+void ReliableChannel::handleSegment(quint16 seq, QByteArray segment) {
+  m_packetsSinceAck++;
+
+  auto const offset = static_cast<quint16>(seq - m_expectedSeq);
+  if (offset == 0) {
+    m_delivered.push_back(std::move(segment));
+    m_expectedSeq++;
+
+    // and whatever was waiting for it
+    bool const filledGap = m_isHeld.any();
+    while (m_isHeld.test(m_expectedSeq % WindowSize)) {
+      auto const slot = static_cast<std::size_t>(m_expectedSeq % WindowSize);
+      m_delivered.push_back(std::exchange(m_held[slot], QByteArray{}));
+      m_isHeld.reset(slot);
+      m_expectedSeq++;
+    }
+
+    if (filledGap || m_packetsSinceAck >= AckEvery) {
+      m_ackUrgency = AckUrgency::Now;
+    } else if (m_ackUrgency == AckUrgency::None) {
+      m_ackUrgency = AckUrgency::Delayed;
+    }
+    return;
+  }
+
+  if (offset < WindowSize) {
+    auto const slot = static_cast<std::size_t>(seq % WindowSize);
+    if (!m_isHeld.test(slot)) {
+      m_held[slot] = std::move(segment);
+      m_isHeld.set(slot);
+    }
+  }
+  // a gap, or a duplicate because an ack got lost - either way the sender
+  // needs to hear about it
+  m_ackUrgency = AckUrgency::Now;
+}
+
+void ReliableChannel::updateRoundTripTime(qint64 sample) {
+  // RFC 6298
+  auto const value = static_cast<double>(sample);
+  if (m_smoothedRtt < 0) {
+    m_smoothedRtt = value;
+    m_rttVariance = value / 2;
+  } else {
+    m_rttVariance =
+        0.75 * m_rttVariance + 0.25 * std::abs(m_smoothedRtt - value);
+    m_smoothedRtt = 0.875 * m_smoothedRtt + 0.125 * value;
+  }
+  updateRetransmitTimeout();
+}
+
+void ReliableChannel::updateRetransmitTimeout() {
+  auto const timeout = static_cast<int>(
+      std::lround(m_smoothedRtt + std::max(1.0, 4 * m_rttVariance)));
+  m_retransmitTimeout =
+      std::clamp(timeout, MinRetransmitTimeout, MaxRetransmitTimeout);
+}
+
+void ReliableChannel::retransmit(Outgoing& packet, qint64 now) {
+  packet.sentAt = now;
+  packet.transmissions++;
+  if (packet.transmissions > MaxRetransmissions + 1) {
+    m_failed = true;
+  }
+
+  m_retransmissions.push_back(encode(RFCommProtocol::NoFlags, packet.seq,
+                                     packet.segment.constData(),
+                                     packet.segment.size()));
+  add(LinkMetrics::Retransmissions);
+}
+
+void ReliableChannel::add(LinkMetrics::Counter counter) {
+  if (m_metrics) {
+    m_metrics->add(counter);
+  }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <QByteArray>
+#include <QtGlobal>
+#include <array>
+#include <bitset>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "linkmetrics.hpp"
+#include "rfcommprotocol.hpp"
+
+// Sliding window ARQ under the RFComm framing, used by BLERFComm once both
+// sides negotiated reliable delivery. Outgoing segments of the frame stream
+// go out in sequenced, CRC protected packets; incoming packets come back out
+// as the segments the peer sent - complete and in order, whatever the link
+// lost, corrupted or cut short. After garbage, the next packet is found again
+// by its header CRC.
+//
+// Acks are cumulative and carry a bitmap of the packets that arrived beyond
+// the first gap. Only missing packets are sent again: once an ack shows a
+// later one got through, or when the retransmission timeout (derived from
+// the measured round trip time) expires. Times are in ms from any monotonic
+// clock.
+class ReliableChannel
+{
+ public:
+  static constexpr int WindowSize{32};
+  static constexpr int MinSegmentSize{128};
+  static constexpr int MaxSegmentSize{512};
+  // the receiver acks at the latest after this many packets
+  static constexpr int AckEvery{WindowSize / 4};
+  static constexpr int InitialRetransmitTimeout{250};
+  static constexpr int MinRetransmitTimeout{40};
+  static constexpr int MaxRetransmitTimeout{4000};
+  // the link is considered dead when a packet still isn't acked after this
+  // many retransmissions
+  static constexpr int MaxRetransmissions{10};
+
+  enum class AckUrgency { None, Delayed, Now };
+
+  void setMetrics(std::shared_ptr<LinkMetrics> metrics);
+  void reset();
+
+  // Sending.
+  auto canSend() const -> bool;
+  // Packs the segment into the next packet, which also acks what was
+  // received so far. A copy is kept until the peer acks it.
+  auto wrap(QByteArray const& segment, qint64 now) -> QByteArray;
+  // Packets to send again, both timed out ones and gaps reported by acks.
+  auto takeRetransmissions(qint64 now) -> std::vector<QByteArray>;
+  // When the oldest packet times out, or -1 if nothing is waiting for an ack.
+  auto nextTimeout() const -> qint64;
+  // Segment bytes acked since the last call, in the order they were wrapped.
+  auto takeAckedBytes() -> qint64;
+  auto unackedPackets() const -> int;
+  auto failed() const -> bool;
+
+  // Receiving.
+  void receive(char const* data, int size, qint64 now);
+  auto takeDelivered(QByteArray& segment) -> bool;
+  auto ackUrgency() const -> AckUrgency;
+  auto makeAck() -> QByteArray;
+
+ private:
+  struct Outgoing {
+    quint16 seq;
+    QByteArray segment;
+    qint64 sentAt;
+    int transmissions;
+    bool selectivelyAcked;
+  };
+
+  // longest packet worth waiting for - a longer length is taken for garbage
+  static constexpr int MaxPacketSize{RFCommProtocol::ReliableOverhead +
+                                     MaxSegmentSize};
+
+  auto encode(quint8 flags, quint16 seq, char const* segment, int size)
+      -> QByteArray;
+  // length of the packet at the offset, 0 if more bytes are needed and -1 if
+  // there's none
+  auto checkPacket(int offset) const -> int;
+  void handlePacket(char const* packet, int size, qint64 now);
+  void handleAck(quint16 ack, quint32 selectiveAcks, qint64 now);
+  void handleSegment(quint16 seq, QByteArray segment);
+  void updateRoundTripTime(qint64 sample);
+  void updateRetransmitTimeout();
+  void retransmit(Outgoing& packet, qint64 now);
+  void add(LinkMetrics::Counter counter);
+
+  std::shared_ptr<LinkMetrics> m_metrics{};
+
+  // sending
+  std::deque<Outgoing> m_window{};
+  quint16 m_nextSeq{0};
+  std::vector<QByteArray> m_retransmissions{};
+  qint64 m_ackedBytes{0};
+  double m_smoothedRtt{-1.0};
+  double m_rttVariance{0.0};
+  int m_retransmitTimeout{InitialRetransmitTimeout};
+  bool m_failed{false};
+
+  // receiving
+  QByteArray m_rxBuffer{};
+  quint16 m_expectedSeq{0};
+  // out of order packets, by seq % WindowSize
+  std::array<QByteArray, WindowSize> m_held{};
+  std::bitset<WindowSize> m_isHeld{};
+  std::deque<QByteArray> m_delivered{};
+  AckUrgency m_ackUrgency{AckUrgency::None};
+  int m_packetsSinceAck{0};
+};
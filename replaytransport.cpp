@@ -0,0 +1,161 @@
+#include "replaytransport.hpp"
+
+#include <algorithm>
+
+ReplayTransport::ReplayTransport(QString const& path, Mode mode,
+                                 QObject* parent)
+    : BLETransport{parent}, m_path{path}, m_mode{mode} {
+  m_timer = new QTimer{this};
+  m_timer->setSingleShot(true);
+  m_timer->setTimerType(Qt::PreciseTimer);
+  QObject::connect(m_timer, &QTimer::timeout, this, &ReplayTransport::play);
+}
+
+void ReplayTransport::connectToDevice(QBluetoothDeviceInfo const& device,
+                                      QBluetoothUuid const&,
+                                      QBluetoothUuid const&) {
+  if (connected()) {
+    disconnectFromDevice();
+  }
+
+  m_reader = std::make_unique<CaptureReader>(m_path);
+  if (!m_reader->open()) {
+    auto const error = m_reader->errorString();
+    m_reader.reset();
+    QTimer::singleShot(0, this, [this, error]() {
+      emit connectionError(ConnectonError,
+                           QString("Cannot replay %1: %2").arg(m_path, error));
+    });
+    return;
+  }
+
+  m_remoteName = device.name();
+  m_remoteAddress = device.address();
+  m_recordPending = false;
+  m_firstRecordUs = -1;
+  m_notifications = 0;
+
+  // stay asynchronous, like a real controller
+  m_timer->stop();
+  QTimer::singleShot(0, this, [this]() {
+    if (!m_reader) {
+      return;
+    }
+    m_connected = true;
+    emit connectedToDevice();
+    emit serviceDiscovered();
+    emit commsReady();
+    m_timer->start(0);
+  });
+}
+
+void ReplayTransport::disconnectFromDevice() {
+  m_timer->stop();
+  m_reader.reset();
+
+  if (m_connected) {
+    m_connected = false;
+    emit disconnectedFromDevice();
+  }
+}
+
+void ReplayTransport::write(QByteArray const& data, WriteMode) {
+  if (!ready()) {
+    QTimer::singleShot(0, this, &ReplayTransport::writeFailed);
+    return;
+  }
+
+  int const size = data.size();
+  QTimer::singleShot(0, this, [this, size]() { emit dataWritten(size); });
+}
+
+auto ReplayTransport::connected() const -> bool { return m_connected; }
+
+auto ReplayTransport::ready() const -> bool { return m_connected; }
+
+auto ReplayTransport::remoteName() const -> QString {
+  return connected() ? m_remoteName : QString{};
+}
+
+auto ReplayTransport::remoteAddress() const -> QBluetoothAddress {
+  return connected() ? m_remoteAddress : QBluetoothAddress{};
+}
+
+auto ReplayTransport::mtu() const -> int { return m_mtu; }
+
+auto ReplayTransport::supportsWriteWithoutResponse() const -> bool {
+  return true;
+}
+
+void ReplayTransport::setMode(Mode mode) { m_mode = mode; }
+
+auto ReplayTransport::mode() const -> Mode { return m_mode; }
+
+auto ReplayTransport::replayedNotifications() const -> quint64 {
+  return m_notifications;
+}
+
+void ReplayTransport::play() {
+  int played{0};
+  while (m_reader && (m_recordPending || m_reader->next(m_record))) {
+    m_recordPending = false;
+
+    if (m_mode == Mode::RealTime) {
+      // timed from the first record, not from when the capture started
+      if (m_firstRecordUs < 0) {
+        m_firstRecordUs = m_record.timestampUs;
+        m_clock.start();
+      }
+      qint64 const waitUs = m_record.timestampUs - m_firstRecordUs -
+                            m_clock.nsecsElapsed() / 1000;
+      if (waitUs > 0) {
+        m_recordPending = true;
+        m_timer->start(static_cast<int>((waitUs + 999) / 1000));
+        return;
+      }
+    } else if (played == FastBatchSize) {
+      // let the receiver's queued work run in between
+      m_recordPending = true;
+      m_timer->start(0);
+      return;
+    }
+    played++;
+
+    switch (m_record.type) {
+      case CaptureFormat::RecordType::Notification:
+        m_notifications++;
+        emit dataReceived(m_record.data);
+        break;
+      case CaptureFormat::RecordType::BulkNotification:
+        if (!m_record.data.isEmpty()) {
+          m_notifications++;
+          emit bulkDataReceived(static_cast<quint8>(m_record.data[0]),
+                                m_record.data.mid(1));
+        }
+        break;
+      case CaptureFormat::RecordType::MtuChanged:
+        if (m_record.data.size() == 2) {
+          m_mtu = std::max(static_cast<quint8>(m_record.data[0]) |
+                               (static_cast<quint8>(m_record.data[1]) << 8),
+                           DefaultMtu);
+          emit mtuChanged(m_mtu);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  finish();
+}
+
+void ReplayTransport::finish() {
+  if (!m_reader) {
+    // disconnected by a receiver
+    return;
+  }
+
+  bool const corrupted = m_reader->corrupted();
+  m_reader.reset();
+  emit replayFinished(m_notifications, corrupted);
+}
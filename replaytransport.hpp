@@ -0,0 +1,74 @@
+#pragma once
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+#include "bletransport.hpp"
+#include "capturefile.hpp"
+
+// Plays the notifications of a capture file back as a peripheral would send
+// them, with the original boundaries and content, so a recorded session can
+// be run through BLEComm and BLERFComm again. RealTime keeps the recorded
+// timing, Fast goes as fast as the receiver keeps up. Writes succeed but go
+// nowhere, and the recorded link events don't interrupt the replay.
+class ReplayTransport : public BLETransport
+{
+  Q_OBJECT
+
+ public:
+  enum class Mode { Fast, RealTime };
+
+  explicit ReplayTransport(QString const& path, Mode mode = Mode::Fast,
+                           QObject* parent = nullptr);
+
+  void connectToDevice(QBluetoothDeviceInfo const& device,
+                       QBluetoothUuid const& serviceUuid,
+                       QBluetoothUuid const& charUuid) override;
+  void disconnectFromDevice() override;
+
+  void write(QByteArray const& data, WriteMode mode) override;
+
+  auto connected() const -> bool override;
+  auto ready() const -> bool override;
+  auto remoteName() const -> QString override;
+  auto remoteAddress() const -> QBluetoothAddress override;
+  auto mtu() const -> int override;
+  auto supportsWriteWithoutResponse() const -> bool override;
+
+  void setMode(Mode mode);
+  auto mode() const -> Mode;
+  auto replayedNotifications() const -> quint64;
+
+ signals:
+  // The whole capture has been played; the link stays up.
+  void replayFinished(quint64 notifications, bool corrupted);
+
+ private slots:
+  void play();
+
+ private:
+  // records played per event loop round in Fast mode
+  static constexpr int FastBatchSize{1024};
+
+  void finish();
+
+  QString m_path{};
+  Mode m_mode{Mode::Fast};
+  std::unique_ptr<CaptureReader> m_reader{};
+  QTimer* m_timer{nullptr};
+  QElapsedTimer m_clock{};
+  CaptureFormat::Record m_record{};
+  qint64 m_firstRecordUs{-1};
+  bool m_recordPending{false};
+  quint64 m_notifications{0};
+
+  int m_mtu{DefaultMtu};
+  bool m_connected{false};
+  QString m_remoteName{};
+  QBluetoothAddress m_remoteAddress{};
+};
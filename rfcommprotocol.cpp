@@ -0,0 +1,101 @@
+#include "rfcommprotocol.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace {
+constexpr auto makeCrc16Table() -> std::array<quint16, 256> {
+  std::array<quint16, 256> table{};
+  for (int i = 0; i < 256; i++) {
+    auto crc = static_cast<quint16>(i << 8);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = static_cast<quint16>((crc & 0x8000) != 0 ? (crc << 1) ^ 0x1021
+                                                     : crc << 1);
+    }
+    table[static_cast<std::size_t>(i)] = crc;
+  }
+  return table;
+}
+
+constexpr auto makeCrc32Table() -> std::array<quint32, 256> {
+  std::array<quint32, 256> table{};
+  for (quint32 i = 0; i < 256; i++) {
+    quint32 crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr auto Crc16Table = makeCrc16Table();
+constexpr auto Crc32Table = makeCrc32Table();
+}  // namespace
+
+auto RFCommProtocol::headerSize(int payloadSize, quint8 flags) -> int {
+  if (flags == NoFlags && payloadSize <= MaxLegacyPayload) {
+    return LegacyHeaderSize;
+  }
+  return ExtendedHeaderSize;
+}
+
+void RFCommProtocol::writeExtendedHeader(char* out, int payloadSize,
+                                         quint8 flags) {
+  out[0] = ExtendedMarker;
+  out[1] = static_cast<char>(flags);
+  out[2] = static_cast<char>(payloadSize & 0xFF);
+  out[3] = static_cast<char>((payloadSize >> 8) & 0xFF);
+}
+
+auto RFCommProtocol::writeHeader(char* out, int payloadSize, quint8 flags)
+    -> int {
+  int const header = headerSize(payloadSize, flags);
+  if (header == LegacyHeaderSize) {
+    out[0] = static_cast<char>(payloadSize);
+  } else {
+    writeExtendedHeader(out, payloadSize, flags);
+  }
+  return header;
+}
+
+void RFCommProtocol::appendFrame(QByteArray& out, char const* payload,
+                                 int payloadSize, quint8 flags) {
+  int const header = headerSize(payloadSize, flags);
+  int const offset = out.size();
+  out.resize(offset + header + payloadSize);
+
+  char* frame = out.data() + offset;
+  writeHeader(frame, payloadSize, flags);
+
+  if (payloadSize > 0) {
+    std::memcpy(frame + header, payload, static_cast<std::size_t>(payloadSize));
+  }
+}
+
+auto RFCommProtocol::encodeFrame(QByteArray const& payload, quint8 flags)
+    -> QByteArray {
+  QByteArray frame{};
+  frame.reserve(headerSize(payload.size(), flags) + payload.size());
+  appendFrame(frame, payload.constData(), payload.size(), flags);
+  return frame;
+}
+
+auto RFCommProtocol::crc16(char const* data, int size) -> quint16 {
+  quint16 crc{0xFFFF};
+  for (int i = 0; i < size; i++) {
+    auto const index = static_cast<quint8>((crc >> 8) ^
+                                           static_cast<quint8>(data[i]));
+    crc = static_cast<quint16>((crc << 8) ^ Crc16Table[index]);
+  }
+  return crc;
+}
+
+auto RFCommProtocol::crc32(char const* data, int size) -> quint32 {
+  quint32 crc{0xFFFFFFFFu};
+  for (int i = 0; i < size; i++) {
+    auto const index = static_cast<quint8>(crc ^ static_cast<quint8>(data[i]));
+    crc = (crc >> 8) ^ Crc32Table[index];
+  }
+  return ~crc;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <QByteArray>
+#include <QtGlobal>
+
+// Frame layout of the BLE RFComm protocol, see README for the details.
+//
+// Legacy frame:   | length (0 - 254) | payload |
+// Extended frame: | 0xFF | flags | length (16 bit LE) | payload |
+//
+// Legacy frames are always understood. Extended frames are only sent after
+// both sides announced support for them in a Hello control frame.
+//
+// Once both sides announced reliable delivery, the frame stream is carried in
+// reliable packets, which are extended frames with the ReliablePacket flag:
+//
+// | 0xFF | flags | length (16 bit LE) | seq (16 bit LE) | ack (16 bit LE) |
+// | header CRC-16 | segment | CRC-32 |
+//
+// The length covers everything after it, the header CRC the 8 bytes before
+// it and the CRC-32 everything before it.
+//
+// With compression negotiated, messages that shrink are sent in extended
+// frames with the Compressed flag:
+//
+// | 0xFF | flags | length (16 bit LE) | message length (16 bit LE) |
+// | LZ4 block |
+//
+// With striping negotiated, the stream of normal priority frames is cut into
+// segments that are spread over the bulk characteristics in extended frames
+// with the Striped flag, and put back in order by their sequence number:
+//
+// | 0xFF | flags | length (16 bit LE) | seq (16 bit LE) | segment |
+namespace RFCommProtocol {
+constexpr int LegacyHeaderSize{1};
+constexpr int ExtendedHeaderSize{4};
+constexpr int MaxLegacyPayload{254};
+constexpr int MaxExtendedPayload{0xFFFF};
+constexpr char ExtendedMarker{static_cast<char>(0xFF)};
+constexpr quint8 ProtocolVersion{1};
+constexpr int ReliableHeaderSize{10};
+constexpr int ReliableTrailerSize{4};
+constexpr int ReliableOverhead{ReliableHeaderSize + ReliableTrailerSize};
+constexpr int CompressedHeaderSize{2};
+constexpr int StripedHeaderSize{2};
+constexpr int StripedOverhead{ExtendedHeaderSize + StripedHeaderSize};
+
+enum FrameFlag : quint8 {
+  NoFlags = 0x00,
+  ControlFrame = 0x01,
+  ReliablePacket = 0x02,
+  // reliable packet without a sequence number, its segment is the
+  // selective ack bitmap
+  AckOnly = 0x04,
+  // message compressed with LzCodec, preceded by its original length
+  Compressed = 0x08,
+  // segment of the striped frame stream
+  Striped = 0x10,
+  // striped segment that doesn't start at a frame boundary
+  StripeContinued = 0x20,
+};
+
+enum class ControlType : quint8 {
+  Hello = 0x01,
+  BlobStart = 0x02,
+  BlobData = 0x03,
+  BlobEnd = 0x04,
+  BlobAbort = 0x05,
+};
+
+// | BlobData | transfer id | offset (32 bit LE) | data |
+constexpr int BlobDataHeaderSize{6};
+// size and offset field value for blobs of unknown size
+constexpr quint32 UnknownBlobSize{0xFFFFFFFF};
+
+auto headerSize(int payloadSize, quint8 flags) -> int;
+// Writes an extended header to the first ExtendedHeaderSize bytes of out,
+// for frames built in place.
+void writeExtendedHeader(char* out, int payloadSize, quint8 flags);
+// Writes the header appendFrame would use and returns its size.
+auto writeHeader(char* out, int payloadSize, quint8 flags) -> int;
+
+// Appends a complete frame to out. Uses the legacy header whenever the frame
+// has no flags and fits in it.
+void appendFrame(QByteArray& out, char const* payload, int payloadSize,
+                 quint8 flags = NoFlags);
+auto encodeFrame(QByteArray const& payload, quint8 flags = NoFlags)
+    -> QByteArray;
+
+// CRC-16/CCITT-FALSE and CRC-32 (IEEE 802.3), as used by reliable packets.
+auto crc16(char const* data, int size) -> quint16;
+auto crc32(char const* data, int size) -> quint32;
+}  // namespace RFCommProtocol
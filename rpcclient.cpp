@@ -0,0 +1,188 @@
+#include "rpcclient.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+RpcClient::RpcClient(BLERFComm* comm, QObject* parent)
+    : QObject{parent}, m_comm{comm} {
+  m_clock.start();
+
+  m_timeoutTimer = new QTimer{this};
+  m_timeoutTimer->setSingleShot(true);
+  QObject::connect(m_timeoutTimer, &QTimer::timeout, this,
+                   &RpcClient::expireCalls);
+
+  QObject::connect(m_comm, &BLERFComm::dataReceived, this,
+                   &RpcClient::handleData);
+  QObject::connect(m_comm, &BLERFComm::messageSent, this,
+                   &RpcClient::handleMessageSent);
+  QObject::connect(m_comm, &BLERFComm::messageDropped, this,
+                   &RpcClient::handleMessageDropped);
+  QObject::connect(m_comm, &BLERFComm::disconnectedFromDevice, this,
+                   &RpcClient::handleLinkLost);
+}
+
+void RpcClient::setDefaultTimeout(int milliseconds) {
+  m_defaultTimeout = std::max(milliseconds, 0);
+}
+
+auto RpcClient::defaultTimeout() const -> int { return m_defaultTimeout; }
+
+auto RpcClient::pendingCalls() const -> int { return m_pending.size(); }
+
+auto RpcClient::maximumRequestSize() const -> int {
+  return m_comm->maximumMessageSize() - HeaderSize;
+}
+
+auto RpcClient::lateReplies() const -> quint64 { return m_lateReplies; }
+
+auto RpcClient::call(QByteArray const& request, int timeoutMs) -> RpcReply* {
+  auto const deadline =
+      m_clock.elapsed() + (timeoutMs < 0 ? m_defaultTimeout : timeoutMs);
+  auto const requestId = nextRequestId();
+  auto* reply = new RpcReply{this, requestId, deadline, this};
+
+  auto const failLater = [reply](QString const& reason) {
+    QTimer::singleShot(0, reply, [reply, reason]() {
+      reply->fail(RpcReply::Error::SendFailed, reason);
+    });
+  };
+  if (requestId == NotificationId) {
+    failLater("Too many calls in flight");
+    return reply;
+  }
+  if (request.size() > maximumRequestSize()) {
+    failLater(QString("Request is too long (limit is %1 bytes)")
+                  .arg(maximumRequestSize()));
+    return reply;
+  }
+
+  QByteArray message{HeaderSize + request.size(), Qt::Uninitialized};
+  message[0] = static_cast<char>(requestId & 0xFF);
+  message[1] = static_cast<char>((requestId >> 8) & 0xFF);
+  std::copy(request.cbegin(), request.cend(), message.begin() + HeaderSize);
+
+  // registered first - on an idle link the request may go out right away
+  m_pending.insert(requestId, reply);
+  auto const messageId = m_comm->sendData(message);
+  if (messageId == 0) {
+    m_pending.remove(requestId);
+    failLater("The device isn't ready or the transmit queue is full");
+    return reply;
+  }
+  reply->m_messageId = messageId;
+  m_unsent.insert(messageId, requestId);
+
+  scheduleTimeout(deadline);
+  return reply;
+}
+
+void RpcClient::call(QByteArray const& request, Callback callback,
+                     int timeoutMs) {
+  auto* reply = call(request, timeoutMs);
+  QObject::connect(reply, &RpcReply::finished, this,
+                   [reply, callback = std::move(callback)]() {
+                     callback(*reply);
+                     reply->deleteLater();
+                   });
+}
+
+void RpcClient::handleData(QByteArray const& data) {
+  if (data.size() < HeaderSize) {
+    return;
+  }
+
+  auto const requestId = static_cast<quint16>(
+      static_cast<quint8>(data[0]) | (static_cast<quint8>(data[1]) << 8));
+  if (requestId == NotificationId) {
+    emit notificationReceived(data.mid(HeaderSize));
+    return;
+  }
+
+  auto* reply = m_pending.value(requestId, nullptr);
+  if (reply == nullptr) {
+    m_lateReplies++;
+    return;
+  }
+  reply->finish(data.mid(HeaderSize));
+}
+
+void RpcClient::handleMessageSent(quint64 messageId) {
+  m_unsent.remove(messageId);
+}
+
+void RpcClient::handleMessageDropped(quint64 messageId) {
+  auto const unsent = m_unsent.find(messageId);
+  if (unsent == m_unsent.end()) {
+    return;
+  }
+
+  auto* reply = m_pending.value(unsent.value(), nullptr);
+  m_unsent.erase(unsent);
+  if (reply != nullptr) {
+    reply->fail(RpcReply::Error::SendFailed, "The request was dropped");
+  }
+}
+
+void RpcClient::handleLinkLost() {
+  // requests still queued go out once the link is back, so only the calls
+  // whose request was already sent are lost - their replies won't come
+  bool const reconnecting = m_comm->comm()->isReconnecting();
+  auto const replies = m_pending.values();
+  for (auto* reply : replies) {
+    if (reconnecting && m_unsent.contains(reply->m_messageId)) {
+      continue;
+    }
+    reply->fail(RpcReply::Error::LinkLost, "Link lost");
+  }
+}
+
+void RpcClient::expireCalls() {
+  auto const now = m_clock.elapsed();
+  auto next = std::numeric_limits<qint64>::max();
+
+  std::vector<RpcReply*> expired{};
+  for (auto* reply : qAsConst(m_pending)) {
+    if (reply->m_deadline <= now) {
+      expired.push_back(reply);
+    } else {
+      next = std::min(next, reply->m_deadline);
+    }
+  }
+  for (auto* reply : expired) {
+    reply->fail(RpcReply::Error::Timeout,
+                QString("No reply after %1 ms").arg(reply->elapsedUs() / 1000));
+  }
+
+  if (next != std::numeric_limits<qint64>::max() && !m_pending.isEmpty()) {
+    scheduleTimeout(next);
+  }
+}
+
+auto RpcClient::nextRequestId() -> quint16 {
+  // skips ids still waiting for their reply; NotificationId if all are
+  for (int i = 0; i <= std::numeric_limits<quint16>::max(); i++) {
+    auto const id = m_nextRequestId++;
+    if (id != NotificationId && !m_pending.contains(id)) {
+      return id;
+    }
+  }
+  return NotificationId;
+}
+
+void RpcClient::release(RpcReply* reply) {
+  if (m_pending.value(reply->m_requestId, nullptr) == reply) {
+    m_pending.remove(reply->m_requestId);
+    m_unsent.remove(reply->m_messageId);
+  }
+}
+
+void RpcClient::scheduleTimeout(qint64 deadline) {
+  if (m_timeoutTimer->isActive() && m_timerDeadline <= deadline) {
+    return;
+  }
+  m_timerDeadline = deadline;
+  m_timeoutTimer->start(
+      static_cast<int>(std::max<qint64>(deadline - m_clock.elapsed(), 0)));
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+
+#include "blerfcomm.hpp"
+#include "rpcreply.hpp"
+
+// Request/response calls over a BLERFComm link. Every request is sent as a
+// message tagged with a 16-bit correlation id, which the peer puts in front
+// of its reply:
+//
+// | request id (16 bit LE) | body |
+//
+// Calls don't wait for each other - as many as the transmit queue takes can
+// be in flight, the replies are matched by id in whatever order they come,
+// and each call times out on its own. Messages from the peer with id 0 are
+// not replies but notifications. The client must live on the thread of the
+// BLERFComm.
+class RpcClient : public QObject
+{
+  Q_OBJECT
+
+ public:
+  static constexpr int HeaderSize{2};
+  static constexpr quint16 NotificationId{0};
+  static constexpr int DefaultTimeout{2000};
+
+  using Callback = std::function<void(RpcReply const& reply)>;
+
+  explicit RpcClient(BLERFComm* comm, QObject* parent = nullptr);
+
+  // ms, for calls that don't give their own timeout
+  void setDefaultTimeout(int milliseconds);
+  auto defaultTimeout() const -> int;
+  auto pendingCalls() const -> int;
+  auto maximumRequestSize() const -> int;
+  // replies that came after their call finished
+  auto lateReplies() const -> quint64;
+
+  // Sends the request and returns the reply to it. A call that can't be
+  // made fails once control returns to the event loop, so finished can
+  // still be connected. A negative timeout means the default one.
+  auto call(QByteArray const& request, int timeoutMs = -1) -> RpcReply*;
+  // Same, but the callback gets the finished reply, which is deleted
+  // afterwards.
+  void call(QByteArray const& request, Callback callback, int timeoutMs = -1);
+
+ signals:
+  void notificationReceived(QByteArray const& data);
+
+ private slots:
+  void handleData(QByteArray const& data);
+  void handleMessageSent(quint64 messageId);
+  void handleMessageDropped(quint64 messageId);
+  void handleLinkLost();
+  void expireCalls();
+
+ private:
+  friend class RpcReply;
+
+  auto nextRequestId() -> quint16;
+  void release(RpcReply* reply);
+  void scheduleTimeout(qint64 deadline);
+
+  BLERFComm* m_comm{nullptr};
+  QHash<quint16, RpcReply*> m_pending{};
+  // request ids by link message id, until the request has been sent
+  QHash<quint64, quint16> m_unsent{};
+  quint16 m_nextRequestId{1};
+  int m_defaultTimeout{DefaultTimeout};
+  quint64 m_lateReplies{0};
+
+  QElapsedTimer m_clock{};
+  QTimer* m_timeoutTimer{nullptr};
+  // when m_timeoutTimer fires, on m_clock
+  qint64 m_timerDeadline{0};
+};
@@ -0,0 +1,59 @@
+#include "rpcreply.hpp"
+
+#include "rpcclient.hpp"
+
+RpcReply::RpcReply(RpcClient* client, quint16 requestId, qint64 deadline,
+                   QObject* parent)
+    : QObject{parent},
+      m_client{client},
+      m_requestId{requestId},
+      m_deadline{deadline} {
+  m_clock.start();
+}
+
+RpcReply::~RpcReply() {
+  if (!isFinished() && m_client) {
+    m_client->release(this);
+  }
+}
+
+auto RpcReply::requestId() const -> quint16 { return m_requestId; }
+
+auto RpcReply::isFinished() const -> bool { return m_elapsedNs >= 0; }
+
+auto RpcReply::error() const -> Error { return m_error; }
+
+auto RpcReply::errorString() const -> QString { return m_errorString; }
+
+auto RpcReply::data() const -> QByteArray { return m_data; }
+
+auto RpcReply::elapsedUs() const -> qint64 {
+  return (isFinished() ? m_elapsedNs : m_clock.nsecsElapsed()) / 1000;
+}
+
+void RpcReply::abort() { fail(Error::Aborted, "Aborted"); }
+
+void RpcReply::finish(QByteArray data) {
+  if (isFinished()) {
+    return;
+  }
+  m_elapsedNs = m_clock.nsecsElapsed();
+  m_data = std::move(data);
+  if (m_client) {
+    m_client->release(this);
+  }
+  emit finished();
+}
+
+void RpcReply::fail(Error error, QString const& reason) {
+  if (isFinished()) {
+    return;
+  }
+  m_elapsedNs = m_clock.nsecsElapsed();
+  m_error = error;
+  m_errorString = reason;
+  if (m_client) {
+    m_client->release(this);
+  }
+  emit finished();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+class RpcClient;
+
+// The pending reply to a request sent with RpcClient::call. It finishes
+// once the peer replied or the call failed - timed out, couldn't be sent,
+// lost with the link or aborted. Whoever made the call deletes it, best
+// with deleteLater() once finished; left over replies go with the client.
+class RpcReply : public QObject
+{
+  Q_OBJECT
+
+ public:
+  enum class Error { NoError, Timeout, SendFailed, LinkLost, Aborted };
+  Q_ENUM(Error)
+
+  ~RpcReply() override;
+
+  auto requestId() const -> quint16;
+  auto isFinished() const -> bool;
+  auto error() const -> Error;
+  auto errorString() const -> QString;
+  // The body of the peer's reply, empty until then.
+  auto data() const -> QByteArray;
+  // From the call to the reply or the failure, or so far if neither came.
+  auto elapsedUs() const -> qint64;
+
+ public slots:
+  // Fails the call with Aborted; a reply that still comes is ignored.
+  void abort();
+
+ signals:
+  void finished();
+
+ private:
+  friend class RpcClient;
+
+  RpcReply(RpcClient* client, quint16 requestId, qint64 deadline,
+           QObject* parent = nullptr);
+
+  void finish(QByteArray data);
+  void fail(Error error, QString const& reason);
+
+  QPointer<RpcClient> m_client{};
+  quint16 m_requestId{0};
+  // of the request message on the link
+  quint64 m_messageId{0};
+  // on the clock of the client
+  qint64 m_deadline{0};
+  QElapsedTimer m_clock{};
+  qint64 m_elapsedNs{-1};
+
+  Error m_error{Error::NoError};
+  QString m_errorString{};
+  QByteArray m_data{};
+};
@@ -0,0 +1,304 @@
+#include "simulatedtransport.hpp"
+
+#include <algorithm>
+
+SimulatedTransport::SimulatedTransport(QObject* parent)
+    : BLETransport{parent} {
+  m_clock.start();
+  m_linkBusyUntilNs.assign(1, 0);
+
+  m_timer = new QTimer{this};
+  m_timer->setSingleShot(true);
+  m_timer->setTimerType(Qt::PreciseTimer);
+  QObject::connect(m_timer, &QTimer::timeout, this,
+                   &SimulatedTransport::deliverPending);
+}
+
+void SimulatedTransport::connectToDevice(QBluetoothDeviceInfo const& device,
+                                         QBluetoothUuid const&,
+                                         QBluetoothUuid const&) {
+  if (connected()) {
+    disconnectFromDevice();
+  }
+
+  m_remoteName = device.name();
+  m_remoteAddress = device.address();
+
+  // stay asynchronous, like a real controller
+  m_connecting = true;
+  QTimer::singleShot(0, this, [this]() {
+    if (!m_connecting) {
+      return;
+    }
+    m_connecting = false;
+    if (m_failConnections > 0) {
+      m_failConnections--;
+      emit connectionError(ConnectonError, "Simulated connection failure");
+      return;
+    }
+    m_quietChannels = std::min(m_failNotifySetups, m_bulkChannels);
+    m_failNotifySetups -= m_quietChannels;
+    m_connected = true;
+    emit connectedToDevice();
+    emit serviceDiscovered();
+    m_ready = true;
+    emit commsReady();
+  });
+}
+
+void SimulatedTransport::disconnectFromDevice() {
+  m_connecting = false;
+  m_timer->stop();
+  m_pending.clear();
+  m_linkBusyUntilNs.assign(static_cast<std::size_t>(m_bulkChannels) + 1, 0);
+  m_ready = false;
+  m_quietChannels = 0;
+
+  if (m_connected) {
+    m_connected = false;
+    emit disconnectedFromDevice();
+  }
+}
+
+void SimulatedTransport::write(QByteArray const& data, WriteMode mode) {
+  if (!ready()) {
+    QTimer::singleShot(0, this, &SimulatedTransport::writeFailed);
+    return;
+  }
+  writeChannel(MainChannel, data, mode);
+}
+
+void SimulatedTransport::writeBulk(int channel, QByteArray const& data,
+                                   WriteMode mode) {
+  if (!ready() || channel < 0 || channel >= m_bulkChannels) {
+    QTimer::singleShot(0, this,
+                       [this, channel]() { emit bulkWriteFailed(channel); });
+    return;
+  }
+  writeChannel(channel, data, mode);
+}
+
+auto SimulatedTransport::connected() const -> bool { return m_connected; }
+
+auto SimulatedTransport::ready() const -> bool { return m_ready; }
+
+auto SimulatedTransport::remoteName() const -> QString {
+  if (connected()) {
+    return m_remoteName;
+  }
+  return QString{};
+}
+
+auto SimulatedTransport::remoteAddress() const -> QBluetoothAddress {
+  if (connected()) {
+    return m_remoteAddress;
+  }
+  return QBluetoothAddress{};
+}
+
+auto SimulatedTransport::mtu() const -> int { return m_mtu; }
+
+auto SimulatedTransport::supportsWriteWithoutResponse() const -> bool {
+  return m_writeWithoutResponseSupported;
+}
+
+void SimulatedTransport::setBulkCharacteristics(
+    QList<QBluetoothUuid> const& charUuids) {
+  m_bulkChannels = charUuids.size();
+  if (!connected()) {
+    m_linkBusyUntilNs.assign(static_cast<std::size_t>(m_bulkChannels) + 1, 0);
+  }
+}
+
+auto SimulatedTransport::bulkChannelCount() const -> int {
+  return static_cast<int>(m_linkBusyUntilNs.size()) - 1;
+}
+
+auto SimulatedTransport::requestConnectionUpdate(
+    QLowEnergyConnectionParameters const& parameters) -> bool {
+  if (!connected()) {
+    return false;
+  }
+
+  // a real update takes effect a few connection events later
+  QTimer::singleShot(10, this, [this, parameters]() {
+    if (!connected()) {
+      return;
+    }
+    QLowEnergyConnectionParameters applied{parameters};
+    applied.setIntervalRange(parameters.minimumInterval(),
+                             parameters.minimumInterval());
+    setPacketDelay(static_cast<int>(parameters.minimumInterval() * 1000.0 /
+                                    PacketsPerConnectionEvent));
+    emit connectionUpdated(applied);
+  });
+  return true;
+}
+
+void SimulatedTransport::setMtu(int mtu) {
+  mtu = std::max(mtu, DefaultMtu);
+  if (m_mtu != mtu) {
+    m_mtu = mtu;
+    emit mtuChanged(m_mtu);
+  }
+}
+
+void SimulatedTransport::setNotificationChunkSize(int size) {
+  m_notificationChunkSize = std::max(size, 1);
+}
+
+void SimulatedTransport::setPacketDelay(int microseconds) {
+  m_packetDelayUs = std::max(microseconds, 0);
+}
+
+void SimulatedTransport::setLossRate(double probability) {
+  m_lossRate = std::clamp(probability, 0.0, 1.0);
+}
+
+void SimulatedTransport::setEchoEnabled(bool enabled) {
+  m_echoEnabled = enabled;
+}
+
+void SimulatedTransport::setWriteWithoutResponseSupported(bool supported) {
+  m_writeWithoutResponseSupported = supported;
+}
+
+void SimulatedTransport::setSeed(quint32 seed) { m_random.seed(seed); }
+
+void SimulatedTransport::failNextConnections(int count) {
+  m_failConnections = std::max(count, 0);
+}
+
+void SimulatedTransport::failNextNotifySetups(int count) {
+  m_failNotifySetups = std::max(count, 0);
+}
+
+auto SimulatedTransport::notificationChunkSize() const -> int {
+  return m_notificationChunkSize;
+}
+
+auto SimulatedTransport::packetDelay() const -> int { return m_packetDelayUs; }
+
+auto SimulatedTransport::lossRate() const -> double { return m_lossRate; }
+
+auto SimulatedTransport::echoEnabled() const -> bool { return m_echoEnabled; }
+
+auto SimulatedTransport::droppedPackets() const -> quint64 {
+  return m_droppedPackets;
+}
+
+void SimulatedTransport::injectNotification(QByteArray const& data,
+                                            int channel) {
+  if (!ready() || channel >= bulkChannelCount() ||
+      (channel != MainChannel && channel < m_quietChannels)) {
+    return;
+  }
+
+  for (int offset = 0; offset < data.size();
+       offset += m_notificationChunkSize) {
+    schedule(data.mid(offset, m_notificationChunkSize),
+             PacketKind::Notification, channel);
+  }
+}
+
+void SimulatedTransport::dropLink() {
+  // from the central's point of view the same as a disconnection
+  disconnectFromDevice();
+}
+
+void SimulatedTransport::deliverPending() {
+  qint64 now = m_clock.nsecsElapsed();
+
+  while (!m_pending.empty() && m_pending.front().dueNs <= now) {
+    Packet packet = std::move(m_pending.front());
+    m_pending.pop_front();
+
+    switch (packet.kind) {
+      case PacketKind::Notification:
+        if (packet.channel == MainChannel) {
+          emit dataReceived(packet.data);
+        } else {
+          emit bulkDataReceived(packet.channel, packet.data);
+        }
+        break;
+      case PacketKind::Write:
+        handlePeripheralPacket(packet.data, packet.channel);
+        break;
+      case PacketKind::WriteResponse:
+        break;
+    }
+
+    if (packet.completesWrite > 0) {
+      if (packet.channel == MainChannel) {
+        emit dataWritten(packet.completesWrite);
+      } else {
+        emit bulkDataWritten(packet.channel, packet.completesWrite);
+      }
+    }
+
+    // a receiver might have disconnected us in the meantime
+    if (!ready()) {
+      return;
+    }
+    now = m_clock.nsecsElapsed();
+  }
+
+  if (!m_pending.empty()) {
+    auto const waitNs = m_pending.front().dueNs - now;
+    m_timer->start(static_cast<int>((waitNs + 999'999) / 1'000'000));
+  }
+}
+
+void SimulatedTransport::writeChannel(int channel, QByteArray const& data,
+                                      WriteMode mode) {
+  // longer writes are split like an ATT prepared write would do it
+  int const packetSize = std::max(m_mtu - AttHeaderSize, 1);
+  bool const withResponse = mode == WriteMode::WithResponse ||
+                            !m_writeWithoutResponseSupported;
+  for (int offset = 0; offset < data.size(); offset += packetSize) {
+    bool const last = offset + packetSize >= data.size();
+    schedule(data.mid(offset, packetSize), PacketKind::Write, channel,
+             last && !withResponse ? data.size() : 0);
+  }
+
+  if (withResponse) {
+    schedule(QByteArray{}, PacketKind::WriteResponse, channel, data.size());
+  }
+}
+
+void SimulatedTransport::schedule(QByteArray const& data, PacketKind kind,
+                                  int channel, int completesWrite) {
+  // every link is serial - every packet occupies it for the configured delay
+  qint64 const now = m_clock.nsecsElapsed();
+  auto& busyUntilNs =
+      m_linkBusyUntilNs[static_cast<std::size_t>(channel + 1)];
+  busyUntilNs = std::max(now, busyUntilNs) +
+                static_cast<qint64>(m_packetDelayUs) * 1000;
+
+  if (kind == PacketKind::Notification &&
+      m_random.generateDouble() < m_lossRate) {
+    m_droppedPackets++;
+    return;
+  }
+
+  // links run side by side, so a packet may be due before ones scheduled
+  // earlier on another link
+  auto const position = std::upper_bound(
+      m_pending.begin(), m_pending.end(), busyUntilNs,
+      [](qint64 dueNs, Packet const& packet) { return dueNs < packet.dueNs; });
+  bool const first = position == m_pending.begin();
+  m_pending.insert(position,
+                   Packet{busyUntilNs, data, kind, channel, completesWrite});
+  if (first || !m_timer->isActive()) {
+    m_timer->start(0);
+  }
+}
+
+void SimulatedTransport::handlePeripheralPacket(QByteArray const& data,
+                                                int channel) {
+  emit peripheralReceived(data, channel);
+
+  if (m_echoEnabled) {
+    injectNotification(data, channel);
+  }
+}
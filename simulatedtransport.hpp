@@ -0,0 +1,134 @@
+#pragma once
+#include <QBluetoothAddress>
+#include <QBluetoothDeviceInfo>
+#include <QBluetoothUuid>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QRandomGenerator>
+#include <QString>
+#include <QTimer>
+#include <deque>
+#include <vector>
+
+#include "bletransport.hpp"
+
+// In-process stand-in for a BLE peripheral. Everything written by the central
+// is split into ATT packets of (MTU - 3) bytes, pushed through a serial link
+// with a fixed per-packet delay and, by default, echoed back as notifications
+// of at most notificationChunkSize bytes - the way an HM-10 forwards its UART.
+// Writes with response occupy the link for one more packet (the response)
+// before they complete. Notifications can be dropped with the configured
+// probability. A connection update takes the lowest interval asked for and
+// sets the packet delay to fit PacketsPerConnectionEvent in it.
+// The peripheral has every bulk characteristic asked for. Each characteristic
+// has a serial link of its own, the way stacks that limit the packets per
+// characteristic and connection event behave.
+class SimulatedTransport : public BLETransport
+{
+  Q_OBJECT
+
+ public:
+  static constexpr int PacketsPerConnectionEvent{6};
+  static constexpr int MainChannel{-1};
+
+  explicit SimulatedTransport(QObject* parent = nullptr);
+
+  void connectToDevice(QBluetoothDeviceInfo const& device,
+                       QBluetoothUuid const& serviceUuid,
+                       QBluetoothUuid const& charUuid) override;
+  void disconnectFromDevice() override;
+
+  void write(QByteArray const& data, WriteMode mode) override;
+
+  auto connected() const -> bool override;
+  auto ready() const -> bool override;
+  auto remoteName() const -> QString override;
+  auto remoteAddress() const -> QBluetoothAddress override;
+  auto mtu() const -> int override;
+  auto supportsWriteWithoutResponse() const -> bool override;
+  auto requestConnectionUpdate(
+      QLowEnergyConnectionParameters const& parameters) -> bool override;
+  void setBulkCharacteristics(QList<QBluetoothUuid> const& charUuids) override;
+  auto bulkChannelCount() const -> int override;
+  void writeBulk(int channel, QByteArray const& data, WriteMode mode) override;
+
+  void setMtu(int mtu);
+  void setNotificationChunkSize(int size);
+  void setPacketDelay(int microseconds);
+  void setLossRate(double probability);
+  void setEchoEnabled(bool enabled);
+  void setWriteWithoutResponseSupported(bool supported);
+  void setSeed(quint32 seed);
+
+  auto notificationChunkSize() const -> int;
+  auto packetDelay() const -> int;
+  auto lossRate() const -> double;
+  auto echoEnabled() const -> bool;
+  auto droppedPackets() const -> quint64;
+
+  // Sends data from the peripheral side, chunked like an echoed write, on
+  // the main characteristic or a bulk channel.
+  void injectNotification(QByteArray const& data, int channel = MainChannel);
+  // Loses the link as if the peripheral went out of range; whatever is on
+  // the way in either direction is lost.
+  void dropLink();
+  // The next count connection attempts end with a connection error.
+  void failNextConnections(int count);
+  // The next count bulk characteristics refuse to notify, as if enabling
+  // their notifications failed: the link gets ready regardless, but nothing
+  // comes in on them.
+  void failNextNotifySetups(int count);
+
+ signals:
+  // channel is MainChannel for the main characteristic
+  void peripheralReceived(QByteArray const& data, int channel);
+
+ private slots:
+  void deliverPending();
+
+ private:
+  enum class PacketKind { Notification, Write, WriteResponse };
+
+  struct Packet {
+    qint64 dueNs;
+    QByteArray data;
+    PacketKind kind;
+    int channel;
+    // bytes of the write completed once this packet is delivered
+    int completesWrite;
+  };
+
+  void writeChannel(int channel, QByteArray const& data, WriteMode mode);
+  void schedule(QByteArray const& data, PacketKind kind, int channel,
+                int completesWrite = 0);
+  void handlePeripheralPacket(QByteArray const& data, int channel);
+
+  QElapsedTimer m_clock{};
+  QTimer* m_timer{nullptr};
+  QRandomGenerator m_random{};
+  // in delivery order, which differs from the order scheduled across
+  // characteristics
+  std::deque<Packet> m_pending{};
+  // by channel + 1
+  std::vector<qint64> m_linkBusyUntilNs{};
+  int m_bulkChannels{0};
+
+  int m_mtu{23};
+  int m_notificationChunkSize{20};
+  int m_packetDelayUs{0};
+  double m_lossRate{0.0};
+  bool m_echoEnabled{true};
+  bool m_writeWithoutResponseSupported{true};
+  quint64 m_droppedPackets{0};
+
+  bool m_connecting{false};
+  bool m_connected{false};
+  bool m_ready{false};
+  int m_failConnections{0};
+  int m_failNotifySetups{0};
+  // the first bulk channels of this connection, which don't notify
+  int m_quietChannels{0};
+  QString m_remoteName{};
+  QBluetoothAddress m_remoteAddress{};
+};
@@ -0,0 +1,204 @@
+#include "transmitqueue.hpp"
+
+#include <algorithm>
+
+void TransmitQueue::setLimits(int maxMessages, qint64 maxBytes) {
+  m_maxMessages = std::max(maxMessages, 1);
+  m_maxBytes = std::max<qint64>(maxBytes, 1);
+}
+
+void TransmitQueue::setWaterMarks(qint64 highWater, qint64 lowWater) {
+  m_highWater = std::max<qint64>(highWater, 1);
+  m_lowWater = std::clamp<qint64>(lowWater, 0, m_highWater - 1);
+}
+
+auto TransmitQueue::push(QByteArray const& frame, Priority priority,
+                         quint64 id) -> bool {
+  if (id != 0 && (m_messages >= m_maxMessages ||
+                  m_bytes + frame.size() > m_maxBytes)) {
+    return false;
+  }
+
+  auto& queue = priority == Priority::High ? m_high : m_normal;
+  queue.push_back(Entry{id, frame});
+  m_messages++;
+  m_bytes += frame.size();
+  return true;
+}
+
+auto TransmitQueue::hasQueued() const -> bool {
+  return !m_high.empty() || !m_normal.empty();
+}
+
+auto TransmitQueue::hasQueued(Priority priority) const -> bool {
+  return priority == Priority::High ? !m_high.empty() : !m_normal.empty();
+}
+
+auto TransmitQueue::takeNext(int track) -> QByteArray {
+  return take(std::nullopt, track);
+}
+
+auto TransmitQueue::takeBatch(int maxBytes, int track) -> QByteArray {
+  return batch(maxBytes, std::nullopt, track);
+}
+
+auto TransmitQueue::takeNext(Priority priority, int track) -> QByteArray {
+  return take(priority, track);
+}
+
+auto TransmitQueue::takeBatch(int maxBytes, Priority priority, int track)
+    -> QByteArray {
+  return batch(maxBytes, priority, track);
+}
+
+void TransmitQueue::acknowledge(int bytes, bool delivered, int track) {
+  auto& inFlight = m_inFlight[track];
+  while (bytes > 0 && !inFlight.empty()) {
+    auto& message = inFlight.front();
+    int const used = std::min(bytes, message.remainingBytes);
+
+    message.remainingBytes -= used;
+    message.delivered = message.delivered && delivered;
+    bytes -= used;
+    m_bytes -= used;
+    m_inFlightBytes[track] -= used;
+
+    if (message.remainingBytes == 0) {
+      complete(message.id, message.delivered);
+      inFlight.pop_front();
+      m_messages--;
+    }
+  }
+}
+
+void TransmitQueue::clear() {
+  for (auto const& inFlight : m_inFlight) {
+    for (auto const& message : inFlight) {
+      complete(message.id, false);
+    }
+  }
+  for (auto const& entry : m_high) {
+    complete(entry.id, false);
+  }
+  for (auto const& entry : m_normal) {
+    complete(entry.id, false);
+  }
+
+  for (auto& inFlight : m_inFlight) {
+    inFlight.clear();
+  }
+  m_high.clear();
+  m_normal.clear();
+  m_messages = 0;
+  m_bytes = 0;
+  m_inFlightBytes.fill(0);
+}
+
+auto TransmitQueue::popCompletion(Completion& completion) -> bool {
+  if (m_completions.empty()) {
+    return false;
+  }
+
+  completion = m_completions.front();
+  m_completions.pop_front();
+  return true;
+}
+
+auto TransmitQueue::updateCongestion() -> bool {
+  bool const congested =
+      m_congested
+          ? (m_bytes > m_lowWater || m_messages > m_maxMessages / 4)
+          : (m_bytes >= m_highWater || m_messages >= m_maxMessages * 3 / 4);
+  if (congested == m_congested) {
+    return false;
+  }
+
+  m_congested = congested;
+  return true;
+}
+
+auto TransmitQueue::hasHighPriority() const -> bool { return !m_high.empty(); }
+
+auto TransmitQueue::waitingBytes() const -> qint64 {
+  return m_bytes - inFlightBytes();
+}
+
+auto TransmitQueue::congested() const -> bool { return m_congested; }
+
+auto TransmitQueue::messages() const -> int { return m_messages; }
+
+auto TransmitQueue::bytes() const -> qint64 { return m_bytes; }
+
+auto TransmitQueue::inFlightBytes() const -> qint64 {
+  qint64 bytes{0};
+  for (auto const trackBytes : m_inFlightBytes) {
+    bytes += trackBytes;
+  }
+  return bytes;
+}
+
+auto TransmitQueue::inFlightBytes(int track) const -> qint64 {
+  return m_inFlightBytes[track];
+}
+
+auto TransmitQueue::maxMessages() const -> int { return m_maxMessages; }
+
+auto TransmitQueue::maxBytes() const -> qint64 { return m_maxBytes; }
+
+auto TransmitQueue::nextQueue(std::optional<Priority> only)
+    -> std::deque<Entry>* {
+  if (!m_high.empty() && only.value_or(Priority::High) == Priority::High) {
+    return &m_high;
+  }
+  if (!m_normal.empty() &&
+      only.value_or(Priority::Normal) == Priority::Normal) {
+    return &m_normal;
+  }
+  return nullptr;
+}
+
+auto TransmitQueue::take(std::optional<Priority> only, int track)
+    -> QByteArray {
+  auto* queue = nextQueue(only);
+  if (queue == nullptr) {
+    return QByteArray{};
+  }
+
+  Entry entry = std::move(queue->front());
+  queue->pop_front();
+  markInFlight(entry, track);
+  return entry.frame;
+}
+
+auto TransmitQueue::batch(int maxBytes, std::optional<Priority> only,
+                          int track) -> QByteArray {
+  auto* first = nextQueue(only);
+  if (first == nullptr || first->front().frame.size() >= maxBytes) {
+    return take(only, track);
+  }
+
+  QByteArray frames{};
+  frames.reserve(maxBytes);
+  while (auto* queue = nextQueue(only)) {
+    if (frames.size() + queue->front().frame.size() > maxBytes) {
+      break;
+    }
+
+    Entry entry = std::move(queue->front());
+    queue->pop_front();
+    markInFlight(entry, track);
+    frames.append(entry.frame);
+  }
+  return frames;
+}
+
+void TransmitQueue::markInFlight(Entry const& entry, int track) {
+  m_inFlight[track].push_back(InFlight{entry.id, entry.frame.size(), true});
+  m_inFlightBytes[track] += entry.frame.size();
+}
+
+void TransmitQueue::complete(quint64 id, bool delivered) {
+  if (id != 0) {
+    m_completions.push_back(Completion{id, delivered});
+  }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <QByteArray>
+#include <array>
+#include <deque>
+#include <optional>
+
+// Outgoing frames of BLERFComm, waiting either for their turn or for the link
+// to finish writing them. High priority frames overtake normal ones that were
+// not handed to the link yet. The queue is bounded by message count and bytes
+// and reports congestion between high and low water marks - on bytes, and at
+// 3/4 and 1/4 of the message limit.
+// Frames taken from the queue are in flight on one of TrackCount tracks,
+// which complete independently of each other, each in the order its frames
+// were taken.
+class TransmitQueue
+{
+ public:
+  enum class Priority { High, Normal };
+
+  static constexpr int TrackCount{2};
+
+  struct Completion {
+    quint64 id;
+    bool delivered;
+  };
+
+  void setLimits(int maxMessages, qint64 maxBytes);
+  void setWaterMarks(qint64 highWater, qint64 lowWater);
+
+  // Frames with id 0 are protocol-internal - they're never rejected and their
+  // completion is not reported.
+  auto push(QByteArray const& frame, Priority priority, quint64 id) -> bool;
+  auto hasQueued() const -> bool;
+  auto hasQueued(Priority priority) const -> bool;
+  // Hands the next frame to the link, high priority first.
+  auto takeNext(int track = 0) -> QByteArray;
+  // Like takeNext, but packs as many following frames as fit in maxBytes
+  // into the same buffer. A single longer frame is returned on its own.
+  auto takeBatch(int maxBytes, int track = 0) -> QByteArray;
+  // The same for the frames of one priority only.
+  auto takeNext(Priority priority, int track) -> QByteArray;
+  auto takeBatch(int maxBytes, Priority priority, int track) -> QByteArray;
+  // Accounts bytes the link is done with, in the order they were taken.
+  void acknowledge(int bytes, bool delivered, int track = 0);
+  // Drops everything, queued and in flight.
+  void clear();
+
+  auto popCompletion(Completion& completion) -> bool;
+  // Returns true when the congestion state flipped.
+  auto updateCongestion() -> bool;
+
+  auto hasHighPriority() const -> bool;
+  // Bytes not handed to the link yet.
+  auto waitingBytes() const -> qint64;
+  auto congested() const -> bool;
+  auto messages() const -> int;
+  auto bytes() const -> qint64;
+  auto inFlightBytes() const -> qint64;
+  auto inFlightBytes(int track) const -> qint64;
+  auto maxMessages() const -> int;
+  auto maxBytes() const -> qint64;
+
+ private:
+  struct Entry {
+    quint64 id;
+    QByteArray frame;
+  };
+
+  struct InFlight {
+    quint64 id;
+    int remainingBytes;
+    bool delivered;
+  };
+
+  // where the next frame comes from, of the given priority only if set;
+  // nullptr if there's none
+  auto nextQueue(std::optional<Priority> only) -> std::deque<Entry>*;
+  auto take(std::optional<Priority> only, int track) -> QByteArray;
+  auto batch(int maxBytes, std::optional<Priority> only, int track)
+      -> QByteArray;
+  void markInFlight(Entry const& entry, int track);
+  void complete(quint64 id, bool delivered);
+
+  std::deque<Entry> m_high{};
+  std::deque<Entry> m_normal{};
+  std::array<std::deque<InFlight>, TrackCount> m_inFlight{};
+  std::deque<Completion> m_completions{};
+
+  int m_messages{0};
+  qint64 m_bytes{0};
+  std::array<qint64, TrackCount> m_inFlightBytes{};
+
+  int m_maxMessages{256};
+  qint64 m_maxBytes{256 * 1024};
+  qint64 m_highWater{192 * 1024};
+  qint64 m_lowWater{64 * 1024};
+  bool m_congested{false};
+};
@@ -1,46 +1,192 @@
 #include "uicontroller.hpp"
 
-UIController::UIController(QObject *parent) : QObject(parent) {
+#include <QDateTime>
+#include <QDir>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <algorithm>
+
+#include "replaytransport.hpp"
+
+namespace {
+// Binary messages, like MessageSchema ones, would come out of fromUtf8
+// mangled, so anything that isn't plain text is shown in hex.
+QString describeMessage(QByteArray const &data) {
+  auto const text = QString::fromUtf8(data);
+  bool const binary =
+      std::any_of(text.cbegin(), text.cend(), [](QChar character) {
+        return character == QChar::ReplacementCharacter ||
+               (character.category() == QChar::Other_Control &&
+                character != '\n' && character != '\r' && character != '\t');
+      });
+  if (!binary) {
+    return text;
+  }
+  return QString("[%1 bytes] %2")
+      .arg(data.size())
+      .arg(QString::fromLatin1(data.toHex(' ')));
+}
+}  // namespace
+
+UIController::UIController(IoMode ioMode, QObject *parent) : QObject(parent) {
   m_scanner = new BLEScanner{this};
-  m_comm = new BLERFComm{this};
+  m_devices = new DeviceModel{m_scanner, this};
+  m_log = new LogModel{this};
+
+  if (ioMode == IoMode::WorkerThread) {
+    m_ioThread = new QThread{this};
+    m_ioThread->setObjectName("BLE I/O");
+    m_comm = new BLERFComm{};
+    m_comm->moveToThread(m_ioThread);
+    QObject::connect(m_ioThread, &QThread::finished, m_comm,
+                     &QObject::deleteLater);
+  } else {
+    m_comm = new BLERFComm{this};
+  }
+  m_maximumMessageSize = m_comm->maximumMessageSize();
+
+  // the counters are atomic, so sampling them from here is fine either way
+  m_metrics = new MetricsReporter{this};
+  m_metrics->setMetrics(m_comm->metrics());
+
+  m_deviceCache = std::make_shared<DeviceCache>();
+  m_deviceCache->load();
+  m_comm->setDeviceCache(m_deviceCache);
+
+  // about one view update per frame
+  m_logTimer = new QTimer{this};
+  m_logTimer->setSingleShot(true);
+  m_logTimer->setInterval(16);
+  QObject::connect(m_logTimer, &QTimer::timeout, this,
+                   &UIController::flushLog);
 
   QObject::connect(m_scanner, &BLEScanner::scanCompleted, this,
                    &UIController::bleScanCompletedHandler);
-  QObject::connect(m_scanner, &BLEScanner::scanCompleted, this,
-                   &UIController::bleScanCompleted);
+  QObject::connect(m_scanner, &BLEScanner::scanCancelled, this,
+                   [&]() { m_connectOnScanMatch = false; });
   QObject::connect(m_scanner, &BLEScanner::scanError, this,
                    &UIController::bleScanErrorHandler);
 
-  QObject::connect(m_comm, &BLERFComm::deviceReady, this,
-                   &UIController::bleDeviceReady);
+  QObject::connect(m_comm, &BLERFComm::deviceReady, this, [&]() {
+    m_deviceReady = true;
+    emit bleDeviceReady();
+  });
   QObject::connect(m_comm, &BLERFComm::connectedToDevice, this,
                    &UIController::bleDeviceConnected);
-  QObject::connect(m_comm, &BLERFComm::disconnectedFromDevice, this,
-                   &UIController::bleDeviceDisconnected);
   QObject::connect(
-      m_comm, &BLERFComm::connectionError,
+      m_comm, &BLERFComm::timeToReady, this,
+      [&](qint64 connectMs, qint64 serviceDiscoveryMs,
+          qint64 characteristicDiscoveryMs, bool fromCache) {
+        logMessage(QString("Ready in %1 ms (%2): connect %3 ms, service %4 "
+                           "ms, characteristic %5 ms")
+                       .arg(connectMs + serviceDiscoveryMs +
+                            characteristicDiscoveryMs)
+                       .arg(fromCache ? "cached device details"
+                                      : "full discovery")
+                       .arg(connectMs)
+                       .arg(serviceDiscoveryMs)
+                       .arg(characteristicDiscoveryMs));
+      });
+  QObject::connect(m_comm, &BLERFComm::reconnecting, this,
+                   [&](int attempt, int delayMs) {
+                     logMessage(QString("Link lost, reconnect attempt %1 in "
+                                        "%2 ms")
+                                    .arg(attempt)
+                                    .arg(delayMs),
+                                LogModel::Warning);
+                   });
+  QObject::connect(m_comm, &BLERFComm::reconnectFailed, this, [&]() {
+    logMessage("Giving up reconnecting", LogModel::Error);
+  });
+  // handled on the I/O thread, logMessage is safe to call from there
+  auto *tuner = m_comm->comm()->connectionTuner();
+  QObject::connect(
+      tuner, &ConnectionTuner::parametersApplied, m_comm,
+      [this](ConnectionTuner::Mode mode,
+             QLowEnergyConnectionParameters const &parameters) {
+        logMessage(QString("Connection parameters (%1): interval %2-%3 ms, "
+                           "latency %4, timeout %5 ms")
+                       .arg(ConnectionTuner::modeName(mode))
+                       .arg(parameters.minimumInterval())
+                       .arg(parameters.maximumInterval())
+                       .arg(parameters.latency())
+                       .arg(parameters.supervisionTimeout()));
+      });
+  QObject::connect(tuner, &ConnectionTuner::effectMeasured, m_comm,
+                   [this](ConnectionTuner::Mode, ConnectionTuner::Sample before,
+                          ConnectionTuner::Sample after) {
+                     logMessage(QString("Throughput %1 -> %2 B/s, write "
+                                        "latency %3 -> %4 us")
+                                    .arg(before.bytesPerSecond, 0, 'f', 0)
+                                    .arg(after.bytesPerSecond, 0, 'f', 0)
+                                    .arg(before.writeLatencyUs, 0, 'f', 0)
+                                    .arg(after.writeLatencyUs, 0, 'f', 0));
+                   });
+  QObject::connect(m_comm, &BLERFComm::disconnectedFromDevice, this, [&]() {
+    m_deviceReady = false;
+    emit bleDeviceDisconnected();
+  });
+  QObject::connect(
+      m_comm, &BLERFComm::connectionError, this,
       [&](BLEComm::Error error, QString const &description) {
         QString errorMessage =
             QString("Device error #%1: %2").arg(error).arg(description);
         emit bleDeviceError(errorMessage);
       });
-  QObject::connect(m_comm, &BLERFComm::dataReceived,
+  QObject::connect(m_comm, &BLERFComm::maximumMessageSizeChanged, this,
+                   [&](int maximumMessageSize) {
+                     m_maximumMessageSize = maximumMessageSize;
+                     emit maximumMessageSizeChanged(maximumMessageSize);
+                   });
+  // decoded right where the frame arrives, so it doesn't have to be copied
+  // out of the receive buffer
+  QObject::connect(m_comm, &BLERFComm::dataReceived, m_comm,
                    [&](QByteArray const &data) {
-                     emit messageReceived(QString::fromUtf8(data));
+                     queueLogEntry(describeMessage(data), LogModel::Incoming,
+                                   LogModel::Normal);
                    });
+  // the sink has to be set before the signal returns
+  QObject::connect(m_comm, &BLERFComm::incomingBlob, m_comm,
+                   [&](BlobTransfer *transfer) { receiveBlob(transfer); },
+                   Qt::DirectConnection);
+
+  restoreKnownDevices();
+
+  if (m_ioThread != nullptr) {
+    m_ioThread->start();
+  }
+}
+
+UIController::~UIController() {
+  if (m_ioThread != nullptr) {
+    m_ioThread->quit();
+    m_ioThread->wait();
+  }
 }
 
 int UIController::serviceUuid() const { return m_serviceUuid; }
 
 int UIController::charUuid() const { return m_charUuid; }
 
-QStringList UIController::bleDeviceDescriptionList() const {
-  return m_bleDeviceDescriptionList;
-}
+DeviceModel *UIController::devices() const { return m_devices; }
 
-bool UIController::isConnectedToDevice() const {
-  return m_comm->isDeviceReady();
-}
+bool UIController::extendedFraming() const { return m_extendedFraming; }
+
+int UIController::maximumMessageSize() const { return m_maximumMessageSize; }
+
+LogModel *UIController::log() const { return m_log; }
+
+int UIController::logUpdateInterval() const { return m_logTimer->interval(); }
+
+MetricsReporter *UIController::metrics() const { return m_metrics; }
+
+bool UIController::autoReconnect() const { return m_autoReconnect; }
+
+bool UIController::reliableDelivery() const { return m_reliableDelivery; }
+
+bool UIController::compression() const { return m_compression; }
+
+bool UIController::isConnectedToDevice() const { return m_deviceReady; }
 
 void UIController::setServiceUuid(int serviceUuid) {
   if (m_serviceUuid == serviceUuid) {
@@ -53,7 +199,9 @@ void UIController::setServiceUuid(int serviceUuid) {
   }
 
   m_serviceUuid = serviceUuid;
-  m_comm->setServiceUuid(QBluetoothUuid(static_cast<quint16>(serviceUuid)));
+  QMetaObject::invokeMethod(m_comm, [this, serviceUuid]() {
+    m_comm->setServiceUuid(QBluetoothUuid(static_cast<quint16>(serviceUuid)));
+  });
   emit serviceUuidChanged(m_serviceUuid);
 }
 
@@ -66,7 +214,9 @@ void UIController::setCharUuid(int charUuid) {
   }
 
   m_charUuid = charUuid;
-  m_comm->setCharUuid(QBluetoothUuid(static_cast<quint16>(charUuid)));
+  QMetaObject::invokeMethod(m_comm, [this, charUuid]() {
+    m_comm->setCharUuid(QBluetoothUuid(static_cast<quint16>(charUuid)));
+  });
   emit charUuidChanged(m_charUuid);
 }
 
@@ -78,36 +228,282 @@ void UIController::setCharUuid(const QString &charUuid) {
   setCharUuid(charUuid.toUInt(nullptr, 16));
 }
 
+void UIController::setExtendedFraming(bool enabled) {
+  if (extendedFraming() == enabled) {
+    return;
+  }
+
+  m_extendedFraming = enabled;
+  QMetaObject::invokeMethod(m_comm, [this, enabled]() {
+    m_comm->setExtendedFramingEnabled(enabled);
+  });
+  emit extendedFramingChanged(enabled);
+}
+
+void UIController::setLogUpdateInterval(int milliseconds) {
+  milliseconds = std::max(milliseconds, 0);
+  if (logUpdateInterval() == milliseconds) {
+    return;
+  }
+
+  m_logTimer->setInterval(milliseconds);
+  emit logUpdateIntervalChanged(milliseconds);
+}
+
+void UIController::setAutoReconnect(bool enabled) {
+  if (m_autoReconnect == enabled) {
+    return;
+  }
+
+  m_autoReconnect = enabled;
+  QMetaObject::invokeMethod(m_comm, [this, enabled]() {
+    m_comm->comm()->setAutoReconnect(enabled);
+  });
+  emit autoReconnectChanged(enabled);
+}
+
+void UIController::setReliableDelivery(bool enabled) {
+  if (m_reliableDelivery == enabled) {
+    return;
+  }
+
+  m_reliableDelivery = enabled;
+  QMetaObject::invokeMethod(m_comm, [this, enabled]() {
+    m_comm->setReliableDeliveryEnabled(enabled);
+  });
+  emit reliableDeliveryChanged(enabled);
+}
+
+void UIController::setCompression(bool enabled) {
+  if (m_compression == enabled) {
+    return;
+  }
+
+  m_compression = enabled;
+  QMetaObject::invokeMethod(m_comm, [this, enabled]() {
+    m_comm->setCompressionEnabled(enabled);
+  });
+  emit compressionChanged(enabled);
+}
+
+void UIController::setConnectionProfiles(ConnectionProfiles const &profiles) {
+  QMetaObject::invokeMethod(m_comm, [this, profiles]() {
+    m_comm->comm()->setConnectionProfiles(profiles);
+  });
+}
+
+void UIController::startCapture(QString const &path) {
+  QMetaObject::invokeMethod(m_comm, [this, path]() {
+    bool const started = m_comm->comm()->startCapture(path);
+    QMetaObject::invokeMethod(this, [this, path, started]() {
+      if (started) {
+        logMessage(QString("Capturing raw traffic to %1").arg(path));
+      } else {
+        emit bleDeviceError(QString("Cannot write capture file %1").arg(path));
+      }
+    });
+  });
+}
+
+void UIController::replayCapture(QString const &path, bool realTime) {
+  logMessage(QString("Replaying %1").arg(path));
+  QMetaObject::invokeMethod(m_comm, [this, path, realTime]() {
+    auto *transport = new ReplayTransport{
+        path, realTime ? ReplayTransport::Mode::RealTime
+                       : ReplayTransport::Mode::Fast};
+    QObject::connect(transport, &ReplayTransport::replayFinished, this,
+                     [this](quint64 notifications, bool corrupted) {
+                       logMessage(QString("Replay finished, %1 notifications%2")
+                                      .arg(notifications)
+                                      .arg(corrupted ? " (file truncated)"
+                                                     : ""));
+                     });
+    m_comm->setTransport(transport);
+    m_comm->connectToDevice(
+        QBluetoothDeviceInfo{QBluetoothAddress{}, "Replay", 0});
+  });
+}
+
+void UIController::logMessage(QString const &text,
+                              LogModel::Severity severity) {
+  queueLogEntry(text, LogModel::Local, severity);
+}
+
 void UIController::connectToDevice(int deviceIndex) {
   if (serviceUuid() == -1 || charUuid() == -1 || deviceIndex < 0 ||
-      deviceIndex >= m_bleDeviceDescriptionList.length()) {
+      deviceIndex >= m_scanner->deviceList().size()) {
+    return;
+  }
+
+  auto const device = m_scanner->deviceList().at(deviceIndex);
+  QMetaObject::invokeMethod(
+      m_comm, [this, device]() { m_comm->connectToDevice(device); });
+}
+
+void UIController::connectToFirstDevice() {
+  if (serviceUuid() == -1 || charUuid() == -1) {
     return;
   }
 
-  m_comm->connectToDevice(m_scanner->deviceList().at(deviceIndex));
+  BLEScanner::Filter filter{};
+  filter.serviceUuids.append(
+      QBluetoothUuid(static_cast<quint16>(serviceUuid())));
+  filter.stopOnFirstMatch = true;
+
+  m_connectOnScanMatch = true;
+  m_scanner->scanFor(filter);
 }
 
-void UIController::disconnectFromDevice() { m_comm->disconnectFromDevice(); }
+void UIController::disconnectFromDevice() {
+  QMetaObject::invokeMethod(m_comm, &BLERFComm::disconnectFromDevice);
+}
 
 void UIController::scanForDevices() {
+  m_connectOnScanMatch = false;
   m_scanner->scan();
 }
 
 void UIController::sendMessageToDevice(const QString &message) {
-  m_comm->sendData(message.toUtf8());
+  auto const data = message.toUtf8();
+  if (data.size() > m_maximumMessageSize) {
+    emit bleDeviceError(QString("Message is too long (limit is %1 bytes)")
+                            .arg(m_maximumMessageSize));
+    return;
+  }
+
+  queueLogEntry(QString("ᐅ %1").arg(message), LogModel::Outgoing,
+                LogModel::Normal);
+  QMetaObject::invokeMethod(m_comm, [this, data]() {
+    if (m_comm->sendData(data) == 0) {
+      // the same checks queueFrame makes before the queue's limits
+      bool const notReady =
+          !m_comm->isDeviceReady() && !m_comm->comm()->isReconnecting();
+      QMetaObject::invokeMethod(this, [this, notReady]() {
+        emit bleDeviceError(notReady
+                                ? "Device not ready, message dropped"
+                                : "Transmit queue is full, message dropped");
+      });
+    }
+  });
+}
+
+void UIController::sendFile(QString const &path) {
+  QMetaObject::invokeMethod(m_comm, [this, path]() {
+    watchBlob(m_comm->sendFile(path), QString("Sending %1").arg(path));
+  });
 }
 
-void UIController::bleScanCompletedHandler(int) {
-  m_bleDeviceDescriptionList.clear();
-  for (auto const &device : m_scanner->deviceList()) {
-    m_bleDeviceDescriptionList.append(
-        QString("%1 (%2)").arg(device.name(), device.address().toString()));
+void UIController::watchBlob(BlobTransfer *transfer, QString const &what) {
+  logMessage(what);
+  QObject::connect(transfer, &BlobTransfer::finished, m_comm,
+                   [this, transfer, what]() {
+                     logMessage(QString("%1: done, %2 bytes in %3 ms "
+                                        "(%4 KiB/s)")
+                                    .arg(what)
+                                    .arg(transfer->totalBytes())
+                                    .arg(transfer->elapsedMs())
+                                    .arg(transfer->throughput() / 1024.0, 0,
+                                         'f', 1));
+                   });
+  QObject::connect(transfer, &BlobTransfer::failed, m_comm,
+                   [this, transfer, what](QString const &reason) {
+                     logMessage(QString("%1: %2 at byte %3")
+                                    .arg(what)
+                                    .arg(reason)
+                                    .arg(transfer->bytesTransferred()),
+                                LogModel::Error);
+                   });
+}
+
+void UIController::receiveBlob(BlobTransfer *transfer) {
+  // no path separators or dot names from the device
+  auto name = transfer->name();
+  name.replace(QRegularExpression{"[/\\\\:]"}, "_");
+  if (name.isEmpty() || name.startsWith('.')) {
+    name = QString("blob-%1").arg(QDateTime::currentMSecsSinceEpoch());
+  }
+  auto const path =
+      QDir{QStandardPaths::writableLocation(QStandardPaths::DownloadLocation)}
+          .filePath(name);
+
+  if (!transfer->saveTo(path)) {
+    logMessage(QString("Cannot save %1: %2").arg(path, transfer->errorString()),
+               LogModel::Error);
+    return;
+  }
+  watchBlob(transfer, QString("Receiving %1").arg(path));
+}
+
+void UIController::bleScanCompletedHandler(int foundDevices) {
+  if (!m_connectOnScanMatch) {
+    emit bleScanCompleted(foundDevices);
+    return;
+  }
+
+  m_connectOnScanMatch = false;
+  if (foundDevices == 0) {
+    emit bleDeviceError(
+        QString("No device advertising service 0x%1 found")
+            .arg(serviceUuid(), 4, 16, QChar('0'))
+            .toUpper());
+    return;
   }
 
-  emit bleDeviceDescriptionListChanged(m_bleDeviceDescriptionList);
+  connectToDevice(0);
 }
 
 void UIController::bleScanErrorHandler(QBluetoothDeviceDiscoveryAgent::Error,
                                        const QString &description) {
   emit bleScanError(description);
 }
+
+void UIController::flushLog() {
+  std::vector<LogModel::Entry> entries{};
+  {
+    std::lock_guard<std::mutex> lock{m_pendingLogMutex};
+    entries.swap(m_pendingLog);
+  }
+  m_log->append(std::move(entries));
+}
+
+void UIController::queueLogEntry(QString const &text,
+                                 LogModel::Direction direction,
+                                 LogModel::Severity severity) {
+  bool first{false};
+  {
+    std::lock_guard<std::mutex> lock{m_pendingLogMutex};
+    first = m_pendingLog.empty();
+    m_pendingLog.push_back(LogModel::Entry{
+        QDateTime::currentMSecsSinceEpoch(), direction, severity, text});
+  }
+
+  // the timer lives on the GUI thread
+  if (first) {
+    QMetaObject::invokeMethod(m_logTimer, [this]() {
+      if (!m_logTimer->isActive()) {
+        m_logTimer->start();
+      }
+    });
+  }
+}
+
+void UIController::restoreKnownDevices() {
+  // known devices can be connected to without scanning first
+  auto const entries = m_deviceCache->entries();
+  for (auto const &entry : entries) {
+    m_scanner->addKnownDevice(entry.deviceInfo());
+  }
+
+  if (entries.empty()) {
+    return;
+  }
+
+  bool serviceOk{false};
+  bool charOk{false};
+  auto const service = entries.front().serviceUuid.toUInt16(&serviceOk);
+  auto const characteristic = entries.front().charUuid.toUInt16(&charOk);
+  if (serviceOk && charOk) {
+    setServiceUuid(service);
+    setCharUuid(characteristic);
+  }
+}
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <QObject>
-#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "blerfcomm.hpp"
 #include "blescanner.hpp"
+#include "devicecache.hpp"
+#include "devicemodel.hpp"
+#include "logmodel.hpp"
+#include "metricsreporter.hpp"
 
 class UIController : public QObject
 {
@@ -14,23 +22,70 @@ class UIController : public QObject
                  serviceUuidChanged)
   Q_PROPERTY(
       int charUuid READ charUuid WRITE setCharUuid NOTIFY charUuidChanged)
-  Q_PROPERTY(QStringList bleDeviceDescriptionList READ bleDeviceDescriptionList
-                 NOTIFY bleDeviceDescriptionListChanged)
+  Q_PROPERTY(DeviceModel* devices READ devices CONSTANT)
+  Q_PROPERTY(bool extendedFraming READ extendedFraming WRITE
+                 setExtendedFraming NOTIFY extendedFramingChanged)
+  Q_PROPERTY(int maximumMessageSize READ maximumMessageSize NOTIFY
+                 maximumMessageSizeChanged)
+  Q_PROPERTY(LogModel* log READ log CONSTANT)
+  Q_PROPERTY(int logUpdateInterval READ logUpdateInterval WRITE
+                 setLogUpdateInterval NOTIFY logUpdateIntervalChanged)
+  Q_PROPERTY(MetricsReporter* metrics READ metrics CONSTANT)
+  Q_PROPERTY(bool autoReconnect READ autoReconnect WRITE setAutoReconnect
+                 NOTIFY autoReconnectChanged)
+  Q_PROPERTY(bool reliableDelivery READ reliableDelivery WRITE
+                 setReliableDelivery NOTIFY reliableDeliveryChanged)
+  Q_PROPERTY(bool compression READ compression WRITE setCompression NOTIFY
+                 compressionChanged)
 
   int m_serviceUuid{-1};
   int m_charUuid{-1};
 
   BLEScanner* m_scanner{nullptr};
+  DeviceModel* m_devices{nullptr};
   BLERFComm* m_comm{nullptr};
-  QStringList m_bleDeviceDescriptionList{};
+  // owns m_comm when the BLE stack runs on its own thread
+  QThread* m_ioThread{nullptr};
+  std::shared_ptr<DeviceCache> m_deviceCache{};
+  LogModel* m_log{nullptr};
+  // log lines waiting for the next view update, filled from both threads
+  std::vector<LogModel::Entry> m_pendingLog{};
+  std::mutex m_pendingLogMutex{};
+  QTimer* m_logTimer{nullptr};
+  MetricsReporter* m_metrics{nullptr};
+
+  // state of m_comm as last reported by its signals - it must not be called
+  // directly, as it might live on another thread
+  bool m_deviceReady{false};
+  // connect to the result of the running targeted scan
+  bool m_connectOnScanMatch{false};
+  bool m_extendedFraming{false};
+  bool m_autoReconnect{false};
+  bool m_reliableDelivery{false};
+  bool m_compression{false};
+  int m_maximumMessageSize{0};
 
  public:
-  explicit UIController(QObject* parent = nullptr);
+  // Where the BLE stack handles its I/O. On a worker thread, received data
+  // is processed regardless of how busy rendering keeps the GUI thread.
+  enum class IoMode { GuiThread, WorkerThread };
+
+  explicit UIController(IoMode ioMode = IoMode::GuiThread,
+                        QObject* parent = nullptr);
+  ~UIController() override;
 
   int serviceUuid() const;
   int charUuid() const;
 
-  QStringList bleDeviceDescriptionList() const;
+  DeviceModel* devices() const;
+  bool extendedFraming() const;
+  int maximumMessageSize() const;
+  LogModel* log() const;
+  int logUpdateInterval() const;
+  MetricsReporter* metrics() const;
+  bool autoReconnect() const;
+  bool reliableDelivery() const;
+  bool compression() const;
 
   Q_INVOKABLE bool isConnectedToDevice() const;
 
@@ -39,21 +94,53 @@ class UIController : public QObject
   void setCharUuid(int charUuid);
   void setServiceUuid(QString const& serviceUuid);
   void setCharUuid(QString const& charUuid);
+  void setExtendedFraming(bool enabled);
+  void setLogUpdateInterval(int milliseconds);
+  // Keeps reconnecting to the device after the link drops, with no limit
+  // on the attempts.
+  void setAutoReconnect(bool enabled);
+  // Acked, checksummed delivery with retransmissions, for devices that
+  // support it, see BLERFComm::setReliableDeliveryEnabled.
+  void setReliableDelivery(bool enabled);
+  // See BLERFComm::setCompressionEnabled.
+  void setCompression(bool enabled);
+  // See BLEComm::setConnectionProfiles.
+  void setConnectionProfiles(ConnectionProfiles const& profiles);
+  // Records the raw traffic of every connection to a capture file.
+  void startCapture(QString const& path);
+  // Plays a capture back in place of a real device, see ReplayTransport.
+  void replayCapture(QString const& path, bool realTime);
+
+  // Log lines go to the view in batches, at most once per update interval.
+  void logMessage(QString const& text,
+                  LogModel::Severity severity = LogModel::Info);
 
   void connectToDevice(int deviceIndex);
+  // Scans for the first device advertising the RFComm service and connects
+  // to it right away.
+  void connectToFirstDevice();
   void disconnectFromDevice();
   void scanForDevices();
   void sendMessageToDevice(QString const& message);
+  // Streams a file to the device as a blob. Blobs from the device are saved
+  // to the downloads folder.
+  void sendFile(QString const& path);
 
  private slots:
-  void bleScanCompletedHandler(int foundDevices);
   void bleScanErrorHandler(QBluetoothDeviceDiscoveryAgent::Error error_code,
                            QString const& description);
+  void bleScanCompletedHandler(int foundDevices);
+  void flushLog();
 
  signals:
   void serviceUuidChanged(int serviceUuid);
   void charUuidChanged(int charUuid);
-  void bleDeviceDescriptionListChanged(QStringList devList);
+  void extendedFramingChanged(bool enabled);
+  void maximumMessageSizeChanged(int maximumMessageSize);
+  void logUpdateIntervalChanged(int milliseconds);
+  void autoReconnectChanged(bool enabled);
+  void reliableDeliveryChanged(bool enabled);
+  void compressionChanged(bool enabled);
   void bleScanCompleted(int foundDevices);
   void bleScanError(QString const& description);
 
@@ -61,5 +148,12 @@ class UIController : public QObject
   void bleDeviceReady();
   void bleDeviceDisconnected();
   void bleDeviceError(QString const& description);
-  void messageReceived(QString const& data);
+
+ private:
+  void queueLogEntry(QString const& text, LogModel::Direction direction,
+                     LogModel::Severity severity);
+  void restoreKnownDevices();
+  // on the thread of m_comm
+  void watchBlob(BlobTransfer* transfer, QString const& what);
+  void receiveBlob(BlobTransfer* transfer);
 };